@@ -0,0 +1,149 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "FurShellVertexFactory.h"
+#include "Rendering/SkeletalMeshLODRenderData.h"
+#include "Rendering/ColorVertexBuffer.h"
+#include "GPUSkinVertexFactory.h"
+#include "MaterialShared.h"
+#include "MeshMaterialShader.h"
+#include "RenderUtils.h"
+
+/** Bone matrices and shell counts, bound per batch element. Vertex shader only. */
+class FFurShellVertexFactoryShaderParameters : public FVertexFactoryShaderParameters
+{
+public:
+	virtual void Bind(const FShaderParameterMap& ParameterMap) override
+	{
+		BoneMatrices.Bind(ParameterMap, TEXT("BoneMatrices"));
+		FurShellParameters.Bind(ParameterMap, TEXT("FurShellParameters"));
+	}
+
+	virtual void Serialize(FArchive& Ar) override
+	{
+		Ar << BoneMatrices;
+		Ar << FurShellParameters;
+	}
+
+	virtual void GetElementShaderBindings(const FSceneInterface* Scene, const FSceneView* View, const FMeshMaterialShader* Shader, bool bShaderRequiresPositionOnlyStream,
+		ERHIFeatureLevel::Type FeatureLevel, const FVertexFactory* VertexFactory, const FMeshBatchElement& BatchElement,
+		FMeshDrawSingleShaderBindings& ShaderBindings, FVertexInputStreamArray& VertexStreams) const override
+	{
+		const FFurShellVertexFactory::FBatchElementParams* Params = static_cast<const FFurShellVertexFactory::FBatchElementParams*>(BatchElement.VertexFactoryUserData);
+		check(Params);
+		ShaderBindings.Add(BoneMatrices, Params->BoneMatrices);
+		ShaderBindings.Add(FurShellParameters, FUintVector4(Params->NumShells, Params->TotalShells, 0, 0));
+	}
+
+	virtual uint32 GetSize() const override
+	{
+		return sizeof(*this);
+	}
+
+private:
+	FShaderResourceParameter BoneMatrices;
+	FShaderParameter FurShellParameters;
+};
+
+bool FFurShellVertexFactory::ShouldCompilePermutation(EShaderPlatform Platform, const FMaterial* Material, const FShaderType* ShaderType)
+{
+	// Special engine materials are the fallback when a shell material fails to compile.
+	return IsFeatureLevelSupported(Platform, ERHIFeatureLevel::SM5)
+		&& (Material->IsSpecialEngineMaterial() || (Material->IsUsedWithSkeletalMesh() && Material->IsUsedWithInstancedStaticMeshes()));
+}
+
+void FFurShellVertexFactory::ModifyCompilationEnvironment(const FVertexFactoryType* Type, EShaderPlatform Platform, const FMaterial* Material, FShaderCompilerEnvironment& OutEnvironment)
+{
+	OutEnvironment.SetDefine(TEXT("FUR_SHELL_VERTEX_FACTORY"), 1);
+}
+
+FVertexFactoryShaderParameters* FFurShellVertexFactory::ConstructShaderParameters(EShaderFrequency ShaderFrequency)
+{
+	return ShaderFrequency == SF_Vertex ? new FFurShellVertexFactoryShaderParameters() : nullptr;
+}
+
+void FFurShellVertexFactory::InitFromLOD(const FSkeletalMeshLODRenderData& LODData, const FColorVertexBuffer* OverrideColors)
+{
+	check(!LODData.SkinWeightVertexBuffer.HasExtraBoneInfluences());
+	FFurShellVertexFactory* VertexFactory = this;
+	const FSkeletalMeshLODRenderData* LODDataPtr = &LODData;
+	ENQUEUE_RENDER_COMMAND(InitFurShellVertexFactory)(
+		[VertexFactory, LODDataPtr, OverrideColors](FRHICommandListImmediate& RHICmdList)
+		{
+			FDataType NewData;
+			LODDataPtr->StaticVertexBuffers.PositionVertexBuffer.BindPositionVertexBuffer(VertexFactory, NewData);
+			LODDataPtr->StaticVertexBuffers.StaticMeshVertexBuffer.BindTangentVertexBuffer(VertexFactory, NewData);
+			LODDataPtr->StaticVertexBuffers.StaticMeshVertexBuffer.BindTexCoordVertexBuffer(VertexFactory, NewData);
+
+			const FColorVertexBuffer* ColorBuffer = OverrideColors ? OverrideColors : &LODDataPtr->StaticVertexBuffers.ColorVertexBuffer;
+			if (ColorBuffer->GetNumVertices() > 0)
+			{
+				ColorBuffer->BindColorVertexBuffer(VertexFactory, NewData);
+			}
+
+			// Same layout the GPU skin vertex factory reads: four bone indices, then four weights.
+			const FSkinWeightVertexBuffer& SkinWeights = LODDataPtr->SkinWeightVertexBuffer;
+			NewData.BoneIndices = FVertexStreamComponent(&SkinWeights, STRUCT_OFFSET(TSkinWeightInfo<false>, InfluenceBones), SkinWeights.GetStride(), VET_UByte4);
+			NewData.BoneWeights = FVertexStreamComponent(&SkinWeights, STRUCT_OFFSET(TSkinWeightInfo<false>, InfluenceWeights), SkinWeights.GetStride(), VET_UByte4N);
+
+			VertexFactory->SetData(NewData);
+			VertexFactory->InitResource();
+		});
+}
+
+bool FFurShellVertexFactory::HasShaders(const FMaterial& Material)
+{
+	const FMaterialShaderMap* ShaderMap = Material.GetRenderingThreadShaderMap();
+	return ShaderMap && ShaderMap->GetMeshShaderMap(&StaticType) != nullptr;
+}
+
+FShaderResourceViewRHIRef FFurShellVertexFactory::GetBoneMatrices(const FVertexFactory* GPUSkinVertexFactory)
+{
+	const FGPUBaseSkinVertexFactory* SkinVertexFactory = static_cast<const FGPUBaseSkinVertexFactory*>(GPUSkinVertexFactory);
+	return SkinVertexFactory->GetShaderData().GetBoneBufferForReading(false).VertexBufferSRV;
+}
+
+void FFurShellVertexFactory::SetData(const FDataType& InData)
+{
+	check(IsInRenderingThread());
+	Data = InData;
+	UpdateRHI();
+}
+
+void FFurShellVertexFactory::InitRHI()
+{
+	FVertexDeclarationElementList Elements;
+	Elements.Add(AccessStreamComponent(Data.PositionComponent, 0));
+	Elements.Add(AccessStreamComponent(Data.TangentBasisComponents[0], 1));
+	Elements.Add(AccessStreamComponent(Data.TangentBasisComponents[1], 2));
+	Elements.Add(AccessStreamComponent(Data.BoneIndices, 3));
+	Elements.Add(AccessStreamComponent(Data.BoneWeights, 4));
+
+	// Texture coordinates come two per attribute. Attributes past the mesh's last one repeat it, so materials
+	// reading more coordinates than the mesh has still get a stream.
+	const int32 BaseTexCoordAttribute = 5;
+	const int32 NumTexCoordAttributes = MAX_STATIC_TEXCOORDS / 2;
+	if (Data.TextureCoordinates.Num() > 0)
+	{
+		for (int32 CoordinateIndex = 0; CoordinateIndex < NumTexCoordAttributes; ++CoordinateIndex)
+		{
+			const int32 StreamIndex = FMath::Min(CoordinateIndex, Data.TextureCoordinates.Num() - 1);
+			Elements.Add(AccessStreamComponent(Data.TextureCoordinates[StreamIndex], BaseTexCoordAttribute + CoordinateIndex));
+		}
+	}
+
+	if (Data.ColorComponent.VertexBuffer)
+	{
+		Elements.Add(AccessStreamComponent(Data.ColorComponent, 13));
+	}
+	else
+	{
+		// White for every vertex, read from a single element.
+		FVertexStreamComponent NullColorComponent(&GNullColorVertexBuffer, 0, 0, VET_Color);
+		Elements.Add(AccessStreamComponent(NullColorComponent, 13));
+	}
+
+	InitDeclaration(Elements);
+}
+
+IMPLEMENT_VERTEX_FACTORY_TYPE(FFurShellVertexFactory, "/Plugin/FurShells/Private/FurShellVertexFactory.ush", true, false, true, false, false);
@@ -0,0 +1,21 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "CoreMinimal.h"
+#include "Modules/ModuleManager.h"
+#include "Interfaces/IPluginManager.h"
+#include "Misc/Paths.h"
+#include "ShaderCore.h"
+
+/** Maps /Plugin/FurShells to the plugin's shader directory. Loaded at PostConfigInit, before any shader is compiled. */
+class FFurShellsModule : public IModuleInterface
+{
+public:
+	virtual void StartupModule() override
+	{
+		const FString ShaderDirectory = FPaths::Combine(IPluginManager::Get().FindPlugin(TEXT("FurShells"))->GetBaseDir(), TEXT("Shaders"));
+		AddShaderSourceDirectoryMapping(TEXT("/Plugin/FurShells"), ShaderDirectory);
+	}
+};
+
+IMPLEMENT_MODULE(FFurShellsModule, FurShells)
@@ -0,0 +1,79 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "RenderResource.h"
+#include "VertexFactory.h"
+#include "Components.h"
+#include "SceneManagement.h"
+
+class FColorVertexBuffer;
+class FSkeletalMeshLODRenderData;
+class FMaterial;
+
+/**
+ * Draws every fur shell of a skeletal mesh section as one instance of a single draw. Skins the section in the
+ * vertex shader with up to four influences per vertex, reading the bone matrices of the section's GPU skin
+ * vertex factory, and hands the material the shell's layer, 0 at the skin, through Particle Relative Time.
+ *
+ * Materials are compiled for it when they are used with both skeletal meshes and instanced static meshes.
+ * SM5 only. Morph targets and cloth are not applied to the shells.
+ */
+class FURSHELLS_API FFurShellVertexFactory : public FVertexFactory
+{
+	DECLARE_VERTEX_FACTORY_TYPE(FFurShellVertexFactory);
+
+public:
+	struct FDataType : public FStaticMeshDataType
+	{
+		FVertexStreamComponent BoneIndices;
+		FVertexStreamComponent BoneWeights;
+	};
+
+	/** Per batch element data, pointed at by FMeshBatchElement::VertexFactoryUserData. */
+	struct FBatchElementParams : public FOneFrameResource
+	{
+		/** Bone matrices of the section's GPU skin vertex factory. */
+		FShaderResourceViewRHIRef BoneMatrices;
+		/** Shells drawn, which is the batch's instance count. */
+		uint32 NumShells;
+		/** Shells the component has; the drawn ones are spread over them so the full fur length is kept. */
+		uint32 TotalShells;
+
+		FBatchElementParams()
+			: NumShells(0)
+			, TotalShells(0)
+		{
+		}
+	};
+
+	explicit FFurShellVertexFactory(ERHIFeatureLevel::Type InFeatureLevel)
+		: FVertexFactory(InFeatureLevel)
+	{
+	}
+
+	static bool ShouldCompilePermutation(EShaderPlatform Platform, const FMaterial* Material, const FShaderType* ShaderType);
+	static void ModifyCompilationEnvironment(const FVertexFactoryType* Type, EShaderPlatform Platform, const FMaterial* Material, FShaderCompilerEnvironment& OutEnvironment);
+	static FVertexFactoryShaderParameters* ConstructShaderParameters(EShaderFrequency ShaderFrequency);
+
+	/**
+	 * Binds the vertex buffers of a skeletal mesh LOD and initializes the factory on the rendering thread.
+	 * OverrideColors replaces the mesh's vertex colours when not null. Both have to outlive the factory.
+	 * Only LODs without extra bone influences can be drawn with it.
+	 */
+	void InitFromLOD(const FSkeletalMeshLODRenderData& LODData, const FColorVertexBuffer* OverrideColors);
+
+	/** Whether Material compiled its shaders for this vertex factory. Rendering thread only. */
+	static bool HasShaders(const FMaterial& Material);
+
+	/** Bone matrices a GPU skin vertex factory was last updated with, to draw the same section with. */
+	static FShaderResourceViewRHIRef GetBoneMatrices(const FVertexFactory* GPUSkinVertexFactory);
+
+	void SetData(const FDataType& InData);
+
+	virtual void InitRHI() override;
+
+private:
+	FDataType Data;
+};
@@ -0,0 +1,404 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "FurBake.h"
+#include "Engine/SkeletalMesh.h"
+#include "Engine/Texture2D.h"
+#include "Rendering/SkeletalMeshRenderData.h"
+#include "Async/ParallelFor.h"
+#include "Serialization/MemoryReader.h"
+#include "Serialization/MemoryWriter.h"
+#if WITH_EDITOR
+#include "DerivedDataCacheInterface.h"
+#include "Rendering/SkeletalMeshModel.h"
+#endif
+
+DEFINE_LOG_CATEGORY_STATIC(LogFurBake, Log, All);
+
+// Change to invalidate every cached bake after a change to the bake or its encoding.
+#define FURBAKE_DERIVEDDATA_VER TEXT("A3F09B6E2C7D4185B1E6D03C9F8A7E24")
+
+namespace
+{
+	/** CPU copy of a fur map, sampled bilinearly with wrapping. */
+	struct FFurMapPixels
+	{
+		TArray<FColor> Pixels;
+		int32 SizeX = 0;
+		int32 SizeY = 0;
+
+		static bool CanRead(UTexture2D* Texture)
+		{
+#if WITH_EDITOR
+			if (Texture->Source.IsValid() && Texture->Source.GetFormat() == TSF_BGRA8)
+			{
+				return true;
+			}
+#endif
+			const FTexturePlatformData* PlatformData = Texture->PlatformData;
+			return PlatformData && PlatformData->PixelFormat == PF_B8G8R8A8 && PlatformData->Mips.Num() > 0
+				&& PlatformData->Mips[0].BulkData.IsBulkDataLoaded();
+		}
+
+		bool Read(UTexture2D* Texture)
+		{
+#if WITH_EDITOR
+			if (Texture->Source.IsValid() && Texture->Source.GetFormat() == TSF_BGRA8)
+			{
+				TArray<uint8> MipData;
+				if (Texture->Source.GetMipData(MipData, 0))
+				{
+					SizeX = Texture->Source.GetSizeX();
+					SizeY = Texture->Source.GetSizeY();
+					Pixels.SetNumUninitialized(SizeX * SizeY);
+					FMemory::Memcpy(Pixels.GetData(), MipData.GetData(), Pixels.Num() * sizeof(FColor));
+					return true;
+				}
+			}
+#endif
+			FTexturePlatformData* PlatformData = Texture->PlatformData;
+			if (PlatformData == nullptr || PlatformData->PixelFormat != PF_B8G8R8A8 || PlatformData->Mips.Num() == 0)
+			{
+				return false;
+			}
+			FTexture2DMipMap& Mip = PlatformData->Mips[0];
+			if (!Mip.BulkData.IsBulkDataLoaded())
+			{
+				return false;
+			}
+			SizeX = Mip.SizeX;
+			SizeY = Mip.SizeY;
+			Pixels.SetNumUninitialized(SizeX * SizeY);
+			const void* Data = Mip.BulkData.LockReadOnly();
+			FMemory::Memcpy(Pixels.GetData(), Data, Pixels.Num() * sizeof(FColor));
+			Mip.BulkData.Unlock();
+			return true;
+		}
+
+		FLinearColor Sample(const FVector2D& UV) const
+		{
+			const float X = UV.X * SizeX - 0.5f;
+			const float Y = UV.Y * SizeY - 0.5f;
+			const int32 X0 = FMath::FloorToInt(X);
+			const int32 Y0 = FMath::FloorToInt(Y);
+			const float FracX = X - X0;
+			const float FracY = Y - Y0;
+			auto Texel = [this](int32 InX, int32 InY)
+			{
+				InX = ((InX % SizeX) + SizeX) % SizeX;
+				InY = ((InY % SizeY) + SizeY) % SizeY;
+				return Pixels[InY * SizeX + InX].ReinterpretAsLinear();
+			};
+			return FMath::Lerp(
+				FMath::Lerp(Texel(X0, Y0), Texel(X0 + 1, Y0), FracX),
+				FMath::Lerp(Texel(X0, Y0 + 1), Texel(X0 + 1, Y0 + 1), FracX),
+				FracY);
+		}
+	};
+
+	/**
+	 * Baked meshes by cache key, so components sharing a mesh and settings share the bake. The components own the
+	 * bakes; entries of freed ones are pruned when a new one is added. Game thread only.
+	 */
+	TMap<FString, TWeakPtr<const FFurBakedMesh>> GFurBakeCache;
+
+	FString MakeBakeKey(const FString& MeshId, const FString& MapId, const FFurBakeSettings& Settings)
+	{
+		return FString::Printf(TEXT("%s_%s_%d_%.4f_%.4f_%.4f"), *MeshId, *MapId,
+			Settings.UVChannel, Settings.CombStrength, Settings.LengthScale, Settings.DensityScale);
+	}
+
+	/** The cooked bake as a shared bake, or null if its LODs don't match the mesh's render data. */
+	TSharedPtr<FFurBakedMesh> LoadCookedBake(const FFurCookedBake& Cooked, const FSkeletalMeshRenderData& RenderData)
+	{
+		if (Cooked.LODs.Num() != RenderData.LODRenderData.Num())
+		{
+			return nullptr;
+		}
+		TSharedPtr<FFurBakedMesh> Baked = MakeShared<FFurBakedMesh>();
+		Baked->LODs.SetNum(Cooked.LODs.Num());
+		for (int32 LODIndex = 0; LODIndex < Cooked.LODs.Num(); ++LODIndex)
+		{
+			const TArray<FColor>& Colors = Cooked.LODs[LODIndex].Colors;
+			if (Colors.Num() > 0 && Colors.Num() != (int32)RenderData.LODRenderData[LODIndex].GetNumVertices())
+			{
+				return nullptr;
+			}
+			Baked->LODs[LODIndex] = Colors;
+		}
+		return Baked;
+	}
+
+	/** Whether the LOD has the CPU copies the bake reads: tangents, the UVs for a fur map and any authored colours. */
+	bool HasBakeData(const FSkeletalMeshLODRenderData& LODData, bool bUseFurMap)
+	{
+		const FStaticMeshVertexBuffer& VertexBuffer = LODData.StaticVertexBuffers.StaticMeshVertexBuffer;
+		const FColorVertexBuffer& ColorBuffer = LODData.StaticVertexBuffers.ColorVertexBuffer;
+		const bool bHasColors = ColorBuffer.GetNumVertices() == LODData.GetNumVertices();
+		return VertexBuffer.GetTangentData() != nullptr && (!bUseFurMap || VertexBuffer.GetTexCoordData() != nullptr)
+			&& (!bHasColors || ColorBuffer.GetVertexData() != nullptr);
+	}
+
+	uint8 QuantizeUnorm(float Value)
+	{
+		return (uint8)FMath::RoundToInt(FMath::Clamp(Value, 0.0f, 1.0f) * 255.0f);
+	}
+
+	uint8 QuantizeSnorm(float Value)
+	{
+		return QuantizeUnorm(Value * 0.5f + 0.5f);
+	}
+}
+
+FColor FFurBake::EncodeVertex(const FVector& Direction, float Length, float Density)
+{
+	// Octahedral mapping: project onto the octahedron, fold the lower half over the diagonals.
+	const float L1 = FMath::Abs(Direction.X) + FMath::Abs(Direction.Y) + FMath::Abs(Direction.Z);
+	float X = Direction.X / L1;
+	float Y = Direction.Y / L1;
+	if (Direction.Z < 0.0f)
+	{
+		const float FoldedX = (1.0f - FMath::Abs(Y)) * (X >= 0.0f ? 1.0f : -1.0f);
+		const float FoldedY = (1.0f - FMath::Abs(X)) * (Y >= 0.0f ? 1.0f : -1.0f);
+		X = FoldedX;
+		Y = FoldedY;
+	}
+	return FColor(QuantizeSnorm(X), QuantizeSnorm(Y), QuantizeUnorm(Length), QuantizeUnorm(Density));
+}
+
+void FFurBake::DecodeVertex(FColor Color, FVector& OutDirection, float& OutLength, float& OutDensity)
+{
+	const float X = Color.R / 255.0f * 2.0f - 1.0f;
+	const float Y = Color.G / 255.0f * 2.0f - 1.0f;
+	FVector Direction(X, Y, 1.0f - FMath::Abs(X) - FMath::Abs(Y));
+	if (Direction.Z < 0.0f)
+	{
+		Direction.X = (1.0f - FMath::Abs(Y)) * (X >= 0.0f ? 1.0f : -1.0f);
+		Direction.Y = (1.0f - FMath::Abs(X)) * (Y >= 0.0f ? 1.0f : -1.0f);
+	}
+	OutDirection = Direction.GetSafeNormal();
+	OutLength = Color.B / 255.0f;
+	OutDensity = Color.A / 255.0f;
+}
+
+FString FFurBake::GetCacheKey(USkeletalMesh* Mesh, const FFurBakeSettings& Settings)
+{
+#if WITH_EDITOR
+	// Source ids change whenever the mesh or map is reimported, unlike their paths.
+	const FString MapId = Settings.FurMap ? Settings.FurMap->Source.GetId().ToString() : TEXT("VertexColor");
+	return MakeBakeKey(Mesh->GetImportedModel()->SkeletalMeshModelGUID.ToString(), MapId, Settings);
+#else
+	return GetCookedKey(Mesh, Settings);
+#endif
+}
+
+FString FFurBake::GetCookedKey(USkeletalMesh* Mesh, const FFurBakeSettings& Settings)
+{
+	const FString MapId = Settings.FurMap ? Settings.FurMap->GetPathName() : TEXT("VertexColor");
+	return MakeBakeKey(Mesh->GetPathName(), MapId, Settings);
+}
+
+TSharedPtr<const FFurBakedMesh> FFurBake::GetOrBuild(USkeletalMesh* Mesh, const FFurBakeSettings& Settings, const FFurCookedBake* Cooked)
+{
+	check(IsInGameThread());
+	if (Mesh == nullptr || Mesh->GetResourceForRendering() == nullptr)
+	{
+		return nullptr;
+	}
+
+	const FString Key = GetCacheKey(Mesh, Settings);
+	if (const TWeakPtr<const FFurBakedMesh>* Cached = GFurBakeCache.Find(Key))
+	{
+		if (TSharedPtr<const FFurBakedMesh> Shared = Cached->Pin())
+		{
+			return Shared;
+		}
+	}
+
+	TSharedPtr<FFurBakedMesh> Baked;
+	if (Cooked && Cooked->Key.Len() > 0 && Cooked->Key == GetCookedKey(Mesh, Settings))
+	{
+		Baked = LoadCookedBake(*Cooked, *Mesh->GetResourceForRendering());
+	}
+	if (!Baked.IsValid())
+	{
+#if WITH_EDITOR
+		const FString DerivedDataKey = FDerivedDataCacheInterface::BuildCacheKey(TEXT("FURBAKE"), FURBAKE_DERIVEDDATA_VER, *Key);
+		TArray<uint8> DerivedData;
+		if (GetDerivedDataCacheRef().GetSynchronous(*DerivedDataKey, DerivedData))
+		{
+			Baked = MakeShared<FFurBakedMesh>();
+			FMemoryReader Ar(DerivedData);
+			Ar << Baked->LODs;
+		}
+		else
+		{
+			Baked = Build(Mesh, Settings);
+			// LODs skipped for missing CPU data are baked once it is there, which doesn't change the key.
+			const bool bComplete = !Baked->LODs.ContainsByPredicate([](const TArray<FColor>& Colors) { return Colors.Num() == 0; });
+			if (bComplete)
+			{
+				FMemoryWriter Ar(DerivedData);
+				Ar << Baked->LODs;
+				GetDerivedDataCacheRef().Put(*DerivedDataKey, DerivedData);
+			}
+		}
+#else
+		Baked = Build(Mesh, Settings);
+#endif
+	}
+
+	if (Baked.IsValid())
+	{
+		for (auto It = GFurBakeCache.CreateIterator(); It; ++It)
+		{
+			if (!It.Value().IsValid())
+			{
+				It.RemoveCurrent();
+			}
+		}
+		GFurBakeCache.Add(Key, Baked);
+	}
+	return Baked;
+}
+
+#if WITH_EDITOR
+void FFurBake::Cook(USkeletalMesh* Mesh, const FFurBakeSettings& Settings, FFurCookedBake& OutCooked)
+{
+	OutCooked = FFurCookedBake();
+	const TSharedPtr<const FFurBakedMesh> Baked = GetOrBuild(Mesh, Settings);
+	if (!Baked.IsValid())
+	{
+		return;
+	}
+	OutCooked.Key = GetCookedKey(Mesh, Settings);
+	OutCooked.LODs.SetNum(Baked->LODs.Num());
+	for (int32 LODIndex = 0; LODIndex < Baked->LODs.Num(); ++LODIndex)
+	{
+		OutCooked.LODs[LODIndex].Colors = Baked->LODs[LODIndex];
+	}
+}
+#endif
+
+TSharedPtr<FFurBakedMesh> FFurBake::Build(USkeletalMesh* Mesh, const FFurBakeSettings& Settings)
+{
+	FFurMapPixels FurMap;
+	const bool bUseFurMap = Settings.FurMap && FurMap.Read(Settings.FurMap);
+	if (Settings.FurMap && !bUseFurMap)
+	{
+		UE_LOG(LogFurBake, Warning, TEXT("%s: fur map %s is not readable as uncompressed BGRA8, using vertex colours."),
+			*Mesh->GetName(), *Settings.FurMap->GetName());
+	}
+
+	FSkeletalMeshRenderData* RenderData = Mesh->GetResourceForRendering();
+	TSharedPtr<FFurBakedMesh> Baked = MakeShared<FFurBakedMesh>();
+	Baked->LODs.SetNum(RenderData->LODRenderData.Num());
+
+	for (int32 LODIndex = 0; LODIndex < RenderData->LODRenderData.Num(); ++LODIndex)
+	{
+		const FSkeletalMeshLODRenderData& LODData = RenderData->LODRenderData[LODIndex];
+		const FStaticMeshVertexBuffer& VertexBuffer = LODData.StaticVertexBuffers.StaticMeshVertexBuffer;
+		const FColorVertexBuffer& ColorBuffer = LODData.StaticVertexBuffers.ColorVertexBuffer;
+		const int32 NumVertices = LODData.GetNumVertices();
+
+		const bool bHasColors = ColorBuffer.GetNumVertices() == NumVertices;
+		if (!HasBakeData(LODData, bUseFurMap))
+		{
+			UE_LOG(LogFurBake, Warning, TEXT("%s LOD %d has no CPU copy of its vertices and is not fur baked, enable Allow CPU Access on the LOD."),
+				*Mesh->GetName(), LODIndex);
+			continue;
+		}
+		const uint32 UVChannel = FMath::Min<uint32>(Settings.UVChannel, FMath::Max<uint32>(VertexBuffer.GetNumTexCoords(), 1) - 1);
+
+		TArray<FColor>& Out = Baked->LODs[LODIndex];
+		Out.SetNumUninitialized(NumVertices);
+		ParallelFor(NumVertices, [&](int32 VertexIndex)
+		{
+			FLinearColor Painted(0.5f, 0.5f, 1.0f, 1.0f);
+			if (bUseFurMap)
+			{
+				Painted = FurMap.Sample(VertexBuffer.GetVertexUV(VertexIndex, UVChannel));
+			}
+			else if (bHasColors)
+			{
+				Painted = ColorBuffer.VertexColor(VertexIndex).ReinterpretAsLinear();
+			}
+
+			// Comb is painted in the tangent plane; tilt the normal towards it.
+			const FVector Direction = FVector(
+				(Painted.R * 2.0f - 1.0f) * Settings.CombStrength,
+				(Painted.G * 2.0f - 1.0f) * Settings.CombStrength,
+				1.0f).GetUnsafeNormal();
+			Out[VertexIndex] = EncodeVertex(Direction, Painted.B * Settings.LengthScale, Painted.A * Settings.DensityScale);
+		});
+	}
+	return Baked;
+}
+
+bool FFurBake::MakeVertexColorOverride(USkeletalMesh* Mesh, int32 LODIndex, const FFurBakedMesh& Baked, const TBitArray<>& FurrySections, TArray<FColor>& OutColors)
+{
+	const FSkeletalMeshRenderData* RenderData = Mesh->GetResourceForRendering();
+	if (RenderData == nullptr || !RenderData->LODRenderData.IsValidIndex(LODIndex) || !Baked.LODs.IsValidIndex(LODIndex))
+	{
+		return false;
+	}
+	const FSkeletalMeshLODRenderData& LODData = RenderData->LODRenderData[LODIndex];
+	const TArray<FColor>& BakedColors = Baked.LODs[LODIndex];
+	if (BakedColors.Num() != (int32)LODData.GetNumVertices() || FurrySections.Find(true) == INDEX_NONE)
+	{
+		return false;
+	}
+
+	// Sections without fur, the skin among them, keep their own colours.
+	const FColorVertexBuffer& ColorBuffer = LODData.StaticVertexBuffers.ColorVertexBuffer;
+	if (ColorBuffer.GetNumVertices() == (uint32)BakedColors.Num())
+	{
+		if (ColorBuffer.GetVertexData() == nullptr)
+		{
+			UE_LOG(LogFurBake, Warning, TEXT("%s LOD %d has no CPU copy of its vertex colours to keep on the sections without fur, its fur bake is not applied."),
+				*Mesh->GetName(), LODIndex);
+			return false;
+		}
+		OutColors.SetNumUninitialized(BakedColors.Num());
+		FMemory::Memcpy(OutColors.GetData(), ColorBuffer.GetVertexData(), OutColors.Num() * sizeof(FColor));
+	}
+	else
+	{
+		OutColors.Init(FColor::White, BakedColors.Num());
+	}
+
+	for (int32 SectionIndex = 0; SectionIndex < LODData.RenderSections.Num() && SectionIndex < FurrySections.Num(); ++SectionIndex)
+	{
+		const FSkelMeshRenderSection& Section = LODData.RenderSections[SectionIndex];
+		if (FurrySections[SectionIndex] && Section.NumVertices > 0)
+		{
+			FMemory::Memcpy(&OutColors[Section.BaseVertexIndex], &BakedColors[Section.BaseVertexIndex], Section.NumVertices * sizeof(FColor));
+		}
+	}
+	return true;
+}
+
+#if WITH_EDITOR
+void FFurBake::GetProblems(USkeletalMesh* Mesh, const FFurBakeSettings& Settings, TArray<FString>& OutProblems)
+{
+	const FSkeletalMeshRenderData* RenderData = Mesh->GetResourceForRendering();
+	if (RenderData == nullptr)
+	{
+		return;
+	}
+	const bool bUseFurMap = Settings.FurMap && FFurMapPixels::CanRead(Settings.FurMap);
+	if (Settings.FurMap && !bUseFurMap)
+	{
+		OutProblems.Add(FString::Printf(TEXT("Fur map %s is not uncompressed BGRA8, the fur bake of %s reads vertex colours instead."),
+			*Settings.FurMap->GetName(), *Mesh->GetName()));
+	}
+	for (int32 LODIndex = 0; LODIndex < RenderData->LODRenderData.Num(); ++LODIndex)
+	{
+		if (!HasBakeData(RenderData->LODRenderData[LODIndex], bUseFurMap))
+		{
+			OutProblems.Add(FString::Printf(TEXT("%s LOD %d is not fur baked: it has no CPU copy of its vertices. Enable Allow CPU Access on the LOD."),
+				*Mesh->GetName(), LODIndex));
+		}
+	}
+}
+#endif
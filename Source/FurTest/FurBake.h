@@ -0,0 +1,115 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "FurBake.generated.h"
+
+class USkeletalMesh;
+class UTexture2D;
+
+/**
+ * Inputs of the per-vertex fur bake.
+ * Painted values are read as R/G comb direction in tangent space (0.5 = none), B length and A density.
+ */
+USTRUCT(BlueprintType)
+struct FFurBakeSettings
+{
+	GENERATED_BODY()
+
+	/** Painted fur map sampled at each vertex. Vertex colours are used when unset. Must be uncompressed BGRA8. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Fur Bake")
+	UTexture2D* FurMap;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Fur Bake", meta = (ClampMin = "0", ClampMax = "7"))
+	int32 UVChannel;
+
+	/** How far a full comb value tilts the fur from the normal. 0 keeps the fur upright. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Fur Bake", meta = (ClampMin = "0.0"))
+	float CombStrength;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Fur Bake", meta = (ClampMin = "0.0"))
+	float LengthScale;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Fur Bake", meta = (ClampMin = "0.0"))
+	float DensityScale;
+
+	FFurBakeSettings()
+		: FurMap(nullptr)
+		, UVChannel(0)
+		, CombStrength(1.0f)
+		, LengthScale(1.0f)
+		, DensityScale(1.0f)
+	{
+	}
+};
+
+/** Baked fur stream of a mesh, one colour per render vertex and LOD. An LOD is left empty where it can't be baked. */
+struct FFurBakedMesh
+{
+	TArray<TArray<FColor>> LODs;
+};
+
+USTRUCT()
+struct FFurCookedBakeLOD
+{
+	GENERATED_BODY()
+
+	UPROPERTY()
+	TArray<FColor> Colors;
+};
+
+/** Bake saved with a cooked component, so cooked builds neither rebake nor need CPU access to the mesh. */
+USTRUCT()
+struct FFurCookedBake
+{
+	GENERATED_BODY()
+
+	/** Mesh, fur map and settings the bake was made for; it is ignored once they change. */
+	UPROPERTY()
+	FString Key;
+
+	UPROPERTY()
+	TArray<FFurCookedBakeLOD> LODs;
+};
+
+/**
+ * Bakes per-vertex fur direction, length and density from a skeletal mesh's render data.
+ * The result is quantized to one FColor per vertex: R/G octahedral tangent space direction, B length, A density,
+ * and is shared in memory while a component uses it and, in the editor, cached in the derived data cache.
+ * Cooked components carry their bake, see Cook.
+ */
+struct FURTEST_API FFurBake
+{
+	/**
+	 * Returns the bake for the mesh and settings: the shared one, Cooked if it was made for them, or a new build.
+	 * LODs without CPU readable data are left empty.
+	 */
+	static TSharedPtr<const FFurBakedMesh> GetOrBuild(USkeletalMesh* Mesh, const FFurBakeSettings& Settings, const FFurCookedBake* Cooked = nullptr);
+
+	/**
+	 * Vertex colours for one LOD with the bake on the vertices of FurrySections and the authored colours, or white,
+	 * everywhere else. False if the LOD wasn't baked or its authored colours can't be read to keep them.
+	 */
+	static bool MakeVertexColorOverride(USkeletalMesh* Mesh, int32 LODIndex, const FFurBakedMesh& Baked, const TBitArray<>& FurrySections, TArray<FColor>& OutColors);
+
+#if WITH_EDITOR
+	/** Why the bake of the mesh falls short of the settings: an unreadable fur map or LODs that can't be baked. */
+	static void GetProblems(USkeletalMesh* Mesh, const FFurBakeSettings& Settings, TArray<FString>& OutProblems);
+#endif
+
+#if WITH_EDITOR
+	/** Fills OutCooked with the bake for the mesh and settings, to be saved with a cooked component. Empty if it can't be built. */
+	static void Cook(USkeletalMesh* Mesh, const FFurBakeSettings& Settings, FFurCookedBake& OutCooked);
+#endif
+
+	/** Quantizes one baked vertex. Direction is in tangent space and normalized by the caller. */
+	static FColor EncodeVertex(const FVector& Direction, float Length, float Density);
+	static void DecodeVertex(FColor Color, FVector& OutDirection, float& OutLength, float& OutDensity);
+
+private:
+	static TSharedPtr<FFurBakedMesh> Build(USkeletalMesh* Mesh, const FFurBakeSettings& Settings);
+	static FString GetCacheKey(USkeletalMesh* Mesh, const FFurBakeSettings& Settings);
+	/** Key of a cooked bake, made from asset paths so it reads the same in the editor and in cooked builds. */
+	static FString GetCookedKey(USkeletalMesh* Mesh, const FFurBakeSettings& Settings);
+};
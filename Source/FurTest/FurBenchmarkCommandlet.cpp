@@ -0,0 +1,211 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "FurBenchmarkCommandlet.h"
+#include "FurTestCharacter.h"
+#include "FurSkeletalMeshComponent.h"
+#include "FurStats.h"
+#include "Engine/Engine.h"
+#include "Engine/World.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "RenderingThread.h"
+#include "Components/SceneCaptureComponent2D.h"
+#include "Engine/TextureRenderTarget2D.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogFurBenchmark, Log, All);
+
+UFurBenchmarkCommandlet::UFurBenchmarkCommandlet()
+{
+	IsClient = false;
+	IsServer = false;
+	IsEditor = true;
+	LogToConsole = true;
+	ShowErrorCount = true;
+}
+
+int32 UFurBenchmarkCommandlet::Main(const FString& Params)
+{
+	if (FParse::Param(*Params, TEXT("micro")))
+	{
+		int32 Iterations = 100000;
+		FParse::Value(*Params, TEXT("iterations="), Iterations);
+		RunShadowParameterBenchmark(FMath::Max(Iterations, 1));
+		return 0;
+	}
+
+	int32 NumCharacters = 50;
+	int32 NumFrames = 300;
+	int32 NumWarmupFrames = 30;
+	float Threshold = 0.1f;
+	FString ClassPath = TEXT("/Game/ThirdPersonCPP/Blueprints/ThirdPersonCharacter.ThirdPersonCharacter_C");
+	FString CsvPath = FPaths::ProjectSavedDir() / TEXT("Profiling") / TEXT("FurBenchmark.csv");
+	FString BaselinePath;
+
+	FParse::Value(*Params, TEXT("characters="), NumCharacters);
+	FParse::Value(*Params, TEXT("frames="), NumFrames);
+	FParse::Value(*Params, TEXT("warmup="), NumWarmupFrames);
+	FParse::Value(*Params, TEXT("threshold="), Threshold);
+	FParse::Value(*Params, TEXT("class="), ClassPath);
+	FParse::Value(*Params, TEXT("csv="), CsvPath);
+	FParse::Value(*Params, TEXT("baseline="), BaselinePath);
+	const bool bShadows = !FParse::Param(*Params, TEXT("noshadow"));
+	const bool bShadowAtlas = FParse::Param(*Params, TEXT("atlas"));
+
+	NumCharacters = FMath::Max(NumCharacters, 1);
+	NumFrames = FMath::Max(NumFrames, 1);
+
+	UClass* CharacterClass = LoadClass<AFurTestCharacter>(nullptr, *ClassPath);
+	if (CharacterClass == nullptr)
+	{
+		UE_LOG(LogFurBenchmark, Warning, TEXT("Could not load %s, falling back to AFurTestCharacter (no mesh, so no fur proxies)."), *ClassPath);
+		CharacterClass = AFurTestCharacter::StaticClass();
+	}
+
+	UWorld* World = UWorld::CreateWorld(EWorldType::Game, false, TEXT("FurBenchmark"));
+	FWorldContext& WorldContext = GEngine->CreateNewWorldContext(EWorldType::Game);
+	WorldContext.SetCurrentWorld(World);
+	World->InitializeActorsForPlay(FURL());
+	World->BeginPlay();
+
+	FFurTimings::Reset();
+	FFurTimings::SetEnabled(true);
+
+	// Grid of characters, far enough apart not to overlap.
+	const int32 GridSize = FMath::CeilToInt(FMath::Sqrt((float)NumCharacters));
+	int32 NumSpawned = 0;
+	for (int32 i = 0; i < NumCharacters; ++i)
+	{
+		const FVector Location((i % GridSize) * 200.0f, (i / GridSize) * 200.0f, 100.0f);
+		FActorSpawnParameters SpawnParameters;
+		SpawnParameters.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+		AFurTestCharacter* Character = World->SpawnActor<AFurTestCharacter>(CharacterClass, Location, FRotator::ZeroRotator, SpawnParameters);
+		if (Character && Character->furMesh)
+		{
+			Character->furMesh->SetBuiltInShadow(bShadows && !bShadowAtlas);
+			Character->furMesh->SetShadowAtlas(bShadows && bShadowAtlas);
+			++NumSpawned;
+		}
+	}
+	FlushRenderingCommands();
+	const double ProxyMilliseconds = FFurTimings::GetMilliseconds(EFurTiming::CreateSceneProxy);
+	const uint64 ProxyCalls = FFurTimings::GetCalls(EFurTiming::CreateSceneProxy);
+
+	const float DeltaTime = 1.0f / 30.0f;
+	for (int32 Frame = 0; Frame < NumWarmupFrames + NumFrames; ++Frame)
+	{
+		if (Frame == NumWarmupFrames)
+		{
+			FFurTimings::Reset();
+		}
+		World->Tick(LEVELTICK_All, DeltaTime);
+		GFrameCounter++;
+		FlushRenderingCommands();
+	}
+
+	FFurTimings::SetEnabled(false);
+
+	// metric,total_ms,per_character_us,calls; per frame for the ticking metrics, once for proxy creation.
+	const double PerCharacterFrame = 1000.0 / ((double)NumSpawned * NumFrames);
+	TMap<FString, double> Results;
+	FString Csv = TEXT("metric,total_ms,per_character_us,calls\n");
+	auto AddRow = [&Csv, &Results](const TCHAR* Metric, double TotalMilliseconds, double PerCharacterMicroseconds, uint64 Calls)
+	{
+		Results.Add(Metric, PerCharacterMicroseconds);
+		Csv += FString::Printf(TEXT("%s,%.4f,%.4f,%llu\n"), Metric, TotalMilliseconds, PerCharacterMicroseconds, Calls);
+	};
+
+	const EFurTiming FrameTimings[] = { EFurTiming::TickComponent, EFurTiming::ShadowTick, EFurTiming::GetDynamicMeshElements, EFurTiming::Dynamics };
+	for (EFurTiming Timing : FrameTimings)
+	{
+		const double Milliseconds = FFurTimings::GetMilliseconds(Timing);
+		AddRow(FFurTimings::GetName(Timing), Milliseconds, NumSpawned > 0 ? Milliseconds * PerCharacterFrame : 0.0, FFurTimings::GetCalls(Timing));
+	}
+	AddRow(FFurTimings::GetName(EFurTiming::CreateSceneProxy), ProxyMilliseconds, NumSpawned > 0 ? ProxyMilliseconds * 1000.0 / NumSpawned : 0.0, ProxyCalls);
+
+	UE_LOG(LogFurBenchmark, Display, TEXT("%d characters, %d frames:\n%s"), NumSpawned, NumFrames, *Csv);
+	if (!FFileHelper::SaveStringToFile(Csv, *CsvPath))
+	{
+		UE_LOG(LogFurBenchmark, Error, TEXT("Could not write %s"), *CsvPath);
+	}
+
+	int32 Result = 0;
+	if (!BaselinePath.IsEmpty())
+	{
+		TMap<FString, double> Baseline;
+		if (!LoadBaseline(BaselinePath, Baseline))
+		{
+			UE_LOG(LogFurBenchmark, Error, TEXT("Could not read baseline %s"), *BaselinePath);
+			Result = 1;
+		}
+		for (const TPair<FString, double>& Entry : Results)
+		{
+			const double* BaselineValue = Baseline.Find(Entry.Key);
+			if (BaselineValue && *BaselineValue > 0.0 && Entry.Value > *BaselineValue * (1.0 + Threshold))
+			{
+				UE_LOG(LogFurBenchmark, Error, TEXT("Regression in %s: %.4f us per character, baseline %.4f us (+%.1f%%)"),
+					*Entry.Key, Entry.Value, *BaselineValue, (Entry.Value / *BaselineValue - 1.0) * 100.0);
+				Result = 1;
+			}
+		}
+	}
+
+	GEngine->DestroyWorldContext(World);
+	World->DestroyWorld(false);
+
+	return Result;
+}
+
+bool UFurBenchmarkCommandlet::LoadBaseline(const FString& Path, TMap<FString, double>& OutPerCharacterMicroseconds)
+{
+	TArray<FString> Lines;
+	if (!FFileHelper::LoadFileToStringArray(Lines, *Path))
+	{
+		return false;
+	}
+	for (int32 i = 1; i < Lines.Num(); ++i)
+	{
+		TArray<FString> Columns;
+		Lines[i].ParseIntoArray(Columns, TEXT(","));
+		if (Columns.Num() >= 3)
+		{
+			OutPerCharacterMicroseconds.Add(Columns[0], FCString::Atod(*Columns[2]));
+		}
+	}
+	return true;
+}
+
+void UFurBenchmarkCommandlet::RunShadowParameterBenchmark(int32 Iterations)
+{
+	USceneCaptureComponent2D* Caster = NewObject<USceneCaptureComponent2D>(GetTransientPackage());
+	Caster->TextureTarget = NewObject<UTextureRenderTarget2D>(GetTransientPackage());
+	Caster->TextureTarget->SizeX = 512;
+	Caster->TextureTarget->SizeY = 512;
+	Caster->ProjectionType = ECameraProjectionMode::Orthographic;
+	Caster->OrthoWidth = 400.0f;
+
+	const FTransform CasterTransform(FRotator(-60.0f, 30.0f, 0.0f), FVector(120.0f, -40.0f, 300.0f));
+	FLinearColor Cols[4];
+	float Sink = 0.0f;
+
+	double StartTime = FPlatformTime::Seconds();
+	for (int32 i = 0; i < Iterations; ++i)
+	{
+		UFurSkeletalMeshComponent::ComputeShadowProjection(CasterTransform, FIntPoint(512, 512), ECameraProjectionMode::Orthographic, 90.0f, 400.0f + (i & 1), Cols);
+		Sink += Cols[0].R;
+	}
+	const double ProjectionNanoseconds = (FPlatformTime::Seconds() - StartTime) * 1.e9 / Iterations;
+
+	FFurShadowParameters Parameters;
+	StartTime = FPlatformTime::Seconds();
+	for (int32 i = 0; i < Iterations; ++i)
+	{
+		Caster->OrthoWidth = 400.0f + (i & 1);
+		UFurSkeletalMeshComponent::ComputeShadowParameters(Caster, Parameters);
+		Sink += Parameters.ProjCol[0].R;
+	}
+	const double ParametersNanoseconds = (FPlatformTime::Seconds() - StartTime) * 1.e9 / Iterations;
+
+	UE_LOG(LogFurBenchmark, Display, TEXT("ComputeShadowProjection: %.1f ns/call, ComputeShadowParameters: %.1f ns/call (%d iterations, %f)"),
+		ProjectionNanoseconds, ParametersNanoseconds, Iterations, Sink);
+}
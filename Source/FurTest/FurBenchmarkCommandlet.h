@@ -0,0 +1,44 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "FurBenchmarkCommandlet.generated.h"
+
+/**
+ * Spawns a crowd of fur characters in an empty game world, ticks it for a fixed number of frames
+ * and writes the fur CPU cost per character as CSV.
+ *
+ * UE4Editor-Cmd FurTest.uproject -run=FurBenchmark -nullrhi [-characters=50] [-frames=300] [-warmup=30]
+ *     [-class=/Game/ThirdPersonCPP/Blueprints/ThirdPersonCharacter.ThirdPersonCharacter_C] [-noshadow] [-atlas]
+ *     [-csv=<path>] [-baseline=<path>] [-threshold=0.1]
+ *
+ * With -baseline, every metric whose per-character time grew by more than -threshold (a fraction)
+ * over the baseline CSV is reported as a regression and the commandlet returns 1.
+ * GetDynamicMeshElements is only timed when a renderer runs, so it reads 0 under -nullrhi.
+ *
+ * -atlas keeps the fur shadows in the shared fur shadow atlas texture instead of a render target per character.
+ * Every character still takes its own shadow capture.
+ *
+ * -micro skips the crowd and instead times the per-frame shadow parameter update path. The shadow projection,
+ * the shell skinning choice and significance are checked by the FurTest.Shadow.Projection, FurTest.Shells.Skinning
+ * and FurTest.Significance automation tests.
+ */
+UCLASS()
+class UFurBenchmarkCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+	UFurBenchmarkCommandlet();
+
+	virtual int32 Main(const FString& Params) override;
+
+private:
+	/** Times ComputeShadowProjection and ComputeShadowParameters over Iterations calls. */
+	static void RunShadowParameterBenchmark(int32 Iterations);
+
+	/** Reads metric -> per character microseconds from a CSV written by this commandlet. */
+	static bool LoadBaseline(const FString& Path, TMap<FString, double>& OutPerCharacterMicroseconds);
+};
@@ -0,0 +1,208 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "FurBudget.h"
+#include "FurSkeletalMeshComponent.h"
+#include "FurSkeletalMeshSceneProxy.h"
+#include "Engine/World.h"
+
+static TAutoConsoleVariable<int32> CVarFurBudgetMaxShellPasses(
+	TEXT("fur.Budget.MaxShellPasses"),
+	0,
+	TEXT("Most shell passes (shells times furry sections) drawn per frame across all fur components of a world.\n")
+	TEXT("Shared out by screen size and importance. 0 for no limit. Set per FoliageQuality level in Scalability.ini."),
+	ECVF_Scalability);
+
+static TAutoConsoleVariable<int32> CVarFurBudgetMinShells(
+	TEXT("fur.Budget.MinShells"),
+	2,
+	TEXT("Shells a visible fur component keeps however tight the budget is."),
+	ECVF_Scalability);
+
+static TAutoConsoleVariable<float> CVarFurBudgetRecentlyRenderedTime(
+	TEXT("fur.Budget.RecentlyRenderedTime"),
+	0.2f,
+	TEXT("Seconds since a fur component was last rendered for it to still take part in the budget."),
+	ECVF_Default);
+
+namespace
+{
+	TMap<TWeakObjectPtr<UWorld>, TUniquePtr<FFurShellBudget>> GBudgets;
+	FDelegateHandle GPostActorTickHandle;
+}
+
+FFurShellBudget* FFurShellBudget::Find(UWorld* World)
+{
+	TUniquePtr<FFurShellBudget>* Budget = GBudgets.Find(World);
+	return Budget ? Budget->Get() : nullptr;
+}
+
+void FFurShellBudget::Register(UFurSkeletalMeshComponent* Component)
+{
+	check(IsInGameThread());
+	UWorld* World = Component->GetWorld();
+	if (World == nullptr)
+	{
+		return;
+	}
+
+	FFurShellBudget* Budget = Find(World);
+	if (Budget == nullptr)
+	{
+		Budget = GBudgets.Add(World, MakeUnique<FFurShellBudget>()).Get();
+		if (!GPostActorTickHandle.IsValid())
+		{
+			GPostActorTickHandle = FWorldDelegates::OnWorldPostActorTick.AddStatic(&FFurShellBudget::OnWorldPostActorTick);
+		}
+	}
+
+	if (!Budget->Entries.ContainsByPredicate([Component](const FEntry& Entry) { return Entry.Component == Component; }))
+	{
+		FEntry& Entry = Budget->Entries.AddDefaulted_GetRef();
+		Entry.Component = Component;
+		Entry.PushedShellCount = -1;
+	}
+}
+
+void FFurShellBudget::Unregister(UFurSkeletalMeshComponent* Component)
+{
+	check(IsInGameThread());
+	FFurShellBudget* Budget = Find(Component->GetWorld());
+	if (Budget == nullptr)
+	{
+		return;
+	}
+	Budget->Entries.RemoveAll([Component](const FEntry& Entry) { return Entry.Component == Component; });
+	if (Budget->Entries.Num() == 0)
+	{
+		GBudgets.Remove(Component->GetWorld());
+	}
+	if (GBudgets.Num() == 0 && GPostActorTickHandle.IsValid())
+	{
+		FWorldDelegates::OnWorldPostActorTick.Remove(GPostActorTickHandle);
+		GPostActorTickHandle.Reset();
+	}
+}
+
+void FFurShellBudget::OnWorldPostActorTick(UWorld* World, ELevelTick TickType, float DeltaSeconds)
+{
+	if (FFurShellBudget* Budget = Find(World))
+	{
+		Budget->Tick(World);
+	}
+}
+
+void FFurShellBudget::Allocate(float Budget, const TArray<float>& Weights, const TArray<float>& Demands, TArray<float>& OutAllocations)
+{
+	check(Weights.Num() == Demands.Num());
+	OutAllocations.Init(0.0f, Weights.Num());
+
+	TArray<int32, TInlineAllocator<64>> Open;
+	float OpenWeight = 0.0f;
+	for (int32 Index = 0; Index < Weights.Num(); ++Index)
+	{
+		if (Weights[Index] > 0.0f && Demands[Index] > 0.0f)
+		{
+			Open.Add(Index);
+			OpenWeight += Weights[Index];
+		}
+	}
+
+	// Water filling: hand out shares, cap whoever gets more than they need, reshare the rest.
+	float Remaining = Budget;
+	bool bCapped = true;
+	while (bCapped && Open.Num() > 0 && Remaining > 0.0f)
+	{
+		bCapped = false;
+		for (int32 OpenIndex = Open.Num() - 1; OpenIndex >= 0; --OpenIndex)
+		{
+			const int32 Index = Open[OpenIndex];
+			if (Remaining * Weights[Index] / OpenWeight >= Demands[Index])
+			{
+				OutAllocations[Index] = Demands[Index];
+				Remaining -= Demands[Index];
+				OpenWeight -= Weights[Index];
+				Open.RemoveAtSwap(OpenIndex);
+				bCapped = true;
+			}
+		}
+	}
+	for (int32 Index : Open)
+	{
+		OutAllocations[Index] = FMath::Max(Remaining, 0.0f) * Weights[Index] / OpenWeight;
+	}
+}
+
+void FFurShellBudget::Tick(UWorld* World)
+{
+	Entries.RemoveAll([](const FEntry& Entry) { return !Entry.Component.IsValid(); });
+
+	const int32 MaxShellPasses = CVarFurBudgetMaxShellPasses.GetValueOnGameThread();
+	const int32 MinShells = FMath::Max(CVarFurBudgetMinShells.GetValueOnGameThread(), 0);
+	const float RecentlyRenderedTime = CVarFurBudgetRecentlyRenderedTime.GetValueOnGameThread();
+
+	// Weight is screen area from the closest view times importance; the demand is every shell on every furry section.
+	TArray<float> Weights;
+	TArray<float> Demands;
+	TArray<int32> ShellsPerPass;
+	Weights.Reserve(Entries.Num());
+	Demands.Reserve(Entries.Num());
+	ShellsPerPass.Reserve(Entries.Num());
+	for (const FEntry& Entry : Entries)
+	{
+		UFurSkeletalMeshComponent* Component = Entry.Component.Get();
+		int32 MaxShells = 0;
+		int32 NumFurSections = 0;
+		Component->GetShellPassDemand(MaxShells, NumFurSections);
+
+		float Weight = 0.0f;
+		if (MaxShellPasses > 0)
+		{
+			Weight = FMath::Square(Component->GetFurScreenSize(RecentlyRenderedTime)) * FMath::Max(Component->FurBudgetImportance, 0.0f);
+		}
+		Weights.Add(Weight);
+		Demands.Add((float)(MaxShells * NumFurSections));
+		ShellsPerPass.Add(NumFurSections);
+	}
+
+	TArray<float> Allocations;
+	Allocate((float)MaxShellPasses, Weights, Demands, Allocations);
+
+	TArray<TPair<FurSkeletalMeshSceneProxy*, int32>> ProxyUpdates;
+	for (int32 Index = 0; Index < Entries.Num(); ++Index)
+	{
+		FEntry& Entry = Entries[Index];
+		UFurSkeletalMeshComponent* Component = Entry.Component.Get();
+
+		// Components that weren't rendered keep their cap until they are weighed again.
+		int32 ShellCount = Component->BudgetShellCount;
+		if (MaxShellPasses <= 0)
+		{
+			ShellCount = -1;
+		}
+		else if (Weights[Index] > 0.0f && ShellsPerPass[Index] > 0)
+		{
+			ShellCount = FMath::Max(FMath::FloorToInt(Allocations[Index] / ShellsPerPass[Index]), MinShells);
+		}
+
+		FurSkeletalMeshSceneProxy* FurProxy = static_cast<FurSkeletalMeshSceneProxy*>(Component->SceneProxy);
+		if (ShellCount != Entry.PushedShellCount && FurProxy)
+		{
+			ProxyUpdates.Emplace(FurProxy, ShellCount);
+			Entry.PushedShellCount = ShellCount;
+		}
+		Component->BudgetShellCount = ShellCount;
+	}
+
+	if (ProxyUpdates.Num() > 0)
+	{
+		ENQUEUE_RENDER_COMMAND(FurUpdateShellBudget)(
+			[ProxyUpdates = MoveTemp(ProxyUpdates)](FRHICommandListImmediate& RHICmdList)
+			{
+				for (const TPair<FurSkeletalMeshSceneProxy*, int32>& Update : ProxyUpdates)
+				{
+					Update.Key->SetBudgetShellCount_RenderThread(Update.Value);
+				}
+			});
+	}
+}
@@ -0,0 +1,41 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+class UWorld;
+class UFurSkeletalMeshComponent;
+
+/**
+ * Shares a per-world budget of shell passes (shells times furry sections) between the fur components that were
+ * rendered recently, weighted by screen size and FurBudgetImportance. Each component gets a shell cap that its
+ * scene proxy applies on top of the shell LOD. Runs once per world tick; see fur.Budget.* for the settings.
+ */
+class FURTEST_API FFurShellBudget
+{
+public:
+	static void Register(UFurSkeletalMeshComponent* Component);
+	static void Unregister(UFurSkeletalMeshComponent* Component);
+
+	/**
+	 * Splits Budget between demands in proportion to their weights, never giving more than asked for;
+	 * what a capped entry doesn't need goes to the others. Zero weights get nothing.
+	 */
+	static void Allocate(float Budget, const TArray<float>& Weights, const TArray<float>& Demands, TArray<float>& OutAllocations);
+
+private:
+	struct FEntry
+	{
+		TWeakObjectPtr<UFurSkeletalMeshComponent> Component;
+		/** Shell cap last sent to the proxy, negative for none. */
+		int32 PushedShellCount;
+	};
+
+	TArray<FEntry> Entries;
+
+	static FFurShellBudget* Find(UWorld* World);
+	static void OnWorldPostActorTick(UWorld* World, ELevelTick TickType, float DeltaSeconds);
+
+	void Tick(UWorld* World);
+};
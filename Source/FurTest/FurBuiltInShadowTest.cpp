@@ -0,0 +1,57 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "FurSkeletalMeshComponent.h"
+#include "FurSkeletalMeshSceneProxy.h"
+#include "Engine/Engine.h"
+#include "Engine/World.h"
+#include "Engine/SkeletalMesh.h"
+#include "GameFramework/Actor.h"
+#include "RenderingThread.h"
+#include "Misc/AutomationTest.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FFurBuiltInShadowTest, "FurTest.Shadow.BuiltInRelease", EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::ProductFilter)
+
+bool FFurBuiltInShadowTest::RunTest(const FString& Parameters)
+{
+	USkeletalMesh* Mesh = LoadObject<USkeletalMesh>(nullptr, TEXT("/Game/Mannequin/Character/Mesh/SK_Mannequin.SK_Mannequin"));
+	if (!TestNotNull(TEXT("Mannequin mesh"), Mesh))
+	{
+		return false;
+	}
+
+	// The built-in shadow is only made in game worlds.
+	UWorld* World = UWorld::CreateWorld(EWorldType::Game, false);
+	FWorldContext& WorldContext = GEngine->CreateNewWorldContext(EWorldType::Game);
+	WorldContext.SetCurrentWorld(World);
+	World->InitializeActorsForPlay(FURL());
+	World->BeginPlay();
+
+	AActor* Actor = World->SpawnActor<AActor>();
+	UFurSkeletalMeshComponent* Fur = NewObject<UFurSkeletalMeshComponent>(Actor);
+	Fur->SetSkeletalMesh(Mesh);
+	Fur->RegisterComponent();
+	Fur->SetBuiltInShadow(true);
+	// Pushes the built-in target to the proxy now instead of on the next capture.
+	Fur->SetShadowCaster(Fur->ShadowCaster());
+	FlushRenderingCommands();
+
+	const FurSkeletalMeshSceneProxy* FurProxy = static_cast<const FurSkeletalMeshSceneProxy*>(Fur->SceneProxy);
+	if (TestNotNull(TEXT("Fur scene proxy"), FurProxy))
+	{
+		TestNotNull(TEXT("Proxy shadow map with the built-in shadow on"), FurProxy->ShadowParameters.ShadowMap);
+
+		Fur->SetBuiltInShadow(false);
+		FlushRenderingCommands();
+		TestNull(TEXT("Proxy shadow map after turning the built-in shadow off"), FurProxy->ShadowParameters.ShadowMap);
+		TestNull(TEXT("Component shadow map after turning the built-in shadow off"), Fur->GetShadowParameters().ShadowMap);
+	}
+
+	GEngine->DestroyWorldContext(World);
+	World->DestroyWorld(false);
+	return true;
+}
+
+#endif
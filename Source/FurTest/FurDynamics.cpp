@@ -0,0 +1,332 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "FurDynamics.h"
+#include "FurSkeletalMeshComponent.h"
+#include "FurSkeletalMeshSceneProxy.h"
+#include "FurStats.h"
+#include "Engine/World.h"
+#include "Async/ParallelFor.h"
+#include "Math/VectorRegister.h"
+
+static TAutoConsoleVariable<int32> CVarFurDynamicsEnable(
+	TEXT("fur.Dynamics.Enable"),
+	1,
+	TEXT("Whether fur secondary motion is simulated. When off, the fur is rigid and its offsets are zero."),
+	ECVF_Scalability);
+
+static TAutoConsoleVariable<int32> CVarFurDynamicsPointsPerTask(
+	TEXT("fur.Dynamics.PointsPerTask"),
+	256,
+	TEXT("Guide points stepped per worker task. Fewer points than this in a world are stepped on the game thread."),
+	ECVF_Default);
+
+namespace
+{
+	/** Longest step the springs are integrated with; longer frames are split. */
+	const float MaxSubstepSeconds = 1.0f / 60.0f;
+	const int32 MaxSubsteps = 4;
+	/** A target moving further than this in one frame is a teleport: its points are reset rather than flung. */
+	const float TeleportDistance = 200.0f;
+
+	TMap<TWeakObjectPtr<UWorld>, TUniquePtr<FFurDynamicsSolver>> GSolvers;
+	FDelegateHandle GPostActorTickHandle;
+}
+
+void FFurDynamicsSolver::FPoints::SetNumZeroed(int32 Num)
+{
+	for (TArray<float>* Array : { &PositionX, &PositionY, &PositionZ, &VelocityX, &VelocityY, &VelocityZ,
+		&TargetX, &TargetY, &TargetZ, &AccelerationX, &AccelerationY, &AccelerationZ, &Stiffness, &Damping, &MaxDisplacement })
+	{
+		Array->Reset();
+		Array->AddZeroed(Num);
+	}
+}
+
+void FFurDynamicsSolver::FPoints::CopyPoint(const FPoints& From, int32 FromIndex, int32 ToIndex)
+{
+	PositionX[ToIndex] = From.PositionX[FromIndex];
+	PositionY[ToIndex] = From.PositionY[FromIndex];
+	PositionZ[ToIndex] = From.PositionZ[FromIndex];
+	VelocityX[ToIndex] = From.VelocityX[FromIndex];
+	VelocityY[ToIndex] = From.VelocityY[FromIndex];
+	VelocityZ[ToIndex] = From.VelocityZ[FromIndex];
+	TargetX[ToIndex] = From.TargetX[FromIndex];
+	TargetY[ToIndex] = From.TargetY[FromIndex];
+	TargetZ[ToIndex] = From.TargetZ[FromIndex];
+}
+
+FFurDynamicsSolver::FFurDynamicsSolver()
+	: NumPoints(0)
+	, bLayoutDirty(false)
+{
+}
+
+FFurDynamicsSolver* FFurDynamicsSolver::Find(UWorld* World)
+{
+	TUniquePtr<FFurDynamicsSolver>* Solver = GSolvers.Find(World);
+	return Solver ? Solver->Get() : nullptr;
+}
+
+void FFurDynamicsSolver::Register(UFurSkeletalMeshComponent* Component)
+{
+	check(IsInGameThread());
+	UWorld* World = Component->GetWorld();
+	if (World == nullptr)
+	{
+		return;
+	}
+
+	FFurDynamicsSolver* Solver = Find(World);
+	if (Solver == nullptr)
+	{
+		Solver = GSolvers.Add(World, TUniquePtr<FFurDynamicsSolver>(new FFurDynamicsSolver())).Get();
+		if (!GPostActorTickHandle.IsValid())
+		{
+			GPostActorTickHandle = FWorldDelegates::OnWorldPostActorTick.AddStatic(&FFurDynamicsSolver::OnWorldPostActorTick);
+		}
+	}
+
+	FEntry* Entry = Solver->Entries.FindByPredicate([Component](const FEntry& Other) { return Other.Component == Component; });
+	if (Entry == nullptr)
+	{
+		Entry = &Solver->Entries.AddDefaulted_GetRef();
+		Entry->Component = Component;
+		Entry->FirstPoint = INDEX_NONE;
+	}
+	Entry->BoneIndices.Reset();
+	for (const FName& BoneName : Component->FurDynamicsGuideBones)
+	{
+		if (Entry->BoneIndices.Num() < FFurDynamicsParameters::MaxGuides)
+		{
+			Entry->BoneIndices.Add(Component->GetPoseSource()->GetBoneIndex(BoneName));
+		}
+	}
+	if (Entry->BoneIndices.Num() == 0)
+	{
+		Entry->BoneIndices.Add(INDEX_NONE);
+	}
+	Entry->bReset = true;
+	Solver->bLayoutDirty = true;
+}
+
+void FFurDynamicsSolver::Unregister(UFurSkeletalMeshComponent* Component)
+{
+	check(IsInGameThread());
+	FFurDynamicsSolver* Solver = Find(Component->GetWorld());
+	if (Solver == nullptr)
+	{
+		return;
+	}
+	if (Solver->Entries.RemoveAll([Component](const FEntry& Entry) { return Entry.Component == Component; }) > 0)
+	{
+		Solver->bLayoutDirty = true;
+	}
+	if (Solver->Entries.Num() == 0)
+	{
+		GSolvers.Remove(Component->GetWorld());
+	}
+	if (GSolvers.Num() == 0 && GPostActorTickHandle.IsValid())
+	{
+		FWorldDelegates::OnWorldPostActorTick.Remove(GPostActorTickHandle);
+		GPostActorTickHandle.Reset();
+	}
+}
+
+void FFurDynamicsSolver::OnWorldPostActorTick(UWorld* World, ELevelTick TickType, float DeltaSeconds)
+{
+	if (FFurDynamicsSolver* Solver = Find(World))
+	{
+		Solver->Tick(World, DeltaSeconds);
+	}
+}
+
+void FFurDynamicsSolver::RebuildLayout()
+{
+	Entries.RemoveAll([](const FEntry& Entry) { return !Entry.Component.IsValid(); });
+
+	FPoints OldPoints = MoveTemp(Points);
+	NumPoints = 0;
+	for (const FEntry& Entry : Entries)
+	{
+		NumPoints += Entry.BoneIndices.Num();
+	}
+	Points.SetNumZeroed(Align(NumPoints, 4));
+
+	int32 NextPoint = 0;
+	for (FEntry& Entry : Entries)
+	{
+		if (Entry.FirstPoint != INDEX_NONE && !Entry.bReset)
+		{
+			for (int32 i = 0; i < Entry.BoneIndices.Num(); ++i)
+			{
+				Points.CopyPoint(OldPoints, Entry.FirstPoint + i, NextPoint + i);
+			}
+		}
+		else
+		{
+			Entry.bReset = true;
+		}
+		Entry.FirstPoint = NextPoint;
+		NextPoint += Entry.BoneIndices.Num();
+	}
+	bLayoutDirty = false;
+}
+
+void FFurDynamicsSolver::Tick(UWorld* World, float DeltaSeconds)
+{
+	FUR_SCOPE_TIMING(Dynamics);
+	SCOPE_CYCLE_COUNTER(STAT_FurDynamics);
+	CSV_SCOPED_TIMING_STAT(Fur, Dynamics);
+	if (Entries.RemoveAll([](const FEntry& Entry) { return !Entry.Component.IsValid(); }) > 0)
+	{
+		bLayoutDirty = true;
+	}
+	if (bLayoutDirty)
+	{
+		RebuildLayout();
+	}
+	const bool bEnabled = CVarFurDynamicsEnable.GetValueOnGameThread() != 0;
+	if (NumPoints == 0 || DeltaSeconds <= 0.0f)
+	{
+		return;
+	}
+
+	// Gather targets and per point settings.
+	const FVector Gravity(0.0f, 0.0f, World->GetGravityZ());
+	for (FEntry& Entry : Entries)
+	{
+		UFurSkeletalMeshComponent* Component = Entry.Component.Get();
+		const FTransform& ComponentTransform = Component->GetComponentTransform();
+		const TArray<FTransform>& ComponentSpaceTransforms = Component->GetPoseSource()->GetComponentSpaceTransforms();
+		const FVector Acceleration = Gravity * Component->FurGravityScale + Component->FurWind;
+
+		for (int32 i = 0; i < Entry.BoneIndices.Num(); ++i)
+		{
+			const int32 BoneIndex = Entry.BoneIndices[i];
+			const FVector Target = ComponentSpaceTransforms.IsValidIndex(BoneIndex)
+				? ComponentTransform.TransformPosition(ComponentSpaceTransforms[BoneIndex].GetLocation())
+				: ComponentTransform.GetLocation();
+
+			const int32 Point = Entry.FirstPoint + i;
+			const FVector PreviousTarget(Points.TargetX[Point], Points.TargetY[Point], Points.TargetZ[Point]);
+			if (Entry.bReset || !bEnabled || FVector::DistSquared(Target, PreviousTarget) > FMath::Square(TeleportDistance))
+			{
+				Points.PositionX[Point] = Target.X;
+				Points.PositionY[Point] = Target.Y;
+				Points.PositionZ[Point] = Target.Z;
+				Points.VelocityX[Point] = Points.VelocityY[Point] = Points.VelocityZ[Point] = 0.0f;
+			}
+			Points.TargetX[Point] = Target.X;
+			Points.TargetY[Point] = Target.Y;
+			Points.TargetZ[Point] = Target.Z;
+			Points.AccelerationX[Point] = Acceleration.X;
+			Points.AccelerationY[Point] = Acceleration.Y;
+			Points.AccelerationZ[Point] = Acceleration.Z;
+			Points.Stiffness[Point] = Component->FurStiffness;
+			Points.Damping[Point] = Component->FurDamping;
+			Points.MaxDisplacement[Point] = Component->FurMaxDisplacement;
+		}
+		Entry.bReset = false;
+	}
+
+	if (bEnabled)
+	{
+		const int32 NumSubsteps = FMath::Clamp(FMath::CeilToInt(DeltaSeconds / MaxSubstepSeconds), 1, MaxSubsteps);
+		const int32 NumPaddedPoints = Points.PositionX.Num();
+		const int32 PointsPerTask = Align(FMath::Max(CVarFurDynamicsPointsPerTask.GetValueOnGameThread(), 4), 4);
+		const int32 NumTasks = FMath::DivideAndRoundUp(NumPaddedPoints, PointsPerTask);
+		ParallelFor(NumTasks, [this, NumPaddedPoints, PointsPerTask, DeltaSeconds, NumSubsteps](int32 TaskIndex)
+		{
+			const int32 First = TaskIndex * PointsPerTask;
+			Step(First, FMath::Min(PointsPerTask, NumPaddedPoints - First), DeltaSeconds, NumSubsteps);
+		}, NumTasks == 1);
+	}
+
+	// Scatter the offsets and hand them to the proxies in one go.
+	TArray<TPair<FurSkeletalMeshSceneProxy*, FFurDynamicsParameters>> ProxyUpdates;
+	ProxyUpdates.Reserve(Entries.Num());
+	for (const FEntry& Entry : Entries)
+	{
+		UFurSkeletalMeshComponent* Component = Entry.Component.Get();
+		FFurDynamicsParameters& Parameters = Component->DynamicsParameters;
+		for (int32 i = 0; i < FFurDynamicsParameters::MaxGuides; ++i)
+		{
+			// Guides past the component's own count repeat its last one, so materials can always read all four.
+			const int32 Point = Entry.FirstPoint + FMath::Min(i, Entry.BoneIndices.Num() - 1);
+			Parameters.Displacement[i] = FLinearColor(
+				Points.PositionX[Point] - Points.TargetX[Point],
+				Points.PositionY[Point] - Points.TargetY[Point],
+				Points.PositionZ[Point] - Points.TargetZ[Point],
+				0.0f);
+		}
+		Parameters.bValid = true;
+
+		if (FurSkeletalMeshSceneProxy* FurProxy = static_cast<FurSkeletalMeshSceneProxy*>(Component->SceneProxy))
+		{
+			ProxyUpdates.Emplace(FurProxy, Parameters);
+		}
+	}
+
+	if (ProxyUpdates.Num() > 0)
+	{
+		ENQUEUE_RENDER_COMMAND(FurUpdateDynamicsParameters)(
+			[ProxyUpdates = MoveTemp(ProxyUpdates)](FRHICommandListImmediate& RHICmdList)
+			{
+				for (const TPair<FurSkeletalMeshSceneProxy*, FFurDynamicsParameters>& Update : ProxyUpdates)
+				{
+					Update.Key->SetDynamicsParameters_RenderThread(Update.Value);
+				}
+			});
+	}
+}
+
+void FFurDynamicsSolver::Step(int32 First, int32 Num, float DeltaSeconds, int32 NumSubsteps)
+{
+	const VectorRegister Dt = VectorSetFloat1(DeltaSeconds / NumSubsteps);
+	for (int32 i = First; i < First + Num; i += 4)
+	{
+		VectorRegister PositionX = VectorLoad(&Points.PositionX[i]);
+		VectorRegister PositionY = VectorLoad(&Points.PositionY[i]);
+		VectorRegister PositionZ = VectorLoad(&Points.PositionZ[i]);
+		VectorRegister VelocityX = VectorLoad(&Points.VelocityX[i]);
+		VectorRegister VelocityY = VectorLoad(&Points.VelocityY[i]);
+		VectorRegister VelocityZ = VectorLoad(&Points.VelocityZ[i]);
+		const VectorRegister TargetX = VectorLoad(&Points.TargetX[i]);
+		const VectorRegister TargetY = VectorLoad(&Points.TargetY[i]);
+		const VectorRegister TargetZ = VectorLoad(&Points.TargetZ[i]);
+		const VectorRegister AccelerationX = VectorLoad(&Points.AccelerationX[i]);
+		const VectorRegister AccelerationY = VectorLoad(&Points.AccelerationY[i]);
+		const VectorRegister AccelerationZ = VectorLoad(&Points.AccelerationZ[i]);
+		const VectorRegister NegStiffness = VectorNegate(VectorLoad(&Points.Stiffness[i]));
+		const VectorRegister NegDamping = VectorNegate(VectorLoad(&Points.Damping[i]));
+
+		// Semi-implicit Euler: a = -k (p - t) - c v + g, v += a dt, p += v dt.
+		for (int32 Substep = 0; Substep < NumSubsteps; ++Substep)
+		{
+			const VectorRegister AX = VectorMultiplyAdd(NegStiffness, VectorSubtract(PositionX, TargetX), VectorMultiplyAdd(NegDamping, VelocityX, AccelerationX));
+			const VectorRegister AY = VectorMultiplyAdd(NegStiffness, VectorSubtract(PositionY, TargetY), VectorMultiplyAdd(NegDamping, VelocityY, AccelerationY));
+			const VectorRegister AZ = VectorMultiplyAdd(NegStiffness, VectorSubtract(PositionZ, TargetZ), VectorMultiplyAdd(NegDamping, VelocityZ, AccelerationZ));
+			VelocityX = VectorMultiplyAdd(AX, Dt, VelocityX);
+			VelocityY = VectorMultiplyAdd(AY, Dt, VelocityY);
+			VelocityZ = VectorMultiplyAdd(AZ, Dt, VelocityZ);
+			PositionX = VectorMultiplyAdd(VelocityX, Dt, PositionX);
+			PositionY = VectorMultiplyAdd(VelocityY, Dt, PositionY);
+			PositionZ = VectorMultiplyAdd(VelocityZ, Dt, PositionZ);
+		}
+
+		// Keep the offset within MaxDisplacement: scale = min(1, max / |d|).
+		const VectorRegister DX = VectorSubtract(PositionX, TargetX);
+		const VectorRegister DY = VectorSubtract(PositionY, TargetY);
+		const VectorRegister DZ = VectorSubtract(PositionZ, TargetZ);
+		const VectorRegister LengthSquared = VectorMultiplyAdd(DX, DX, VectorMultiplyAdd(DY, DY, VectorMultiply(DZ, DZ)));
+		const VectorRegister SafeLengthSquared = VectorMax(LengthSquared, VectorSetFloat1(KINDA_SMALL_NUMBER));
+		const VectorRegister Scale = VectorMin(VectorOne(), VectorMultiply(VectorLoad(&Points.MaxDisplacement[i]), VectorReciprocalSqrt(SafeLengthSquared)));
+		VectorStore(VectorMultiplyAdd(DX, Scale, TargetX), &Points.PositionX[i]);
+		VectorStore(VectorMultiplyAdd(DY, Scale, TargetY), &Points.PositionY[i]);
+		VectorStore(VectorMultiplyAdd(DZ, Scale, TargetZ), &Points.PositionZ[i]);
+		VectorStore(VelocityX, &Points.VelocityX[i]);
+		VectorStore(VelocityY, &Points.VelocityY[i]);
+		VectorStore(VelocityZ, &Points.VelocityZ[i]);
+	}
+}
@@ -0,0 +1,65 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "FurShellMaterialRenderProxy.h"
+
+class UWorld;
+class UFurSkeletalMeshComponent;
+
+/**
+ * Damped springs that make the fur of every registered component in a world lag behind its guide points.
+ * Runs once per world tick after all actors ticked, for all components at once: guide point state is kept
+ * as structure of arrays and stepped four points at a time, in chunks spread over worker threads.
+ * The resulting offsets reach the shell materials through the scene proxies in one render command.
+ */
+class FURTEST_API FFurDynamicsSolver
+{
+public:
+	/** Adds a component with bFurDynamics set, resolving its guide bones. Its points start at rest. */
+	static void Register(UFurSkeletalMeshComponent* Component);
+	static void Unregister(UFurSkeletalMeshComponent* Component);
+
+private:
+	struct FEntry
+	{
+		TWeakObjectPtr<UFurSkeletalMeshComponent> Component;
+		/** Guide bone per point, INDEX_NONE for the component origin. */
+		TArray<int32, TInlineAllocator<FFurDynamicsParameters::MaxGuides>> BoneIndices;
+		/** First point in the arrays, INDEX_NONE until the layout places it. */
+		int32 FirstPoint;
+		/** Whether the points have to be put back on their targets before the next step. */
+		bool bReset;
+	};
+
+	/** Per point state, one float array per component so four points load into one vector register. */
+	struct FPoints
+	{
+		TArray<float> PositionX, PositionY, PositionZ;
+		TArray<float> VelocityX, VelocityY, VelocityZ;
+		TArray<float> TargetX, TargetY, TargetZ;
+		/** Gravity and wind. */
+		TArray<float> AccelerationX, AccelerationY, AccelerationZ;
+		TArray<float> Stiffness, Damping, MaxDisplacement;
+
+		void SetNumZeroed(int32 Num);
+		void CopyPoint(const FPoints& From, int32 FromIndex, int32 ToIndex);
+	};
+
+	TArray<FEntry> Entries;
+	FPoints Points;
+	/** Points in use; the arrays are padded to a multiple of four with inert points. */
+	int32 NumPoints;
+	bool bLayoutDirty;
+
+	FFurDynamicsSolver();
+
+	static FFurDynamicsSolver* Find(UWorld* World);
+	static void OnWorldPostActorTick(UWorld* World, ELevelTick TickType, float DeltaSeconds);
+
+	void RebuildLayout();
+	void Tick(UWorld* World, float DeltaSeconds);
+	/** Steps points [First, First + Num), Num a multiple of four. */
+	void Step(int32 First, int32 Num, float DeltaSeconds, int32 NumSubsteps);
+};
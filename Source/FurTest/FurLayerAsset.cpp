@@ -0,0 +1,157 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "FurLayerAsset.h"
+#include "Materials/MaterialInstanceDynamic.h"
+#include "UObject/Package.h"
+#include "Engine/Texture2D.h"
+#include "Engine/World.h"
+#if WITH_EDITOR
+#include "Misc/PackageName.h"
+#endif
+
+UFurLayerAsset::UFurLayerAsset()
+	: BaseMaterial(nullptr)
+	, ShellCount(15)
+	, DarkBase(0.0f)
+	, bGenerateTextures(false)
+	, StrandTexture(nullptr)
+	, DensityTexture(nullptr)
+	, SharedInstancedShellMaterial(nullptr)
+	, GeneratedStrandTexture(nullptr)
+	, GeneratedDensityTexture(nullptr)
+{
+}
+
+void UFurLayerAsset::ApplyParameters(UMaterialInstanceDynamic* Material, const FFurLayerParameters& Parameters) const
+{
+	for (const TPair<FName, float>& Param : Parameters.ScalarParameters)
+	{
+		Material->SetScalarParameterValue(Param.Key, Param.Value);
+	}
+	for (const TPair<FName, FLinearColor>& Param : Parameters.VectorParameters)
+	{
+		Material->SetVectorParameterValue(Param.Key, Param.Value);
+	}
+}
+
+void UFurLayerAsset::ApplyTextures(UMaterialInstanceDynamic* Material, int32 Layer)
+{
+	if (!bGenerateTextures)
+	{
+		return;
+	}
+	if ((StrandTexture == nullptr || DensityTexture == nullptr) && GeneratedStrandTexture == nullptr)
+	{
+		TSharedPtr<const FFurGeneratedTextures> Generated = FFurTextureGenerator::GetOrBuild(TextureSettings, ShellCount);
+		FFurTextureGenerator::CreateTransientTextures(*Generated, GeneratedStrandTexture, GeneratedDensityTexture);
+	}
+
+	Material->SetTextureParameterValue(FName("StrandTexture"), StrandTexture ? StrandTexture : GeneratedStrandTexture);
+	Material->SetTextureParameterValue(FName("DensityTexture"), DensityTexture ? DensityTexture : GeneratedDensityTexture);
+	if (Layer >= 0)
+	{
+		Material->SetScalarParameterValue(FName("AlphaThreshold"), FFurTextureGenerator::GetLayerAlphaThreshold(TextureSettings, Layer, ShellCount));
+	}
+	else
+	{
+		Material->SetScalarParameterValue(FName("RootAlphaThreshold"), TextureSettings.RootAlphaThreshold);
+		Material->SetScalarParameterValue(FName("TipAlphaThreshold"), TextureSettings.TipAlphaThreshold);
+	}
+}
+
+const TArray<UMaterialInstanceDynamic*>& UFurLayerAsset::GetShellMaterials()
+{
+	if (SharedShellMaterials.Num() == 0 && BaseMaterial != nullptr)
+	{
+		SharedShellMaterials.Reserve(ShellCount);
+		for (int i = 0; i < ShellCount; ++i)
+		{
+			UMaterialInstanceDynamic* tempMat = UMaterialInstanceDynamic::Create(BaseMaterial, this);
+			tempMat->SetScalarParameterValue(FName("Offset"), i);
+			tempMat->SetScalarParameterValue(FName("MaxLayer"), ShellCount);
+			tempMat->SetScalarParameterValue(FName("DarkBase"), DarkBase);
+			ApplyTextures(tempMat, i);
+			ApplyParameters(tempMat, SharedParameters);
+			if (LayerParameters.IsValidIndex(i))
+			{
+				ApplyParameters(tempMat, LayerParameters[i]);
+			}
+			SharedShellMaterials.Add(tempMat);
+		}
+	}
+	return SharedShellMaterials;
+}
+
+UMaterialInstanceDynamic* UFurLayerAsset::GetInstancedShellMaterial()
+{
+	if (SharedInstancedShellMaterial == nullptr && BaseMaterial != nullptr)
+	{
+		SharedInstancedShellMaterial = UMaterialInstanceDynamic::Create(BaseMaterial, this);
+		SharedInstancedShellMaterial->SetScalarParameterValue(FName("MaxLayer"), ShellCount);
+		SharedInstancedShellMaterial->SetScalarParameterValue(FName("DarkBase"), DarkBase);
+		ApplyTextures(SharedInstancedShellMaterial, -1);
+		ApplyParameters(SharedInstancedShellMaterial, SharedParameters);
+	}
+	return SharedInstancedShellMaterial;
+}
+
+void UFurLayerAsset::InvalidateShellMaterials()
+{
+	SharedShellMaterials.Reset();
+	SharedInstancedShellMaterial = nullptr;
+	GeneratedStrandTexture = nullptr;
+	GeneratedDensityTexture = nullptr;
+}
+
+UFurLayerAsset* UFurLayerAsset::FindOrCreateTransient(UWorld* World, UMaterialInterface* InBaseMaterial, int32 InShellCount, float InDarkBase)
+{
+	check(World);
+	static TArray<TWeakObjectPtr<UFurLayerAsset>> TransientAssets;
+
+	for (int32 i = TransientAssets.Num() - 1; i >= 0; --i)
+	{
+		UFurLayerAsset* Asset = TransientAssets[i].Get();
+		if (Asset == nullptr)
+		{
+			TransientAssets.RemoveAtSwap(i);
+		}
+		else if (Asset->GetOuter() == World && Asset->BaseMaterial == InBaseMaterial && Asset->ShellCount == InShellCount && Asset->DarkBase == InDarkBase)
+		{
+			return Asset;
+		}
+	}
+
+	// Outered to the world so the asset and its shell materials are collected with it, and never shared between
+	// the editor world and play in editor.
+	UFurLayerAsset* Asset = NewObject<UFurLayerAsset>(World, NAME_None, RF_Transient);
+	Asset->BaseMaterial = InBaseMaterial;
+	Asset->ShellCount = InShellCount;
+	Asset->DarkBase = InDarkBase;
+	TransientAssets.Add(Asset);
+	return Asset;
+}
+
+#if WITH_EDITOR
+void UFurLayerAsset::PostEditChangeProperty(FPropertyChangedEvent& PropertyChangedEvent)
+{
+	Super::PostEditChangeProperty(PropertyChangedEvent);
+	InvalidateShellMaterials();
+}
+
+void UFurLayerAsset::SaveGeneratedTextures()
+{
+	TSharedPtr<const FFurGeneratedTextures> Generated = FFurTextureGenerator::GetOrBuild(TextureSettings, ShellCount);
+	const FString PackagePath = FPackageName::GetLongPackagePath(GetOutermost()->GetName());
+	UTexture2D* SavedStrand = nullptr;
+	UTexture2D* SavedDensity = nullptr;
+	if (FFurTextureGenerator::SaveTextureAssets(*Generated, PackagePath, TEXT("T_") + GetName(), SavedStrand, SavedDensity))
+	{
+		Modify();
+		bGenerateTextures = true;
+		StrandTexture = SavedStrand;
+		DensityTexture = SavedDensity;
+		InvalidateShellMaterials();
+	}
+}
+#endif
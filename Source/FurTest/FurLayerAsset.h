@@ -0,0 +1,121 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Engine/DataAsset.h"
+#include "FurTextureGenerator.h"
+#include "FurLayerAsset.generated.h"
+
+class UMaterialInterface;
+class UMaterialInstanceDynamic;
+class UTexture2D;
+class UWorld;
+
+/** Material parameter overrides for one shell layer. */
+USTRUCT(BlueprintType)
+struct FFurLayerParameters
+{
+	GENERATED_BODY()
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Fur Layer")
+	TMap<FName, float> ScalarParameters;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Fur Layer")
+	TMap<FName, FLinearColor> VectorParameters;
+};
+
+/**
+ * Describes a fur shell stack: base material, shell count and per-layer parameters.
+ * The shell material instances are built once per asset and shared by every component using it.
+ */
+UCLASS(BlueprintType)
+class FURTEST_API UFurLayerAsset : public UDataAsset
+{
+	GENERATED_BODY()
+
+public:
+	UFurLayerAsset();
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Fur Layer")
+	UMaterialInterface* BaseMaterial;
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Fur Layer", meta = (ClampMin = "1", ClampMax = "64"))
+	int32 ShellCount;
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Fur Layer")
+	float DarkBase;
+
+	/** Set on every layer, before the per-layer overrides. */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Fur Layer")
+	FFurLayerParameters SharedParameters;
+
+	/** Per-layer overrides, indexed by layer. Missing entries only get the shared parameters. */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Fur Layer")
+	TArray<FFurLayerParameters> LayerParameters;
+
+	/**
+	 * Generate strand and density textures from TextureSettings for layers without saved ones. They are set on
+	 * every layer as StrandTexture and DensityTexture, with the layer's AlphaThreshold.
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Fur Texture")
+	bool bGenerateTextures;
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Fur Texture", meta = (EditCondition = "bGenerateTextures"))
+	FFurTextureSettings TextureSettings;
+
+	/** Saved strand texture; when set it is used instead of generating one. */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Fur Texture", meta = (EditCondition = "bGenerateTextures"))
+	UTexture2D* StrandTexture;
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Fur Texture", meta = (EditCondition = "bGenerateTextures"))
+	UTexture2D* DensityTexture;
+
+#if WITH_EDITOR
+	/** Generates the textures and saves them as assets next to this one, then uses them as StrandTexture and DensityTexture. */
+	UFUNCTION(CallInEditor, Category = "Fur Texture")
+	void SaveGeneratedTextures();
+#endif
+
+	/** One shell material per layer, created on first use and shared. */
+	UFUNCTION(BlueprintCallable, Category = "Fur Layer")
+	const TArray<UMaterialInstanceDynamic*>& GetShellMaterials();
+
+	/**
+	 * Single shell material for instanced shell rendering, created on first use and shared. Takes its layer from
+	 * Particle Relative Time and its alpha threshold from RootAlphaThreshold and TipAlphaThreshold.
+	 */
+	UFUNCTION(BlueprintCallable, Category = "Fur Layer")
+	UMaterialInstanceDynamic* GetInstancedShellMaterial();
+
+	/** Drops the shared shell materials so they are rebuilt from the current settings on next use. */
+	UFUNCTION(BlueprintCallable, Category = "Fur Layer")
+	void InvalidateShellMaterials();
+
+	/**
+	 * Transient asset for a plain base material, shared by everyone in World asking for the same settings.
+	 * Lets code that only has a base material still share its shells. The asset lives in World and goes with it.
+	 */
+	static UFurLayerAsset* FindOrCreateTransient(UWorld* World, UMaterialInterface* InBaseMaterial, int32 InShellCount, float InDarkBase);
+
+#if WITH_EDITOR
+	virtual void PostEditChangeProperty(struct FPropertyChangedEvent& PropertyChangedEvent) override;
+#endif
+
+private:
+	UPROPERTY(Transient)
+	TArray<UMaterialInstanceDynamic*> SharedShellMaterials;
+
+	UPROPERTY(Transient)
+	UMaterialInstanceDynamic* SharedInstancedShellMaterial;
+
+	UPROPERTY(Transient)
+	UTexture2D* GeneratedStrandTexture;
+
+	UPROPERTY(Transient)
+	UTexture2D* GeneratedDensityTexture;
+
+	void ApplyParameters(UMaterialInstanceDynamic* Material, const FFurLayerParameters& Parameters) const;
+	/** Sets the fur textures on a shell material, generating them first if needed. Layer is negative for the instanced material. */
+	void ApplyTextures(UMaterialInstanceDynamic* Material, int32 Layer);
+};
@@ -0,0 +1,248 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "FurMeshCache.h"
+#include "Engine/SkeletalMesh.h"
+#include "Rendering/SkeletalMeshRenderData.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogFurMeshCache, Log, All);
+
+namespace
+{
+	/** Per LOD results of one preprocess for one mesh. */
+	template<typename DataType>
+	struct TMeshCacheEntry
+	{
+		/** Render data the LODs were built from; a different pointer means the mesh was rebuilt. */
+		const FSkeletalMeshRenderData* RenderData = nullptr;
+		TArray<TSharedPtr<const DataType, ESPMode::ThreadSafe>> LODs;
+		/** LODs a build was tried for, so a failed build is not retried until the render data changes. */
+		TBitArray<> Attempted;
+		/** Set once a missing CPU copy was reported, so a mesh is reported once however often it is rebuilt. */
+		bool bReportedFailure = false;
+	};
+
+	/** Returns the cached result for a mesh LOD, building it on first use. */
+	template<typename DataType, typename BuildFunctionType>
+	TSharedPtr<const DataType, ESPMode::ThreadSafe> FindOrBuild(TMap<TWeakObjectPtr<USkeletalMesh>, TMeshCacheEntry<DataType>>& Cache,
+		USkeletalMesh* Mesh, int32 LODIndex, const TCHAR* What, BuildFunctionType Build)
+	{
+		check(IsInGameThread());
+		FSkeletalMeshRenderData* RenderData = Mesh ? Mesh->GetResourceForRendering() : nullptr;
+		if (RenderData == nullptr || !RenderData->LODRenderData.IsValidIndex(LODIndex))
+		{
+			return nullptr;
+		}
+
+		TMeshCacheEntry<DataType>* FoundEntry = Cache.Find(Mesh);
+		if (FoundEntry == nullptr)
+		{
+			// Drop the meshes that were garbage collected before adding one, so the cache only holds live meshes.
+			for (auto It = Cache.CreateIterator(); It; ++It)
+			{
+				if (!It.Key().IsValid())
+				{
+					It.RemoveCurrent();
+				}
+			}
+			FoundEntry = &Cache.Add(Mesh);
+		}
+		TMeshCacheEntry<DataType>& Entry = *FoundEntry;
+		if (Entry.RenderData != RenderData)
+		{
+			Entry.RenderData = RenderData;
+			Entry.LODs.Reset();
+			Entry.Attempted.Reset();
+		}
+		if (Entry.LODs.Num() <= LODIndex)
+		{
+			Entry.LODs.SetNum(RenderData->LODRenderData.Num());
+			Entry.Attempted.Init(false, RenderData->LODRenderData.Num());
+		}
+		if (!Entry.Attempted[LODIndex])
+		{
+			Entry.Attempted[LODIndex] = true;
+			Entry.LODs[LODIndex] = Build(*RenderData, LODIndex);
+			if (!Entry.LODs[LODIndex].IsValid() && !Entry.bReportedFailure)
+			{
+				Entry.bReportedFailure = true;
+				UE_LOG(LogFurMeshCache, Warning, TEXT("%s LOD %d has no CPU copy of its mesh data, %s needs Allow CPU Access on its LODs."),
+					*Mesh->GetName(), LODIndex, What);
+			}
+		}
+		return Entry.LODs[LODIndex];
+	}
+
+	TMap<TWeakObjectPtr<USkeletalMesh>, TMeshCacheEntry<FFurFinTopology>> GFinTopologyCache;
+	TMap<TWeakObjectPtr<USkeletalMesh>, TMeshCacheEntry<FFurSectionBounds>> GSectionBoundsCache;
+
+	template<bool bExtraBoneInfluences>
+	void AddSectionBoneBoxes(const FSkeletalMeshLODRenderData& LODData, const FSkelMeshRenderSection& Section, TArray<FFurSectionBounds::FBoneBox>& OutBoxes)
+	{
+		typedef TSkinWeightInfo<bExtraBoneInfluences> FWeightInfo;
+		const FPositionVertexBuffer& PositionBuffer = LODData.StaticVertexBuffers.PositionVertexBuffer;
+
+		// Indexed by the section's local bone index, compacted at the end.
+		TArray<FBox, TInlineAllocator<64>> Boxes;
+		Boxes.Init(FBox(ForceInit), Section.BoneMap.Num());
+		for (uint32 VertexIndex = Section.BaseVertexIndex; VertexIndex < Section.BaseVertexIndex + Section.NumVertices; ++VertexIndex)
+		{
+			const FWeightInfo* Weights = LODData.SkinWeightVertexBuffer.GetSkinWeightPtr<bExtraBoneInfluences>(VertexIndex);
+			const FVector Position = PositionBuffer.VertexPosition(VertexIndex);
+			for (int32 Influence = 0; Influence < FWeightInfo::NumInfluences; ++Influence)
+			{
+				if (Weights->InfluenceWeights[Influence] > 0 && Boxes.IsValidIndex(Weights->InfluenceBones[Influence]))
+				{
+					Boxes[Weights->InfluenceBones[Influence]] += Position;
+				}
+			}
+		}
+
+		for (int32 LocalBoneIndex = 0; LocalBoneIndex < Boxes.Num(); ++LocalBoneIndex)
+		{
+			if (Boxes[LocalBoneIndex].IsValid)
+			{
+				FFurSectionBounds::FBoneBox& BoneBox = OutBoxes.AddDefaulted_GetRef();
+				BoneBox.BoneIndex = Section.BoneMap[LocalBoneIndex];
+				BoneBox.Box = Boxes[LocalBoneIndex];
+			}
+		}
+	}
+}
+
+TSharedPtr<const FFurFinTopology, ESPMode::ThreadSafe> FFurMeshCache::GetFinTopology(USkeletalMesh* Mesh, int32 LODIndex)
+{
+	return FindOrBuild(GFinTopologyCache, Mesh, LODIndex, TEXT("drawing fur fins"), &FFurMeshCache::BuildFinTopology);
+}
+
+TSharedPtr<const FFurSectionBounds, ESPMode::ThreadSafe> FFurMeshCache::GetSectionBounds(USkeletalMesh* Mesh, int32 LODIndex)
+{
+	return FindOrBuild(GSectionBoundsCache, Mesh, LODIndex, TEXT("fur section culling"), &FFurMeshCache::BuildSectionBounds);
+}
+
+TSharedPtr<FFurFinTopology, ESPMode::ThreadSafe> FFurMeshCache::BuildFinTopology(const FSkeletalMeshRenderData& RenderData, int32 LODIndex)
+{
+	const FSkeletalMeshLODRenderData& LODData = RenderData.LODRenderData[LODIndex];
+	const FPositionVertexBuffer& PositionBuffer = LODData.StaticVertexBuffers.PositionVertexBuffer;
+	if (PositionBuffer.GetVertexData() == nullptr || LODData.MultiSizeIndexContainer.GetIndexBuffer() == nullptr)
+	{
+		return nullptr;
+	}
+
+	TArray<uint32> Indices;
+	LODData.MultiSizeIndexContainer.GetIndexBuffer(Indices);
+	if (Indices.Num() == 0)
+	{
+		return nullptr;
+	}
+
+	// Weld by position so the same corner split over several render vertices counts as one.
+	const int32 NumVertices = LODData.GetNumVertices();
+	TArray<int32> WeldedIndex;
+	WeldedIndex.SetNumUninitialized(NumVertices);
+	{
+		TMap<FVector, int32> FirstAtPosition;
+		FirstAtPosition.Reserve(NumVertices);
+		for (int32 VertexIndex = 0; VertexIndex < NumVertices; ++VertexIndex)
+		{
+			WeldedIndex[VertexIndex] = FirstAtPosition.FindOrAdd(PositionBuffer.VertexPosition(VertexIndex), VertexIndex);
+		}
+	}
+
+	TSharedPtr<FFurFinTopology, ESPMode::ThreadSafe> Topology = MakeShared<FFurFinTopology, ESPMode::ThreadSafe>();
+	Topology->Sections.SetNum(LODData.RenderSections.Num());
+
+	for (int32 SectionIndex = 0; SectionIndex < LODData.RenderSections.Num(); ++SectionIndex)
+	{
+		const FSkelMeshRenderSection& Section = LODData.RenderSections[SectionIndex];
+		FFurFinSection& FinSection = Topology->Sections[SectionIndex];
+
+		TMap<uint32, int32> LocalVertex;
+		auto GetLocalVertex = [&LocalVertex, &FinSection](uint32 VertexIndex)
+		{
+			if (const int32* Found = LocalVertex.Find(VertexIndex))
+			{
+				return *Found;
+			}
+			const int32 Local = FinSection.Vertices.Add(VertexIndex);
+			LocalVertex.Add(VertexIndex, Local);
+			return Local;
+		};
+
+		// Welded edge -> index into Edges, with OppositeB still unset until a second triangle shares it.
+		TMap<uint64, int32> EdgeLookup;
+		TArray<FFurFinSection::FEdge> OpenEdges;
+		for (uint32 Triangle = 0; Triangle < Section.NumTriangles; ++Triangle)
+		{
+			const uint32 First = Section.BaseIndex + Triangle * 3;
+			for (int32 Corner = 0; Corner < 3; ++Corner)
+			{
+				const uint32 A = Indices[First + Corner];
+				const uint32 B = Indices[First + (Corner + 1) % 3];
+				const uint32 C = Indices[First + (Corner + 2) % 3];
+				const uint32 WeldedA = WeldedIndex[A];
+				const uint32 WeldedB = WeldedIndex[B];
+				if (WeldedA == WeldedB)
+				{
+					continue;
+				}
+				const uint64 Key = WeldedA < WeldedB ? ((uint64)WeldedA << 32) | WeldedB : ((uint64)WeldedB << 32) | WeldedA;
+
+				if (int32* EdgeIndex = EdgeLookup.Find(Key))
+				{
+					FFurFinSection::FEdge& Edge = OpenEdges[*EdgeIndex];
+					// Edges shared by more than two triangles keep their first pair.
+					if (Edge.OppositeB == INDEX_NONE)
+					{
+						Edge.OppositeB = GetLocalVertex(C);
+					}
+				}
+				else
+				{
+					FFurFinSection::FEdge Edge;
+					Edge.V0 = GetLocalVertex(A);
+					Edge.V1 = GetLocalVertex(B);
+					Edge.OppositeA = GetLocalVertex(C);
+					Edge.OppositeB = INDEX_NONE;
+					EdgeLookup.Add(Key, OpenEdges.Add(Edge));
+				}
+			}
+		}
+
+		// Open edges have no silhouette test; only keep the ones between two triangles.
+		FinSection.Edges.Reserve(OpenEdges.Num());
+		for (const FFurFinSection::FEdge& Edge : OpenEdges)
+		{
+			if (Edge.OppositeB != INDEX_NONE)
+			{
+				FinSection.Edges.Add(Edge);
+			}
+		}
+	}
+	return Topology;
+}
+
+TSharedPtr<FFurSectionBounds, ESPMode::ThreadSafe> FFurMeshCache::BuildSectionBounds(const FSkeletalMeshRenderData& RenderData, int32 LODIndex)
+{
+	const FSkeletalMeshLODRenderData& LODData = RenderData.LODRenderData[LODIndex];
+	if (LODData.StaticVertexBuffers.PositionVertexBuffer.GetVertexData() == nullptr
+		|| LODData.SkinWeightVertexBuffer.GetNumVertices() != LODData.GetNumVertices())
+	{
+		return nullptr;
+	}
+
+	TSharedPtr<FFurSectionBounds, ESPMode::ThreadSafe> Bounds = MakeShared<FFurSectionBounds, ESPMode::ThreadSafe>();
+	Bounds->Sections.SetNum(LODData.RenderSections.Num());
+	for (int32 SectionIndex = 0; SectionIndex < LODData.RenderSections.Num(); ++SectionIndex)
+	{
+		if (LODData.SkinWeightVertexBuffer.HasExtraBoneInfluences())
+		{
+			AddSectionBoneBoxes<true>(LODData, LODData.RenderSections[SectionIndex], Bounds->Sections[SectionIndex]);
+		}
+		else
+		{
+			AddSectionBoneBoxes<false>(LODData, LODData.RenderSections[SectionIndex], Bounds->Sections[SectionIndex]);
+		}
+	}
+	return Bounds;
+}
@@ -0,0 +1,70 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+class USkeletalMesh;
+class FSkeletalMeshRenderData;
+
+/** Interior edges of one render section, with what is needed to skin them on the CPU. */
+struct FFurFinSection
+{
+	/** An edge shared by two triangles. Indices are into Vertices. */
+	struct FEdge
+	{
+		int32 V0;
+		int32 V1;
+		/** Third vertex of each adjacent triangle. */
+		int32 OppositeA;
+		int32 OppositeB;
+	};
+
+	/** Render vertex indices referenced by Edges. */
+	TArray<uint32> Vertices;
+	TArray<FEdge> Edges;
+};
+
+/** Edge adjacency of one skeletal mesh LOD, per render section. */
+struct FFurFinTopology
+{
+	TArray<FFurFinSection> Sections;
+};
+
+/** Reference pose bounds of each render section, split by the bones that move its vertices. */
+struct FFurSectionBounds
+{
+	struct FBoneBox
+	{
+		/** Skeleton bone index, into the reference to local matrices. */
+		int32 BoneIndex;
+		/** Reference pose box of the section vertices this bone influences. */
+		FBox Box;
+	};
+
+	/** Per render section; empty for sections without vertices. */
+	TArray<TArray<FBoneBox>> Sections;
+};
+
+/**
+ * CPU preprocesses of skeletal mesh render data shared by every fur component.
+ * Each is built once per mesh and LOD and rebuilt when the mesh's render data is replaced. Game thread only.
+ */
+struct FURTEST_API FFurMeshCache
+{
+	/**
+	 * Edge adjacency of a mesh LOD for fin rendering. Vertices split by UV or normal seams are welded by position,
+	 * so seams don't show up as open edges. Null if the LOD has no CPU copy of its indices and vertices.
+	 */
+	static TSharedPtr<const FFurFinTopology, ESPMode::ThreadSafe> GetFinTopology(USkeletalMesh* Mesh, int32 LODIndex);
+
+	/**
+	 * Per section, per bone reference pose boxes of a mesh LOD. Skinning each box with its bone bounds the section
+	 * in any pose. Null if the LOD has no CPU copy of its vertices and skin weights.
+	 */
+	static TSharedPtr<const FFurSectionBounds, ESPMode::ThreadSafe> GetSectionBounds(USkeletalMesh* Mesh, int32 LODIndex);
+
+private:
+	static TSharedPtr<FFurFinTopology, ESPMode::ThreadSafe> BuildFinTopology(const FSkeletalMeshRenderData& RenderData, int32 LODIndex);
+	static TSharedPtr<FFurSectionBounds, ESPMode::ThreadSafe> BuildSectionBounds(const FSkeletalMeshRenderData& RenderData, int32 LODIndex);
+};
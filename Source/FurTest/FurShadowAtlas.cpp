@@ -0,0 +1,470 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "FurShadowAtlas.h"
+#include "FurSkeletalMeshComponent.h"
+#include "FurStats.h"
+#include "Components/SceneCaptureComponent2D.h"
+#include "Engine/TextureRenderTarget2D.h"
+#include "Engine/World.h"
+
+static TAutoConsoleVariable<int32> CVarFurShadowAtlasSize(
+	TEXT("fur.ShadowAtlas.Size"),
+	2048,
+	TEXT("Width and height of the fur shadow atlas render target, shared by every fur component of a world that uses it."),
+	ECVF_Scalability);
+
+static TAutoConsoleVariable<int32> CVarFurShadowAtlasMaxTileSize(
+	TEXT("fur.ShadowAtlas.MaxTileSize"),
+	512,
+	TEXT("Tile size of a fur component filling the screen. Smaller on screen gets smaller power of two tiles."),
+	ECVF_Scalability);
+
+static TAutoConsoleVariable<int32> CVarFurShadowAtlasMinTileSize(
+	TEXT("fur.ShadowAtlas.MinTileSize"),
+	64,
+	TEXT("Smallest tile. Components that don't fit at this size when the atlas is full get no fur shadow."),
+	ECVF_Scalability);
+
+static TAutoConsoleVariable<float> CVarFurShadowAtlasResizeMargin(
+	TEXT("fur.ShadowAtlas.ResizeMargin"),
+	0.25f,
+	TEXT("Fraction of its screen size a fur component has to move past the next tile size before its tile is resized.\n")
+	TEXT("Keeps tiles from flipping between two sizes, and being recaptured, around a size boundary."),
+	ECVF_Scalability);
+
+namespace
+{
+	TMap<TWeakObjectPtr<UWorld>, TUniquePtr<FFurShadowAtlas>> GAtlases;
+	FDelegateHandle GPostActorTickHandle;
+
+	UTextureRenderTarget2D* CreateDepthTarget(UObject* Outer, int32 Size)
+	{
+		UTextureRenderTarget2D* Target = NewObject<UTextureRenderTarget2D>(Outer, NAME_None, RF_Transient);
+		Target->RenderTargetFormat = RTF_R32f;
+		Target->ClearColor = FLinearColor::Black;
+		Target->InitAutoFormat(Size, Size);
+		return Target;
+	}
+}
+
+FFurShadowAtlas* FFurShadowAtlas::Find(UWorld* World)
+{
+	TUniquePtr<FFurShadowAtlas>* Atlas = GAtlases.Find(World);
+	return Atlas ? Atlas->Get() : nullptr;
+}
+
+void FFurShadowAtlas::Register(UFurSkeletalMeshComponent* Component)
+{
+	check(IsInGameThread());
+	UWorld* World = Component->GetWorld();
+	if (World == nullptr)
+	{
+		return;
+	}
+
+	FFurShadowAtlas* Atlas = Find(World);
+	if (Atlas == nullptr)
+	{
+		Atlas = GAtlases.Add(World, MakeUnique<FFurShadowAtlas>()).Get();
+		if (!GPostActorTickHandle.IsValid())
+		{
+			GPostActorTickHandle = FWorldDelegates::OnWorldPostActorTick.AddStatic(&FFurShadowAtlas::OnWorldPostActorTick);
+		}
+	}
+
+	if (!Atlas->Entries.ContainsByPredicate([Component](const FEntry& Entry) { return Entry.Component == Component; }))
+	{
+		FEntry& Entry = Atlas->Entries.AddDefaulted_GetRef();
+		Entry.Component = Component;
+		Entry.TileOffset = FIntPoint::ZeroValue;
+		Entry.TileSize = 0;
+		Entry.PendingTileOffset = FIntPoint::ZeroValue;
+		Entry.PendingTileSize = 0;
+	}
+	Component->bInShadowAtlas = true;
+}
+
+void FFurShadowAtlas::Unregister(UFurSkeletalMeshComponent* Component)
+{
+	check(IsInGameThread());
+	Component->bInShadowAtlas = false;
+	FFurShadowAtlas* Atlas = Find(Component->GetWorld());
+	if (Atlas == nullptr)
+	{
+		return;
+	}
+	const int32 EntryIndex = Atlas->Entries.IndexOfByPredicate([Component](const FEntry& Entry) { return Entry.Component == Component; });
+	if (EntryIndex != INDEX_NONE)
+	{
+		Atlas->ReleaseTiles(Atlas->Entries[EntryIndex]);
+		Atlas->Entries.RemoveAtSwap(EntryIndex);
+	}
+	if (Atlas->Entries.Num() == 0)
+	{
+		GAtlases.Remove(Component->GetWorld());
+	}
+	if (GAtlases.Num() == 0 && GPostActorTickHandle.IsValid())
+	{
+		FWorldDelegates::OnWorldPostActorTick.Remove(GPostActorTickHandle);
+		GPostActorTickHandle.Reset();
+	}
+}
+
+void FFurShadowAtlas::OnWorldPostActorTick(UWorld* World, ELevelTick TickType, float DeltaSeconds)
+{
+	if (FFurShadowAtlas* Atlas = Find(World))
+	{
+		Atlas->Tick(World);
+	}
+}
+
+FFurShadowAtlas::~FFurShadowAtlas()
+{
+	Release();
+}
+
+void FFurShadowAtlas::AddReferencedObjects(FReferenceCollector& Collector)
+{
+	Collector.AddReferencedObject(AtlasTarget);
+	Collector.AddReferencedObject(Capture);
+	for (TPair<int32, UTextureRenderTarget2D*>& Scratch : ScratchTargets)
+	{
+		Collector.AddReferencedObject(Scratch.Value);
+	}
+}
+
+void FFurShadowAtlas::Release()
+{
+	if (Capture && Capture->IsRegistered())
+	{
+		Capture->DestroyComponent();
+	}
+	Capture = nullptr;
+	AtlasTarget = nullptr;
+	ScratchTargets.Reset();
+}
+
+void FFurShadowAtlas::ApplyTileToProjection(FLinearColor ProjCols[4], const FVector2D& TileOffset, float TileScale)
+{
+	// U = X/W * 0.5 + 0.5 and V = 0.5 - Y/W * 0.5. For U' = Offset.X + Scale * U and V' = Offset.Y + Scale * V:
+	// X' = Scale * X + (2 * Offset.X + Scale - 1) * W, Y' = Scale * Y - (2 * Offset.Y + Scale - 1) * W.
+	const FLinearColor W = ProjCols[3];
+	ProjCols[0] = ProjCols[0] * TileScale + W * (2.0f * TileOffset.X + TileScale - 1.0f);
+	ProjCols[1] = ProjCols[1] * TileScale - W * (2.0f * TileOffset.Y + TileScale - 1.0f);
+}
+
+UTextureRenderTarget2D* FFurShadowAtlas::GetScratchTarget(int32 Size)
+{
+	UTextureRenderTarget2D*& Scratch = ScratchTargets.FindOrAdd(Size);
+	if (Scratch == nullptr)
+	{
+		Scratch = CreateDepthTarget(GetTransientPackage(), Size);
+	}
+	return Scratch;
+}
+
+bool FFurShadowAtlas::AllocateTile(int32 Size, FIntPoint& OutOffset)
+{
+	for (int32 BlockSize = Size; BlockSize <= FreeTilesAtlasSize; BlockSize *= 2)
+	{
+		TArray<FIntPoint>* Free = FreeTiles.Find(BlockSize);
+		if (Free == nullptr || Free->Num() == 0)
+		{
+			continue;
+		}
+		const FIntPoint Offset = Free->Pop(false);
+		// Split the block down to the size asked for; the other three quarters of each split stay free.
+		while (BlockSize > Size)
+		{
+			BlockSize /= 2;
+			TArray<FIntPoint>& Quarters = FreeTiles.FindOrAdd(BlockSize);
+			Quarters.Add(Offset + FIntPoint(BlockSize, 0));
+			Quarters.Add(Offset + FIntPoint(0, BlockSize));
+			Quarters.Add(Offset + FIntPoint(BlockSize, BlockSize));
+		}
+		OutOffset = Offset;
+		return true;
+	}
+	return false;
+}
+
+void FFurShadowAtlas::FreeTile(FIntPoint Offset, int32 Size)
+{
+	// Merge with the other three quarters of the parent square while they are all free.
+	while (Size < FreeTilesAtlasSize)
+	{
+		TArray<FIntPoint>& Free = FreeTiles.FindOrAdd(Size);
+		const FIntPoint Parent(Offset.X & ~(Size * 2 - 1), Offset.Y & ~(Size * 2 - 1));
+		FIntPoint Siblings[3];
+		int32 NumSiblings = 0;
+		for (int32 Quarter = 0; Quarter < 4; ++Quarter)
+		{
+			const FIntPoint Sibling = Parent + FIntPoint((Quarter & 1) * Size, (Quarter >> 1) * Size);
+			if (Sibling != Offset)
+			{
+				Siblings[NumSiblings++] = Sibling;
+			}
+		}
+		if (!Free.Contains(Siblings[0]) || !Free.Contains(Siblings[1]) || !Free.Contains(Siblings[2]))
+		{
+			break;
+		}
+		for (const FIntPoint& Sibling : Siblings)
+		{
+			Free.RemoveSingleSwap(Sibling, false);
+		}
+		Offset = Parent;
+		Size *= 2;
+	}
+	FreeTiles.FindOrAdd(Size).Add(Offset);
+}
+
+void FFurShadowAtlas::ResetTiles(int32 AtlasSize)
+{
+	FreeTiles.Reset();
+	FreeTiles.Add(AtlasSize).Add(FIntPoint::ZeroValue);
+	FreeTilesAtlasSize = AtlasSize;
+}
+
+void FFurShadowAtlas::ReleaseTiles(FEntry& Entry)
+{
+	if (Entry.TileSize > 0)
+	{
+		FreeTile(Entry.TileOffset, Entry.TileSize);
+		Entry.TileSize = 0;
+	}
+	if (Entry.PendingTileSize > 0)
+	{
+		FreeTile(Entry.PendingTileOffset, Entry.PendingTileSize);
+		Entry.PendingTileSize = 0;
+	}
+}
+
+void FFurShadowAtlas::EvictEntry(FEntry& Entry)
+{
+	ReleaseTiles(Entry);
+	Entry.Component->bShadowCaptureDirty = true;
+	Entry.Component->SetShadowParameters(FFurShadowParameters());
+}
+
+void FFurShadowAtlas::AssignTiles()
+{
+	const int32 AtlasSize = FreeTilesAtlasSize;
+	const int32 MinTileSize = FMath::Clamp<int32>(FMath::RoundUpToPowerOfTwo(FMath::Max(CVarFurShadowAtlasMinTileSize.GetValueOnGameThread(), 1)), 1, AtlasSize);
+	const int32 MaxTileSize = FMath::Clamp<int32>(FMath::RoundUpToPowerOfTwo(FMath::Max(CVarFurShadowAtlasMaxTileSize.GetValueOnGameThread(), 1)), MinTileSize, AtlasSize);
+	const float ResizeMargin = FMath::Clamp(CVarFurShadowAtlasResizeMargin.GetValueOnGameThread(), 0.0f, 0.9f);
+
+	auto GetTileSize = [MinTileSize, MaxTileSize](const UFurSkeletalMeshComponent* Component, float ScreenSize)
+	{
+		// A screen size of 0.5 is about a full screen high.
+		int32 TileSize = FMath::RoundUpToPowerOfTwo(FMath::CeilToInt(ScreenSize * 2.0f * MaxTileSize));
+		const FFurSignificanceLevel* Level = Component->GetSignificanceLevel();
+		if (Level && Level->MaxShadowResolution > 0)
+		{
+			TileSize = FMath::Min(TileSize, 1 << FMath::FloorLog2(Level->MaxShadowResolution));
+		}
+		return FMath::Clamp<int32>(TileSize, MinTileSize, MaxTileSize);
+	};
+
+	// Components not rendered lately give their tiles back.
+	TArray<TPair<float, int32>> Order;
+	for (int32 Index = 0; Index < Entries.Num(); ++Index)
+	{
+		FEntry& Entry = Entries[Index];
+		const float ScreenSize = Entry.Component->GetFurScreenSize();
+		if (ScreenSize > 0.0f)
+		{
+			Order.Emplace(ScreenSize, Index);
+		}
+		else if (Entry.TileSize > 0 || Entry.PendingTileSize > 0)
+		{
+			EvictEntry(Entry);
+		}
+	}
+	Order.Sort([](const TPair<float, int32>& A, const TPair<float, int32>& B) { return A.Key > B.Key; });
+
+	for (int32 OrderIndex = 0; OrderIndex < Order.Num(); ++OrderIndex)
+	{
+		FEntry& Entry = Entries[Order[OrderIndex].Value];
+		const UFurSkeletalMeshComponent* Component = Entry.Component.Get();
+		const float ScreenSize = Order[OrderIndex].Key;
+		const int32 TileSize = GetTileSize(Component, ScreenSize);
+		const int32 CurrentSize = Entry.PendingTileSize > 0 ? Entry.PendingTileSize : Entry.TileSize;
+
+		if (CurrentSize > 0)
+		{
+			// Resize only once the screen size is the margin past the next size, and only if the new tile fits;
+			// the shadow stays in the current tile meanwhile.
+			const bool bGrow = GetTileSize(Component, ScreenSize * (1.0f - ResizeMargin)) > CurrentSize;
+			const bool bShrink = GetTileSize(Component, ScreenSize * (1.0f + ResizeMargin)) < CurrentSize;
+			FIntPoint Offset;
+			if ((bGrow || bShrink) && AllocateTile(TileSize, Offset))
+			{
+				if (Entry.PendingTileSize > 0)
+				{
+					FreeTile(Entry.PendingTileOffset, Entry.PendingTileSize);
+				}
+				Entry.PendingTileOffset = Offset;
+				Entry.PendingTileSize = TileSize;
+				Entry.Component->bShadowCaptureDirty = true;
+			}
+			continue;
+		}
+
+		// Take the largest tile that fits. If none does, take the tiles of the least significant components.
+		for (;;)
+		{
+			FIntPoint Offset;
+			int32 Size = TileSize;
+			while (Size >= MinTileSize && !AllocateTile(Size, Offset))
+			{
+				Size /= 2;
+			}
+			if (Size >= MinTileSize)
+			{
+				Entry.PendingTileOffset = Offset;
+				Entry.PendingTileSize = Size;
+				Entry.Component->bShadowCaptureDirty = true;
+				break;
+			}
+
+			int32 Victim = Order.Num() - 1;
+			while (Victim > OrderIndex && Entries[Order[Victim].Value].TileSize == 0 && Entries[Order[Victim].Value].PendingTileSize == 0)
+			{
+				--Victim;
+			}
+			if (Victim == OrderIndex)
+			{
+				break;
+			}
+			EvictEntry(Entries[Order[Victim].Value]);
+		}
+	}
+}
+
+void FFurShadowAtlas::CaptureTile(UWorld* World, const FEntry& Entry, const FTransform& CasterTransform, float OrthoWidth)
+{
+	if (Capture == nullptr)
+	{
+		Capture = NewObject<USceneCaptureComponent2D>(World, NAME_None, RF_Transient);
+		UFurSkeletalMeshComponent::ConfigureShadowDepthCapture(Capture);
+		Capture->RegisterComponentWithWorld(World);
+	}
+
+	UTextureRenderTarget2D* Scratch = GetScratchTarget(Entry.TileSize);
+	Capture->ShowOnlyComponents.Reset();
+	Capture->ShowOnlyComponent(Entry.Component.Get());
+	Capture->TextureTarget = Scratch;
+	Capture->OrthoWidth = OrthoWidth;
+	Capture->SetWorldTransform(CasterTransform);
+	Capture->CaptureScene();
+	FUR_COUNTER_ADD(ShadowCaptures, 1);
+
+	// Render commands run in order, so the copy sees the capture that was just queued.
+	FTextureRenderTargetResource* Source = Scratch->GameThread_GetRenderTargetResource();
+	FTextureRenderTargetResource* Dest = AtlasTarget->GameThread_GetRenderTargetResource();
+	const FIntPoint Offset = Entry.TileOffset;
+	const int32 Size = Entry.TileSize;
+	ENQUEUE_RENDER_COMMAND(FurCopyShadowTile)(
+		[Source, Dest, Offset, Size](FRHICommandListImmediate& RHICmdList)
+		{
+			FResolveParams ResolveParams;
+			ResolveParams.Rect = FResolveRect(0, 0, Size, Size);
+			ResolveParams.DestRect = FResolveRect(Offset.X, Offset.Y, Offset.X + Size, Offset.Y + Size);
+			RHICmdList.CopyToResolveTarget(Source->GetRenderTargetTexture(), Dest->TextureRHI, ResolveParams);
+		});
+}
+
+void FFurShadowAtlas::Tick(UWorld* World)
+{
+	for (int32 Index = Entries.Num() - 1; Index >= 0; --Index)
+	{
+		if (!Entries[Index].Component.IsValid())
+		{
+			ReleaseTiles(Entries[Index]);
+			Entries.RemoveAtSwap(Index);
+		}
+	}
+
+	const int32 AtlasSize = FMath::Clamp<int32>(FMath::RoundUpToPowerOfTwo(FMath::Max(CVarFurShadowAtlasSize.GetValueOnGameThread(), 64)), 64, 8192);
+	if (AtlasTarget == nullptr || AtlasTarget->SizeX != AtlasSize)
+	{
+		if (AtlasTarget == nullptr)
+		{
+			AtlasTarget = CreateDepthTarget(GetTransientPackage(), AtlasSize);
+		}
+		else
+		{
+			AtlasTarget->ResizeTarget(AtlasSize, AtlasSize);
+		}
+	}
+	if (FreeTilesAtlasSize != AtlasSize)
+	{
+		// A new atlas holds none of the old tiles.
+		ResetTiles(AtlasSize);
+		for (FEntry& Entry : Entries)
+		{
+			Entry.TileSize = 0;
+			Entry.PendingTileSize = 0;
+			Entry.Component->bShadowCaptureDirty = true;
+			Entry.Component->SetShadowParameters(FFurShadowParameters());
+		}
+	}
+
+	AssignTiles();
+
+	const float CurrentTime = World->GetTimeSeconds();
+	for (FEntry& Entry : Entries)
+	{
+		UFurSkeletalMeshComponent* Component = Entry.Component.Get();
+		if (Entry.TileSize == 0 && Entry.PendingTileSize == 0)
+		{
+			continue;
+		}
+
+		FTransform CasterTransform;
+		float OrthoWidth;
+		Component->GetBuiltInShadowPlacement(CasterTransform, OrthoWidth);
+		if (!Component->bShadowCaptureDirty && !Component->HasShadowInputChanged(CasterTransform))
+		{
+			continue;
+		}
+		// A new tile has no shadow yet, so only the frame budget holds it back. A resized one still has the old shadow.
+		const bool bHasShadow = Component->GetShadowParameters().bValid;
+		Component->bShadowCaptureDirty = true;
+		const float ShadowUpdateRate = Component->GetShadowUpdateRate();
+		if (bHasShadow && ShadowUpdateRate > 0.0f && CurrentTime - Component->LastShadowCaptureTime < 1.0f / ShadowUpdateRate)
+		{
+			continue;
+		}
+		if (!UFurSkeletalMeshComponent::AcquireShadowCaptureBudget(World))
+		{
+			continue;
+		}
+
+		if (Entry.PendingTileSize > 0)
+		{
+			// The old tile is free from the next assignment on; by then the parameters below point at the new one.
+			if (Entry.TileSize > 0)
+			{
+				FreeTile(Entry.TileOffset, Entry.TileSize);
+			}
+			Entry.TileOffset = Entry.PendingTileOffset;
+			Entry.TileSize = Entry.PendingTileSize;
+			Entry.PendingTileSize = 0;
+		}
+		CaptureTile(World, Entry, CasterTransform, OrthoWidth);
+		Component->RecordShadowCapture(CasterTransform, CurrentTime);
+
+		FFurShadowParameters Parameters;
+		UFurSkeletalMeshComponent::ComputeShadowProjection(CasterTransform, FIntPoint(Entry.TileSize, Entry.TileSize),
+			ECameraProjectionMode::Orthographic, 90.0f, OrthoWidth, Parameters.ProjCol);
+		ApplyTileToProjection(Parameters.ProjCol, FVector2D(Entry.TileOffset) / AtlasSize, (float)Entry.TileSize / AtlasSize);
+		Parameters.SourcePos = FLinearColor(CasterTransform.GetLocation());
+		Parameters.SourceDir = FLinearColor(CasterTransform.GetRotation().GetForwardVector());
+		Parameters.ShadowMap = AtlasTarget;
+		Parameters.bValid = true;
+		Component->SetShadowParameters(Parameters);
+	}
+}
@@ -0,0 +1,80 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "UObject/GCObject.h"
+
+class UWorld;
+class UFurSkeletalMeshComponent;
+class USceneCaptureComponent2D;
+class UTextureRenderTarget2D;
+
+/**
+ * Fur shadow maps of every component of a world that uses the shadow atlas, packed into one render target.
+ * Recently rendered components get a power of two tile sized by their screen size, which they keep until their
+ * screen size moves past the next size by a margin. A resized tile keeps the old shadow until the new one is captured.
+ * Every dirty component still takes a depth capture of its own, made by one capture component reused for all of them
+ * into a scratch target of the tile size and copied into the tile. The atlas saves render targets, not scene renders.
+ * The tile's scale and bias are folded into the component's shadow projection, so shell materials are unchanged.
+ * See fur.ShadowAtlas.* for the settings.
+ */
+class FURTEST_API FFurShadowAtlas : public FGCObject
+{
+public:
+	static void Register(UFurSkeletalMeshComponent* Component);
+	static void Unregister(UFurSkeletalMeshComponent* Component);
+
+	/**
+	 * Remaps a projection onto one tile of an atlas. TileOffset and TileScale are in atlas UV: the tile covers
+	 * [TileOffset, TileOffset + TileScale]. Shadow UV is clip X/W and Y/W mapped to [0, 1] with V pointing down.
+	 */
+	static void ApplyTileToProjection(FLinearColor ProjCols[4], const FVector2D& TileOffset, float TileScale);
+
+	virtual ~FFurShadowAtlas();
+	virtual void AddReferencedObjects(FReferenceCollector& Collector) override;
+	virtual FString GetReferencerName() const override { return TEXT("FFurShadowAtlas"); }
+
+private:
+	struct FEntry
+	{
+		TWeakObjectPtr<UFurSkeletalMeshComponent> Component;
+		/** Tile holding the component's shadow, in texels, and its size; 0 for no tile. */
+		FIntPoint TileOffset;
+		int32 TileSize;
+		/** New tile the next capture goes to, 0 for none. Until then the shadow is still read from the old tile. */
+		FIntPoint PendingTileOffset;
+		int32 PendingTileSize;
+	};
+
+	TArray<FEntry> Entries;
+	/** Free squares of the atlas by size. Tiles are split off and merged back as a quadtree, so they never overlap. */
+	TMap<int32, TArray<FIntPoint>> FreeTiles;
+	int32 FreeTilesAtlasSize = 0;
+	UTextureRenderTarget2D* AtlasTarget = nullptr;
+	USceneCaptureComponent2D* Capture = nullptr;
+	/** Capture targets by tile size. */
+	TMap<int32, UTextureRenderTarget2D*> ScratchTargets;
+
+	static FFurShadowAtlas* Find(UWorld* World);
+	static void OnWorldPostActorTick(UWorld* World, ELevelTick TickType, float DeltaSeconds);
+
+	void Tick(UWorld* World);
+	/**
+	 * Gives tiles to the components that need one, most significant first, taking them from the least significant
+	 * ones when the atlas is full, and resizes tiles whose screen size moved past the margin. Frees unused tiles.
+	 */
+	void AssignTiles();
+	bool AllocateTile(int32 Size, FIntPoint& OutOffset);
+	void FreeTile(FIntPoint Offset, int32 Size);
+	/** Frees every tile of an atlas of the given size. */
+	void ResetTiles(int32 AtlasSize);
+	/** Frees the entry's tiles. */
+	void ReleaseTiles(FEntry& Entry);
+	/** Frees the entry's tiles and drops its shadow, whose texels go to others. */
+	void EvictEntry(FEntry& Entry);
+	/** Renders a component's shadow into its tile. */
+	void CaptureTile(UWorld* World, const FEntry& Entry, const FTransform& CasterTransform, float OrthoWidth);
+	UTextureRenderTarget2D* GetScratchTarget(int32 Size);
+	void Release();
+};
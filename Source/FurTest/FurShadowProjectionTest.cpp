@@ -0,0 +1,78 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "FurSkeletalMeshComponent.h"
+#include "FurShadowAtlas.h"
+#include "Misc/AutomationTest.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FFurShadowProjectionTest, "FurTest.Shadow.Projection", EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::ProductFilter)
+
+bool FFurShadowProjectionTest::RunTest(const FString& Parameters)
+{
+	struct FCase
+	{
+		const TCHAR* Name;
+		ECameraProjectionMode::Type ProjectionType;
+		FIntPoint Size;
+		float FOVAngle;
+		float OrthoWidth;
+		/** Point in caster space: X forward, Y right, Z up. */
+		FVector CasterSpacePoint;
+		/** Expected clip X/W and Y/W. */
+		FVector2D ExpectedClip;
+	};
+
+	// Orthographic: clip = (right, up) / half extent. Perspective: clip = (right, up) / (forward * tan(FOV / 2)).
+	// A non-square target scales Y by width / height.
+	const FCase Cases[] =
+	{
+		{ TEXT("Ortho centre"), ECameraProjectionMode::Orthographic, FIntPoint(512, 512), 90.0f, 400.0f, FVector(300.0f, 0.0f, 0.0f), FVector2D(0.0f, 0.0f) },
+		{ TEXT("Ortho right"), ECameraProjectionMode::Orthographic, FIntPoint(512, 512), 90.0f, 400.0f, FVector(300.0f, 100.0f, 0.0f), FVector2D(0.5f, 0.0f) },
+		{ TEXT("Ortho up"), ECameraProjectionMode::Orthographic, FIntPoint(512, 512), 90.0f, 400.0f, FVector(50.0f, 0.0f, -200.0f), FVector2D(0.0f, -1.0f) },
+		{ TEXT("Ortho wide target"), ECameraProjectionMode::Orthographic, FIntPoint(1024, 512), 90.0f, 400.0f, FVector(300.0f, 0.0f, 50.0f), FVector2D(0.0f, 0.5f) },
+		{ TEXT("Perspective centre"), ECameraProjectionMode::Perspective, FIntPoint(512, 512), 90.0f, 0.0f, FVector(500.0f, 0.0f, 0.0f), FVector2D(0.0f, 0.0f) },
+		{ TEXT("Perspective edge"), ECameraProjectionMode::Perspective, FIntPoint(512, 512), 90.0f, 0.0f, FVector(500.0f, 500.0f, -250.0f), FVector2D(1.0f, -0.5f) },
+		{ TEXT("Perspective 60 degrees"), ECameraProjectionMode::Perspective, FIntPoint(512, 512), 60.0f, 0.0f, FVector(300.0f, 150.0f * FMath::Tan(FMath::DegreesToRadians(30.0f)), 0.0f), FVector2D(0.5f, 0.0f) },
+	};
+
+	// Any caster transform must give the same result for points expressed in its own space.
+	const FTransform CasterTransforms[] =
+	{
+		FTransform::Identity,
+		FTransform(FRotator(-60.0f, 30.0f, 0.0f), FVector(120.0f, -40.0f, 300.0f)),
+	};
+
+	for (const FTransform& CasterTransform : CasterTransforms)
+	{
+		for (const FCase& Case : Cases)
+		{
+			FLinearColor Cols[4];
+			UFurSkeletalMeshComponent::ComputeShadowProjection(CasterTransform, Case.Size, Case.ProjectionType, Case.FOVAngle, Case.OrthoWidth, Cols);
+
+			const FVector WorldPoint = CasterTransform.TransformPosition(Case.CasterSpacePoint);
+			const FVector4 Point(WorldPoint, 1.0f);
+			auto Dot = [&Point](const FLinearColor& Col) { return Point.X * Col.R + Point.Y * Col.G + Point.Z * Col.B + Point.W * Col.A; };
+			const float W = Dot(Cols[3]);
+			const FVector2D Clip(Dot(Cols[0]) / W, Dot(Cols[1]) / W);
+			TestTrue(FString::Printf(TEXT("'%s' (caster %s): clip %s, expected %s"),
+				Case.Name, *CasterTransform.ToHumanReadableString(), *Clip.ToString(), *Case.ExpectedClip.ToString()),
+				Clip.Equals(Case.ExpectedClip, 1.e-3f));
+
+			// The same point through an atlas tile lands at the tile's offset plus its scale times the full map UV.
+			const FVector2D TileOffset(0.25f, 0.5f);
+			const float TileScale = 0.25f;
+			FFurShadowAtlas::ApplyTileToProjection(Cols, TileOffset, TileScale);
+			const float TileW = Dot(Cols[3]);
+			const FVector2D TileUV(Dot(Cols[0]) / TileW * 0.5f + 0.5f, 0.5f - Dot(Cols[1]) / TileW * 0.5f);
+			const FVector2D ExpectedUV = TileOffset + FVector2D(Case.ExpectedClip.X * 0.5f + 0.5f, 0.5f - Case.ExpectedClip.Y * 0.5f) * TileScale;
+			TestTrue(FString::Printf(TEXT("Atlas tile '%s' (caster %s): uv %s, expected %s"),
+				Case.Name, *CasterTransform.ToHumanReadableString(), *TileUV.ToString(), *ExpectedUV.ToString()),
+				TileUV.Equals(ExpectedUV, 1.e-3f));
+		}
+	}
+	return true;
+}
+
+#endif
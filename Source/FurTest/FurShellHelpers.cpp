@@ -0,0 +1,51 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "FurShellHelpers.h"
+#include "FurSkeletalMeshComponent.h"
+#include "MaterialShared.h"
+
+void FFurShellHelpers::GetSectionShellLimits(int32 LODIndex, const TArray<FName>& SectionSlotNames, bool bFurOnUnlistedSections,
+	const TArray<FFurMaterialSlotSettings>& FurMaterialSlots, const TArray<FFurSectionSettings>& FurSections, TArray<int32>& OutShellLimits)
+{
+	OutShellLimits.Reset(SectionSlotNames.Num());
+	for (int32 SectionIndex = 0; SectionIndex < SectionSlotNames.Num(); ++SectionIndex)
+	{
+		int32 Limit = bFurOnUnlistedSections ? -1 : 0;
+
+		const FName SlotName = SectionSlotNames[SectionIndex];
+		if (SlotName != NAME_None)
+		{
+			for (const FFurMaterialSlotSettings& Slot : FurMaterialSlots)
+			{
+				if (Slot.MaterialSlotName == SlotName)
+				{
+					Limit = Slot.bHasFur ? Slot.ShellCount : 0;
+				}
+			}
+		}
+
+		for (const FFurSectionSettings& Section : FurSections)
+		{
+			if (Section.SectionIndex == SectionIndex && (Section.LODIndex < 0 || Section.LODIndex == LODIndex))
+			{
+				Limit = Section.bHasFur ? Section.ShellCount : 0;
+			}
+		}
+
+		OutShellLimits.Add(Limit < 0 ? -1 : Limit);
+	}
+}
+
+FMaterialRelevance FFurShellHelpers::GetMaterialRelevance(const TArray<UMaterialInterface*>& Materials, ERHIFeatureLevel::Type FeatureLevel)
+{
+	FMaterialRelevance Relevance;
+	for (UMaterialInterface* Material : Materials)
+	{
+		if (Material)
+		{
+			Relevance |= Material->GetRelevance_Concurrent(FeatureLevel);
+		}
+	}
+	return Relevance;
+}
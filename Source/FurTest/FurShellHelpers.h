@@ -0,0 +1,31 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "RHIDefinitions.h"
+
+class UMaterialInterface;
+struct FMaterialRelevance;
+struct FFurMaterialSlotSettings;
+struct FFurSectionSettings;
+
+/** Shell selection and section settings shared by the skeletal and static mesh fur components and their proxies. */
+struct FURTEST_API FFurShellHelpers
+{
+	/** Index of the Index-th shell when only Count of Total shells are drawn, spread so the full fur length is kept. */
+	static FORCEINLINE int32 GetLODShellIndex(int32 Index, int32 Count, int32 Total)
+	{
+		return Count > 1 ? (Index * (Total - 1)) / (Count - 1) : 0;
+	}
+
+	/**
+	 * Resolves the section settings for one LOD from the material slot name of each section, NAME_None if it has none:
+	 * 0 = no fur, negative = all shells, otherwise the shell limit. Section settings take precedence over slot settings.
+	 */
+	static void GetSectionShellLimits(int32 LODIndex, const TArray<FName>& SectionSlotNames, bool bFurOnUnlistedSections,
+		const TArray<FFurMaterialSlotSettings>& FurMaterialSlots, const TArray<FFurSectionSettings>& FurSections, TArray<int32>& OutShellLimits);
+
+	/** Relevance of the non-null materials, merged, for the given feature level. */
+	static FMaterialRelevance GetMaterialRelevance(const TArray<UMaterialInterface*>& Materials, ERHIFeatureLevel::Type FeatureLevel);
+};
@@ -0,0 +1,70 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "FurShellMaterialRenderProxy.h"
+
+static const FName NAME_ProjCol0("ProjCol0");
+static const FName NAME_ProjCol1("ProjCol1");
+static const FName NAME_ProjCol2("ProjCol2");
+static const FName NAME_ProjCol3("ProjCol3");
+static const FName NAME_SourcePos("SourcePos");
+static const FName NAME_SourceDir("SourceDir");
+static const FName NAME_DirectShadowMap("DirectShadowMap");
+static const FName NAME_FurDisplacement[FFurDynamicsParameters::MaxGuides] =
+{
+	FName("FurDisplacement0"),
+	FName("FurDisplacement1"),
+	FName("FurDisplacement2"),
+	FName("FurDisplacement3"),
+};
+
+const FMaterial& FFurShellMaterialRenderProxy::GetMaterialWithFallback(ERHIFeatureLevel::Type InFeatureLevel, const FMaterialRenderProxy*& OutFallbackMaterialRenderProxy) const
+{
+	return Parent->GetMaterialWithFallback(InFeatureLevel, OutFallbackMaterialRenderProxy);
+}
+
+UMaterialInterface* FFurShellMaterialRenderProxy::GetMaterialInterface() const
+{
+	return Parent->GetMaterialInterface();
+}
+
+bool FFurShellMaterialRenderProxy::GetVectorValue(const FMaterialParameterInfo& ParameterInfo, FLinearColor* OutValue, const FMaterialRenderContext& Context) const
+{
+	if (ShadowParameters.bValid)
+	{
+		const FName& Name = ParameterInfo.Name;
+		if (Name == NAME_ProjCol0) { *OutValue = ShadowParameters.ProjCol[0]; return true; }
+		if (Name == NAME_ProjCol1) { *OutValue = ShadowParameters.ProjCol[1]; return true; }
+		if (Name == NAME_ProjCol2) { *OutValue = ShadowParameters.ProjCol[2]; return true; }
+		if (Name == NAME_ProjCol3) { *OutValue = ShadowParameters.ProjCol[3]; return true; }
+		if (Name == NAME_SourcePos) { *OutValue = ShadowParameters.SourcePos; return true; }
+		if (Name == NAME_SourceDir) { *OutValue = ShadowParameters.SourceDir; return true; }
+	}
+	if (DynamicsParameters.bValid)
+	{
+		for (int32 i = 0; i < FFurDynamicsParameters::MaxGuides; ++i)
+		{
+			if (ParameterInfo.Name == NAME_FurDisplacement[i])
+			{
+				*OutValue = DynamicsParameters.Displacement[i];
+				return true;
+			}
+		}
+	}
+	return Parent->GetVectorValue(ParameterInfo, OutValue, Context);
+}
+
+bool FFurShellMaterialRenderProxy::GetScalarValue(const FMaterialParameterInfo& ParameterInfo, float* OutValue, const FMaterialRenderContext& Context) const
+{
+	return Parent->GetScalarValue(ParameterInfo, OutValue, Context);
+}
+
+bool FFurShellMaterialRenderProxy::GetTextureValue(const FMaterialParameterInfo& ParameterInfo, const UTexture** OutValue, const FMaterialRenderContext& Context) const
+{
+	if (ShadowParameters.bValid && ShadowParameters.ShadowMap && ParameterInfo.Name == NAME_DirectShadowMap)
+	{
+		*OutValue = ShadowParameters.ShadowMap;
+		return true;
+	}
+	return Parent->GetTextureValue(ParameterInfo, OutValue, Context);
+}
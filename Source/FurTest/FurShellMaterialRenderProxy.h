@@ -0,0 +1,78 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "MaterialShared.h"
+
+class UTexture;
+
+/**
+ * Shadow lookup values shared by every shell material of one fur component.
+ * Computed once per frame on the game thread and handed to the scene proxy.
+ */
+struct FFurShadowParameters
+{
+	FLinearColor ProjCol[4];
+	FLinearColor SourcePos;
+	FLinearColor SourceDir;
+	const UTexture* ShadowMap;
+	bool bValid;
+
+	FFurShadowParameters()
+		: SourcePos(ForceInitToZero)
+		, SourceDir(ForceInitToZero)
+		, ShadowMap(nullptr)
+		, bValid(false)
+	{
+		for (int32 i = 0; i < 4; ++i)
+		{
+			ProjCol[i] = FLinearColor(ForceInitToZero);
+		}
+	}
+};
+
+/** Fur secondary motion of one fur component: world space offset of each guide point from where the skin puts it. */
+struct FFurDynamicsParameters
+{
+	static const int32 MaxGuides = 4;
+
+	FLinearColor Displacement[MaxGuides];
+	bool bValid;
+
+	FFurDynamicsParameters()
+		: bValid(false)
+	{
+		for (int32 i = 0; i < MaxGuides; ++i)
+		{
+			Displacement[i] = FLinearColor(ForceInitToZero);
+		}
+	}
+};
+
+/**
+ * Wraps a shell material and answers the shadow parameters (ProjCol0..3, SourcePos, SourceDir, DirectShadowMap)
+ * and the dynamics offsets (FurDisplacement0..3) from the owning proxy, so the values don't have to be pushed
+ * into every shell MID.
+ */
+class FURTEST_API FFurShellMaterialRenderProxy : public FMaterialRenderProxy
+{
+public:
+	FFurShellMaterialRenderProxy(const FMaterialRenderProxy* InParent, const FFurShadowParameters& InShadowParameters, const FFurDynamicsParameters& InDynamicsParameters)
+		: Parent(InParent)
+		, ShadowParameters(InShadowParameters)
+		, DynamicsParameters(InDynamicsParameters)
+	{
+	}
+
+	virtual const FMaterial& GetMaterialWithFallback(ERHIFeatureLevel::Type InFeatureLevel, const FMaterialRenderProxy*& OutFallbackMaterialRenderProxy) const override;
+	virtual UMaterialInterface* GetMaterialInterface() const override;
+	virtual bool GetVectorValue(const FMaterialParameterInfo& ParameterInfo, FLinearColor* OutValue, const FMaterialRenderContext& Context) const override;
+	virtual bool GetScalarValue(const FMaterialParameterInfo& ParameterInfo, float* OutValue, const FMaterialRenderContext& Context) const override;
+	virtual bool GetTextureValue(const FMaterialParameterInfo& ParameterInfo, const UTexture** OutValue, const FMaterialRenderContext& Context) const override;
+
+private:
+	const FMaterialRenderProxy* const Parent;
+	const FFurShadowParameters ShadowParameters;
+	const FFurDynamicsParameters DynamicsParameters;
+};
@@ -0,0 +1,36 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "FurShellSkinning.h"
+#include "HAL/IConsoleManager.h"
+
+static TAutoConsoleVariable<int32> CVarFurPerShellSkinningMaxShells(
+	TEXT("fur.Shells.PerShellSkinningMaxShells"),
+	0,
+	TEXT("Most shells drawn on a furry section that can't read its vertices from the GPU skin cache,\n")
+	TEXT("where every shell skins the section again. 0 for no limit."),
+	ECVF_Scalability | ECVF_RenderThreadSafe);
+
+EFurShellSkinning FFurShellSkinning::Select(const FFurShellSkinningInputs& Inputs)
+{
+	if (Inputs.NumShells <= 0)
+	{
+		return EFurShellSkinning::None;
+	}
+	if (Inputs.bSkinCacheSupported && Inputs.bSkinCacheEnabled && !Inputs.bCPUSkinned && Inputs.bSectionCached)
+	{
+		return EFurShellSkinning::SkinCache;
+	}
+	// The instanced draw reads the section's GPU skin bone matrices, which CPU skinned meshes don't have.
+	if (Inputs.bInstancingSupported && !Inputs.bCPUSkinned)
+	{
+		return EFurShellSkinning::Instanced;
+	}
+	return EFurShellSkinning::PerShell;
+}
+
+int32 FFurShellSkinning::GetPerShellMaxShells()
+{
+	const int32 MaxShells = CVarFurPerShellSkinningMaxShells.GetValueOnAnyThread();
+	return MaxShells > 0 ? MaxShells : -1;
+}
@@ -0,0 +1,55 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/** Where the shells of a section get their skinned vertices from for a frame. */
+enum class EFurShellSkinning : uint8
+{
+	/** No shells are drawn, nothing to skin. */
+	None,
+	/** The section is skinned once into the GPU skin cache; every shell reads it and only adds its offset. */
+	SkinCache,
+	/** Every shell skins the section again in its vertex shader. */
+	PerShell,
+	/** All shells are one instanced draw of the fur shell vertex factory, which skins the section per instance. */
+	Instanced,
+};
+
+/** What the choice depends on, as plain values so it can be checked without a GPU. */
+struct FFurShellSkinningInputs
+{
+	/** The scene has a GPU skin cache: off on null RHI, below SM5 and without r.SkinCache.CompileShaders. */
+	bool bSkinCacheSupported = false;
+	/** r.SkinCache.Mode is on this frame. */
+	bool bSkinCacheEnabled = false;
+	/** Whether the mesh object skins on the CPU, which never goes through the skin cache. */
+	bool bCPUSkinned = false;
+	/** The skin cache holds this section's vertices this frame. It can run out of memory for some meshes. */
+	bool bSectionCached = false;
+	/**
+	 * Instanced shells are on, the instanced shell material compiled the fur shell vertex factory, and the section
+	 * has at most four bone influences and no cloth.
+	 */
+	bool bInstancingSupported = false;
+	/** Shells drawn on the section, in any view. */
+	int32 NumShells = 0;
+};
+
+struct FURTEST_API FFurShellSkinning
+{
+	static EFurShellSkinning Select(const FFurShellSkinningInputs& Inputs);
+
+	/** Whether the shells of a section skinned this way skin it again for every shell. */
+	static bool SkinsPerShell(EFurShellSkinning Skinning)
+	{
+		return Skinning == EFurShellSkinning::PerShell || Skinning == EFurShellSkinning::Instanced;
+	}
+
+	/**
+	 * Most shells drawn on a section that has to be skinned per shell, from fur.Shells.PerShellSkinningMaxShells.
+	 * Negative for no limit.
+	 */
+	static int32 GetPerShellMaxShells();
+};
@@ -0,0 +1,61 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "FurShellSkinning.h"
+#include "Misc/AutomationTest.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FFurShellSkinningTest, "FurTest.Shells.Skinning", EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::ProductFilter)
+
+bool FFurShellSkinningTest::RunTest(const FString& Parameters)
+{
+	struct FCase
+	{
+		const TCHAR* Name;
+		bool bSkinCacheSupported;
+		bool bSkinCacheEnabled;
+		bool bCPUSkinned;
+		bool bSectionCached;
+		bool bInstancingSupported;
+		int32 NumShells;
+		EFurShellSkinning Expected;
+	};
+
+	// Shells read the skin cache only when every condition holds. Otherwise they are one instanced draw when the
+	// section and material support it and the mesh is GPU skinned; anything else, including a null RHI, skins per shell.
+	const FCase Cases[] =
+	{
+		{ TEXT("Cached section"), true, true, false, true, false, 15, EFurShellSkinning::SkinCache },
+		{ TEXT("Cached section, one shell"), true, true, false, true, false, 1, EFurShellSkinning::SkinCache },
+		{ TEXT("No skin cache on this RHI"), false, true, false, true, false, 15, EFurShellSkinning::PerShell },
+		{ TEXT("Skin cache mode off"), true, false, false, true, false, 15, EFurShellSkinning::PerShell },
+		{ TEXT("CPU skinned"), true, true, true, true, false, 15, EFurShellSkinning::PerShell },
+		{ TEXT("Section not in the cache"), true, true, false, false, false, 15, EFurShellSkinning::PerShell },
+		{ TEXT("Null RHI"), false, false, false, false, false, 15, EFurShellSkinning::PerShell },
+		{ TEXT("No shells, cached section"), true, true, false, true, false, 0, EFurShellSkinning::None },
+		{ TEXT("No shells, null RHI"), false, false, false, false, false, 0, EFurShellSkinning::None },
+		{ TEXT("No shells, CPU skinned"), true, true, true, false, false, 0, EFurShellSkinning::None },
+		{ TEXT("Instanced, no skin cache"), false, false, false, false, true, 15, EFurShellSkinning::Instanced },
+		{ TEXT("Instanced, section not in the cache"), true, true, false, false, true, 15, EFurShellSkinning::Instanced },
+		{ TEXT("Instanced, one shell"), false, false, false, false, true, 1, EFurShellSkinning::Instanced },
+		{ TEXT("Instanced, cached section"), true, true, false, true, true, 15, EFurShellSkinning::SkinCache },
+		{ TEXT("Instanced, CPU skinned"), true, true, true, false, true, 15, EFurShellSkinning::PerShell },
+		{ TEXT("Instanced, no shells"), false, false, false, false, true, 0, EFurShellSkinning::None },
+	};
+
+	for (const FCase& Case : Cases)
+	{
+		FFurShellSkinningInputs Inputs;
+		Inputs.bSkinCacheSupported = Case.bSkinCacheSupported;
+		Inputs.bSkinCacheEnabled = Case.bSkinCacheEnabled;
+		Inputs.bCPUSkinned = Case.bCPUSkinned;
+		Inputs.bSectionCached = Case.bSectionCached;
+		Inputs.bInstancingSupported = Case.bInstancingSupported;
+		Inputs.NumShells = Case.NumShells;
+		TestEqual(Case.Name, (int32)FFurShellSkinning::Select(Inputs), (int32)Case.Expected);
+	}
+	return true;
+}
+
+#endif
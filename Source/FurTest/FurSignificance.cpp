@@ -0,0 +1,108 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "FurSignificance.h"
+#include "FurSkeletalMeshComponent.h"
+#include "SignificanceManager.h"
+#include "GameFramework/Pawn.h"
+#include "Engine/World.h"
+
+static TAutoConsoleVariable<float> CVarFurSignificanceBehindViewScale(
+	TEXT("fur.Significance.BehindViewScale"),
+	0.25f,
+	TEXT("Scale on the significance of fur behind a player viewpoint, which the player can only see by turning around."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<float> CVarFurSignificanceHysteresis(
+	TEXT("fur.Significance.Hysteresis"),
+	0.2f,
+	TEXT("Fraction of a row's MinSignificance fur must pass above it to move up to that row, or fall below it to leave it.\n")
+	TEXT("Stops fur near a threshold switching levels every update."),
+	ECVF_Scalability);
+
+static const FName FurSignificanceTag(TEXT("Fur"));
+
+// Called from the significance manager's parallel update, off the game thread.
+static float CalculateFurSignificance(const USignificanceManager::FManagedObjectInfo* ObjectInfo, const FTransform& Viewpoint)
+{
+	const UFurSkeletalMeshComponent* Component = Cast<UFurSkeletalMeshComponent>(ObjectInfo->GetObject());
+	if (Component == nullptr || !Component->IsRegistered())
+	{
+		return 0.0f;
+	}
+	const APawn* Pawn = Cast<APawn>(Component->GetOwner());
+	if (Pawn && Pawn->IsLocallyControlled())
+	{
+		return MAX_flt;
+	}
+	return FFurSignificance::ComputeSignificance(Component->Bounds, Viewpoint, CVarFurSignificanceBehindViewScale.GetValueOnAnyThread());
+}
+
+void FFurSignificance::Register(UFurSkeletalMeshComponent* Component)
+{
+	check(IsInGameThread());
+	USignificanceManager* Manager = USignificanceManager::Get(Component->GetWorld());
+	if (Manager == nullptr || Manager->GetManagedObject(Component) != nullptr)
+	{
+		return;
+	}
+	// Sequential, so the components are changed on the game thread once all significances are known.
+	Manager->RegisterObject(Component, FurSignificanceTag, &CalculateFurSignificance, USignificanceManager::EPostSignificanceType::Sequential,
+		[](const USignificanceManager::FManagedObjectInfo* ObjectInfo, float OldSignificance, float Significance, bool bFinal)
+		{
+			UFurSkeletalMeshComponent* FurComponent = Cast<UFurSkeletalMeshComponent>(ObjectInfo->GetObject());
+			if (FurComponent && FurComponent->IsRegistered())
+			{
+				FurComponent->SetSignificanceLevel(FindLevel(FurComponent->SignificanceLevels, Significance,
+					FurComponent->SignificanceLevel, CVarFurSignificanceHysteresis.GetValueOnGameThread()));
+			}
+		});
+}
+
+void FFurSignificance::Unregister(UFurSkeletalMeshComponent* Component)
+{
+	check(IsInGameThread());
+	USignificanceManager* Manager = USignificanceManager::Get(Component->GetWorld());
+	if (Manager && Manager->GetManagedObject(Component) != nullptr)
+	{
+		Manager->UnregisterObject(Component);
+	}
+	Component->SetSignificanceLevel(INDEX_NONE);
+}
+
+float FFurSignificance::ComputeSignificance(const FBoxSphereBounds& Bounds, const FTransform& Viewpoint, float BehindViewScale)
+{
+	const FVector ToBounds = Bounds.Origin - Viewpoint.GetLocation();
+	const float Distance = FMath::Max(ToBounds.Size(), 1.0f);
+	float Significance = FMath::Min(Bounds.SphereRadius / Distance, 1.0f);
+	if ((ToBounds | Viewpoint.GetRotation().GetForwardVector()) < -Bounds.SphereRadius)
+	{
+		Significance *= FMath::Max(BehindViewScale, 0.0f);
+	}
+	return Significance;
+}
+
+int32 FFurSignificance::FindLevel(const TArray<FFurSignificanceLevel>& Levels, float Significance, int32 CurrentLevel, float Hysteresis)
+{
+	if (Levels.IsValidIndex(CurrentLevel) && Hysteresis > 0.0f)
+	{
+		// Scaling the significance is the same as scaling every row's MinSignificance the other way.
+		const float Margin = FMath::Min(Hysteresis, 0.9f);
+		const int32 UpLevel = FindLevel(Levels, Significance / (1.0f + Margin));
+		if (UpLevel < CurrentLevel)
+		{
+			return UpLevel;
+		}
+		const int32 DownLevel = FindLevel(Levels, Significance / (1.0f - Margin));
+		return FMath::Max(DownLevel, CurrentLevel);
+	}
+
+	for (int32 LevelIndex = 0; LevelIndex < Levels.Num(); ++LevelIndex)
+	{
+		if (Significance >= Levels[LevelIndex].MinSignificance)
+		{
+			return LevelIndex;
+		}
+	}
+	return Levels.Num() - 1;
+}
@@ -0,0 +1,33 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+class UFurSkeletalMeshComponent;
+struct FFurSignificanceLevel;
+
+/**
+ * Hooks fur components into the world's significance manager. Significance is the component's screen size
+ * from the closest player viewpoint, scaled down behind it; the locally controlled pawn's fur is always most
+ * significant. After every update the component is put in the first row of its SignificanceLevels it reaches, with
+ * some hysteresis so fur near a threshold doesn't switch levels every update.
+ * The game calls USignificanceManager::Update with the player viewpoints; see AFurTestGameMode.
+ */
+class FURTEST_API FFurSignificance
+{
+public:
+	static void Register(UFurSkeletalMeshComponent* Component);
+	/** Removes the component from the manager and puts it back on its authored settings. */
+	static void Unregister(UFurSkeletalMeshComponent* Component);
+
+	/** Bounds radius over distance to the viewpoint, at most 1, times BehindViewScale if the bounds are behind it. */
+	static float ComputeSignificance(const FBoxSphereBounds& Bounds, const FTransform& Viewpoint, float BehindViewScale);
+
+	/**
+	 * First row, ordered from most to least significant, whose MinSignificance is reached; the last row if none is. INDEX_NONE if empty.
+	 * With a valid CurrentLevel, moving to a more significant row needs MinSignificance * (1 + Hysteresis) and leaving the
+	 * current row for a less significant one needs falling below its MinSignificance * (1 - Hysteresis).
+	 */
+	static int32 FindLevel(const TArray<FFurSignificanceLevel>& Levels, float Significance, int32 CurrentLevel = INDEX_NONE, float Hysteresis = 0.0f);
+};
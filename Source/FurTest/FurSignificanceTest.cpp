@@ -0,0 +1,76 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "FurSignificance.h"
+#include "FurSkeletalMeshComponent.h"
+#include "Misc/AutomationTest.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FFurSignificanceTest, "FurTest.Significance", EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::ProductFilter)
+
+bool FFurSignificanceTest::RunTest(const FString& Parameters)
+{
+	// A 100 cm sphere seen from the origin looking along +X.
+	const FTransform Viewpoint = FTransform::Identity;
+	struct FSignificanceCase
+	{
+		const TCHAR* Name;
+		FVector Origin;
+		float Expected;
+	};
+	const FSignificanceCase SignificanceCases[] =
+	{
+		{ TEXT("In front"), FVector(1000.0f, 0.0f, 0.0f), 0.1f },
+		{ TEXT("To the side"), FVector(0.0f, 1000.0f, 0.0f), 0.1f },
+		{ TEXT("Behind"), FVector(-1000.0f, 0.0f, 0.0f), 0.025f },
+		{ TEXT("Around the viewpoint"), FVector(50.0f, 0.0f, 0.0f), 1.0f },
+	};
+	for (const FSignificanceCase& Case : SignificanceCases)
+	{
+		const float Significance = FFurSignificance::ComputeSignificance(FBoxSphereBounds(Case.Origin, FVector(100.0f), 100.0f), Viewpoint, 0.25f);
+		TestEqual(Case.Name, Significance, Case.Expected, 1.e-4f);
+	}
+
+	TArray<FFurSignificanceLevel> Levels;
+	Levels.AddDefaulted(3);
+	Levels[0].MinSignificance = 0.15f;
+	Levels[1].MinSignificance = 0.06f;
+	Levels[2].MinSignificance = 0.025f;
+	struct FLevelCase
+	{
+		const TCHAR* Name;
+		float Significance;
+		int32 CurrentLevel;
+		float Hysteresis;
+		int32 Expected;
+	};
+	// With a 0.2 margin, row 0 is entered above 0.18 and left below 0.12; row 1 is entered above 0.072 and left below 0.048.
+	const FLevelCase LevelCases[] =
+	{
+		{ TEXT("Locally controlled"), MAX_flt, INDEX_NONE, 0.0f, 0 },
+		{ TEXT("On the first threshold"), 0.15f, INDEX_NONE, 0.0f, 0 },
+		{ TEXT("Between thresholds"), 0.1f, INDEX_NONE, 0.0f, 1 },
+		{ TEXT("On the last threshold"), 0.025f, INDEX_NONE, 0.0f, 2 },
+		{ TEXT("Below every threshold"), 0.0f, INDEX_NONE, 0.0f, 2 },
+		{ TEXT("No current row ignores the margin"), 0.16f, INDEX_NONE, 0.2f, 0 },
+		{ TEXT("No margin moves up on the threshold"), 0.16f, 1, 0.0f, 0 },
+		{ TEXT("Just above the next row stays"), 0.16f, 1, 0.2f, 1 },
+		{ TEXT("Past the margin moves up"), 0.2f, 1, 0.2f, 0 },
+		{ TEXT("Past the margin skips rows up"), MAX_flt, 2, 0.2f, 0 },
+		{ TEXT("Just above the row below moves up one"), 0.1f, 2, 0.2f, 1 },
+		{ TEXT("Just below the current row stays"), 0.13f, 0, 0.2f, 0 },
+		{ TEXT("Just above row 1 stays"), 0.065f, 2, 0.2f, 2 },
+		{ TEXT("Just below row 1 stays"), 0.055f, 1, 0.2f, 1 },
+		{ TEXT("Past the margin moves down"), 0.11f, 0, 0.2f, 1 },
+		{ TEXT("Past the margin skips rows down"), 0.01f, 0, 0.2f, 2 },
+	};
+	for (const FLevelCase& Case : LevelCases)
+	{
+		TestEqual(Case.Name, FFurSignificance::FindLevel(Levels, Case.Significance, Case.CurrentLevel, Case.Hysteresis), Case.Expected);
+	}
+	TestEqual(TEXT("No rows"), FFurSignificance::FindLevel(TArray<FFurSignificanceLevel>(), 1.0f), (int32)INDEX_NONE);
+	return true;
+}
+
+#endif
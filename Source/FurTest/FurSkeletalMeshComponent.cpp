@@ -6,8 +6,134 @@
 #include "SkeletalRenderPublic.h"
 #include "FurSkeletalMeshSceneProxy.h"
 #include "Components/SceneCaptureComponent2D.h"
-#include "Materials/MaterialInstanceDynamic.h"
 #include "Engine/TextureRenderTarget2D.h"
+#include "Engine/SkeletalMesh.h"
+#include "FurLayerAsset.h"
+#include "Materials/MaterialInstanceDynamic.h"
+#include "FurStats.h"
+#include "FurDynamics.h"
+#include "FurBudget.h"
+#include "FurShadowAtlas.h"
+#include "FurSignificance.h"
+#include "FurShellHelpers.h"
+#include "GameFramework/Character.h"
+#if WITH_EDITOR
+#include "Logging/MessageLog.h"
+#include "Misc/UObjectToken.h"
+#endif
+
+static TAutoConsoleVariable<int32> CVarFurShadowMaxCapturesPerFrame(
+	TEXT("fur.Shadow.MaxCapturesPerFrame"),
+	4,
+	TEXT("Most fur shadow captures issued per frame across all fur components of a world. 0 for no limit.\n")
+	TEXT("Components over the budget keep their shadow dirty and capture on a later frame."),
+	ECVF_Scalability);
+
+UFurSkeletalMeshComponent::UFurSkeletalMeshComponent(const FObjectInitializer& ObjectInitializer)
+	: Super(ObjectInitializer)
+	, LastPushedShadowTargetSize(0, 0)
+	, LastPushedFOV(0.0f)
+	, LastPushedOrthoWidth(0.0f)
+	, LastPushedProjectionType(ECameraProjectionMode::Perspective)
+	, LastShadowCaptureTime(0.0f)
+	, bShadowCaptureDirty(true)
+	, bPoseChangedSinceCapture(true)
+	, bTransformChangedSinceCapture(true)
+	, bInShadowAtlas(false)
+	, BudgetShellCount(-1)
+	, SignificanceLevel(INDEX_NONE)
+	, bDrawsOwnerSkin(false)
+	, OwnerAnimTickOption(EVisibilityBasedAnimTickOption::AlwaysTickPose)
+	, bOwnerRenderInMainPass(true)
+	, bHasSavedAttachment(false)
+	, FurLayerInstancedShellMaterial(nullptr)
+	, FurLayers(nullptr)
+	, bInstancedShells(false)
+	, InstancedShellMaterial(nullptr)
+	, ShellLODHysteresis(0.02f)
+	, FurBudgetImportance(1.0f)
+	, MaxFurLength(2.0f)
+	, bFurSectionCulling(false)
+	, bFurOnUnlistedSections(true)
+	, bFurFins(false)
+	, FinMaterial(nullptr)
+	, FinLength(1.0f)
+	, FinSilhouetteThreshold(0.2f)
+	, bFurDynamics(false)
+	, FurStiffness(200.0f)
+	, FurDamping(15.0f)
+	, FurGravityScale(0.1f)
+	, FurWind(FVector::ZeroVector)
+	, FurMaxDisplacement(2.0f)
+	, bBuiltInShadow(false)
+	, bShadowAtlas(false)
+	, BuiltInShadowRotation(-60.0f, 0.0f, 0.0f)
+	, BuiltInShadowResolution(512)
+	, bChangeDrivenShadowCapture(false)
+	, ShadowLocationThreshold(1.0f)
+	, ShadowRotationThreshold(0.5f)
+	, ShadowPoseThreshold(0.5f)
+	, MaxShadowUpdateRate(30.0f)
+	, bFurSignificance(false)
+	, bBakeFur(false)
+	, bUseOwnerPose(false)
+{
+	FurShadowTickFunction.bCanEverTick = true;
+	FurShadowTickFunction.bStartWithTickEnabled = false;
+	FurShadowTickFunction.TickGroup = TG_PostUpdateWork;
+}
+
+void FFurShadowTickFunction::ExecuteTick(float DeltaTime, ELevelTick TickType, ENamedThreads::Type CurrentThread, const FGraphEventRef& MyCompletionGraphEvent)
+{
+	if (Target && !Target->IsPendingKill() && Target->IsRegistered())
+	{
+		Target->TickFurShadow(DeltaTime);
+	}
+}
+
+FString FFurShadowTickFunction::DiagnosticMessage()
+{
+	return Target ? Target->GetFullName() + TEXT("[FurShadowTick]") : TEXT("<NULL>[FurShadowTick]");
+}
+
+void UFurSkeletalMeshComponent::RegisterComponentTickFunctions(bool bRegister)
+{
+	Super::RegisterComponentTickFunctions(bRegister);
+
+	if (bRegister)
+	{
+		if (SetupActorComponentTickFunction(&FurShadowTickFunction))
+		{
+			FurShadowTickFunction.Target = this;
+			FurShadowTickFunction.AddPrerequisite(this, PrimaryComponentTick);
+			RefreshFurShadowTickEnabled();
+		}
+	}
+	else if (FurShadowTickFunction.IsTickFunctionRegistered())
+	{
+		FurShadowTickFunction.UnRegisterTickFunction();
+	}
+}
+
+void UFurSkeletalMeshComponent::RefreshFurShadowTickEnabled()
+{
+	if (FurShadowTickFunction.IsTickFunctionRegistered())
+	{
+		FurShadowTickFunction.SetTickFunctionEnable(InnerShadowCaster != nullptr && !bInShadowAtlas);
+	}
+}
+
+void UFurSkeletalMeshComponent::FinalizeBoneTransform()
+{
+	Super::FinalizeBoneTransform();
+	bPoseChangedSinceCapture = true;
+}
+
+void UFurSkeletalMeshComponent::OnUpdateTransform(EUpdateTransformFlags UpdateTransformFlags, ETeleportType Teleport)
+{
+	Super::OnUpdateTransform(UpdateTransformFlags, Teleport);
+	bTransformChangedSinceCapture = true;
+}
 
 USceneCaptureComponent2D * UFurSkeletalMeshComponent::ShadowCaster() const
 {
@@ -17,42 +143,966 @@ USceneCaptureComponent2D * UFurSkeletalMeshComponent::ShadowCaster() const
 void UFurSkeletalMeshComponent::SetShadowCaster(USceneCaptureComponent2D * newCaster)
 {
 	InnerShadowCaster = newCaster;
-	if (InnerShadowCaster && InnerShadowCaster->TextureTarget)
+	if (InnerShadowCaster && bChangeDrivenShadowCapture)
+	{
+		InnerShadowCaster->bCaptureEveryFrame = false;
+		InnerShadowCaster->bCaptureOnMovement = false;
+	}
+	bShadowCaptureDirty = true;
+	if (!bInShadowAtlas)
+	{
+		UpdateShadowParameters(true);
+	}
+	RefreshFurShadowTickEnabled();
+}
+
+void UFurSkeletalMeshComponent::SetFurLayers(UFurLayerAsset* NewFurLayers)
+{
+	FurLayers = NewFurLayers;
+	ApplyFurLayers();
+	UpdateShellMaterials();
+}
+
+void UFurSkeletalMeshComponent::SetShellMaterials(const TArray<UMaterialInterface*>& NewMaterials)
+{
+	MultiPassMaterial = NewMaterials;
+	UpdateShellMaterials();
+}
+
+void UFurSkeletalMeshComponent::AddShellMaterial(UMaterialInterface* Material, int32 Index)
+{
+	if (Index >= 0 && Index <= MultiPassMaterial.Num())
+	{
+		MultiPassMaterial.Insert(Material, Index);
+	}
+	else
+	{
+		MultiPassMaterial.Add(Material);
+	}
+	UpdateShellMaterials();
+}
+
+void UFurSkeletalMeshComponent::RemoveShellMaterial(int32 Index)
+{
+	if (MultiPassMaterial.IsValidIndex(Index))
+	{
+		MultiPassMaterial.RemoveAt(Index);
+		UpdateShellMaterials();
+	}
+}
+
+void UFurSkeletalMeshComponent::MoveShellMaterial(int32 FromIndex, int32 ToIndex)
+{
+	if (MultiPassMaterial.IsValidIndex(FromIndex) && MultiPassMaterial.IsValidIndex(ToIndex) && FromIndex != ToIndex)
+	{
+		UMaterialInterface* Material = MultiPassMaterial[FromIndex];
+		MultiPassMaterial.RemoveAt(FromIndex);
+		MultiPassMaterial.Insert(Material, ToIndex);
+		UpdateShellMaterials();
+	}
+}
+
+void UFurSkeletalMeshComponent::SetInstancedShells(bool bEnable, UMaterialInterface* Material)
+{
+	bInstancedShells = bEnable;
+	InstancedShellMaterial = Material;
+	ApplyFurLayers();
+	UpdateShellMaterials();
+}
+
+FMaterialRelevance UFurSkeletalMeshComponent::GetShellMaterialRelevance(ERHIFeatureLevel::Type FeatureLevel) const
+{
+	FMaterialRelevance Relevance = FFurShellHelpers::GetMaterialRelevance(GetShellMaterials(), FeatureLevel);
+	if (UMaterialInterface* Instanced = GetInstancedShellMaterial())
+	{
+		Relevance |= Instanced->GetRelevance_Concurrent(FeatureLevel);
+	}
+	if (bFurFins && FinMaterial)
+	{
+		Relevance |= FinMaterial->GetRelevance_Concurrent(FeatureLevel);
+	}
+	return Relevance;
+}
+
+void UFurSkeletalMeshComponent::UpdateShellMaterials()
+{
+	FurSkeletalMeshSceneProxy* FurProxy = static_cast<FurSkeletalMeshSceneProxy*>(SceneProxy);
+	if (FurProxy == nullptr)
+	{
+		// Nothing to update; the next proxy reads the new materials.
+		return;
+	}
+
+	// The proxy's view relevance is fixed at creation, so a shell needing a pass the old ones didn't means a new proxy.
+	// So do instanced shells turned on or off, as the proxy only makes their vertex factories when it is created.
+	FMaterialRelevance Relevance = FurProxy->ShellMaterialRelevance;
+	Relevance |= GetShellMaterialRelevance(GetWorld()->FeatureLevel);
+	if (FMemory::Memcmp(&Relevance, &FurProxy->ShellMaterialRelevance, sizeof(FMaterialRelevance)) != 0
+		|| (GetInstancedShellMaterial() != nullptr) != FurProxy->bCreatedWithInstancedShells)
+	{
+		MarkRenderStateDirty();
+		return;
+	}
+
+	FurSkeletalMeshSceneProxy::FShellMaterialUpdate Update;
+	Update.MultiPassMaterial = GetShellMaterials();
+	Update.InstancedShellMaterial = GetInstancedShellMaterial();
+#if WITH_EDITOR
+	GetUsedMaterials(Update.UsedMaterials);
+#endif
+	ENQUEUE_RENDER_COMMAND(FurUpdateShellMaterials)(
+		[FurProxy, Update = MoveTemp(Update)](FRHICommandListImmediate& RHICmdList)
+		{
+			FurProxy->SetShellMaterials_RenderThread(Update);
+		});
+}
+
+void UFurSkeletalMeshComponent::ApplyFurLayers()
+{
+	FurLayerShellMaterials.Reset();
+	FurLayerInstancedShellMaterial = nullptr;
+	if (FurLayers)
+	{
+		FurLayerShellMaterials.Append(FurLayers->GetShellMaterials());
+		if (bInstancedShells)
+		{
+			FurLayerInstancedShellMaterial = FurLayers->GetInstancedShellMaterial();
+		}
+	}
+}
+
+void UFurSkeletalMeshComponent::SetFurBake(bool bEnable, const FFurBakeSettings& Settings)
+{
+	bBakeFur = bEnable;
+	FurBakeSettings = Settings;
+	if (IsRegistered())
+	{
+		ApplyFurBake();
+	}
+}
+
+void UFurSkeletalMeshComponent::ApplyFurBake()
+{
+	TSharedPtr<const FFurBakedMesh> Baked;
+	TArray<TBitArray<>> FurrySections;
+	if (bBakeFur && SkeletalMesh)
+	{
+		Baked = FFurBake::GetOrBuild(SkeletalMesh, FurBakeSettings, &CookedFurBake);
+		if (Baked.IsValid())
+		{
+			GetFurrySections(FurrySections);
+		}
+	}
+	if (Baked == AppliedFurBake && FurrySections == AppliedFurBakeSections)
+	{
+		return;
+	}
+
+	ClearFurBake();
+	if (Baked.IsValid())
+	{
+		FurBakeOverrideLODs.Init(false, FurrySections.Num());
+		for (int32 LODIndex = 0; LODIndex < FurrySections.Num(); ++LODIndex)
+		{
+			// LODs that weren't baked, or have no fur, keep their authored vertex colours.
+			TArray<FColor> Colors;
+			if (FFurBake::MakeVertexColorOverride(SkeletalMesh, LODIndex, *Baked, FurrySections[LODIndex], Colors))
+			{
+				SetVertexColorOverride(LODIndex, Colors);
+				FurBakeOverrideLODs[LODIndex] = true;
+			}
+		}
+	}
+	AppliedFurBake = Baked;
+	AppliedFurBakeSections = MoveTemp(FurrySections);
+}
+
+void UFurSkeletalMeshComponent::ClearFurBake()
+{
+	for (int32 LODIndex = 0; LODIndex < FurBakeOverrideLODs.Num(); ++LODIndex)
+	{
+		if (FurBakeOverrideLODs[LODIndex])
+		{
+			ClearVertexColorOverride(LODIndex);
+		}
+	}
+	FurBakeOverrideLODs.Empty();
+	AppliedFurBakeSections.Reset();
+	AppliedFurBake.Reset();
+}
+
+void UFurSkeletalMeshComponent::GetFurrySections(TArray<TBitArray<>>& OutFurrySections) const
+{
+	const FSkeletalMeshRenderData* RenderData = SkeletalMesh ? SkeletalMesh->GetResourceForRendering() : nullptr;
+	OutFurrySections.Reset();
+	if (RenderData == nullptr)
+	{
+		return;
+	}
+	OutFurrySections.SetNum(RenderData->LODRenderData.Num());
+	for (int32 LODIndex = 0; LODIndex < RenderData->LODRenderData.Num(); ++LODIndex)
+	{
+		// Same material resolution as the scene proxy's section elements.
+		const FSkeletalMeshLODRenderData& LODData = RenderData->LODRenderData[LODIndex];
+		const FSkeletalMeshLODInfo* LODInfo = SkeletalMesh->GetLODInfo(LODIndex);
+		TArray<int32> SectionMaterialIndices;
+		for (int32 SectionIndex = 0; SectionIndex < LODData.RenderSections.Num(); ++SectionIndex)
+		{
+			int32 MaterialIndex = LODData.RenderSections[SectionIndex].MaterialIndex;
+			if (LODInfo && LODInfo->LODMaterialMap.IsValidIndex(SectionIndex) && LODInfo->LODMaterialMap[SectionIndex] != INDEX_NONE)
+			{
+				MaterialIndex = LODInfo->LODMaterialMap[SectionIndex];
+			}
+			SectionMaterialIndices.Add(MaterialIndex);
+		}
+		TArray<int32> ShellLimits;
+		GetSectionShellLimits(LODIndex, SectionMaterialIndices, ShellLimits);
+		OutFurrySections[LODIndex].Init(false, ShellLimits.Num());
+		for (int32 SectionIndex = 0; SectionIndex < ShellLimits.Num(); ++SectionIndex)
+		{
+			OutFurrySections[LODIndex][SectionIndex] = ShellLimits[SectionIndex] != 0;
+		}
+	}
+}
+
+#if WITH_EDITOR
+void UFurSkeletalMeshComponent::PreSave(const ITargetPlatform* TargetPlatform)
+{
+	Super::PreSave(TargetPlatform);
+	// A target platform means a cook; editor saves keep the bake out of the source package.
+	CookedFurBake = FFurCookedBake();
+	if (TargetPlatform && bBakeFur && SkeletalMesh)
+	{
+		FFurBake::Cook(SkeletalMesh, FurBakeSettings, CookedFurBake);
+	}
+}
+
+void UFurSkeletalMeshComponent::CheckForErrors()
+{
+	Super::CheckForErrors();
+	if (!bBakeFur || SkeletalMesh == nullptr)
+	{
+		return;
+	}
+	TArray<FString> Problems;
+	FFurBake::GetProblems(SkeletalMesh, FurBakeSettings, Problems);
+	for (const FString& Problem : Problems)
+	{
+		FMessageLog("MapCheck").Warning()
+			->AddToken(FUObjectToken::Create(GetOwner()))
+			->AddToken(FTextToken::Create(FText::FromString(Problem)));
+	}
+}
+#endif
+
+void UFurSkeletalMeshComponent::SetSkeletalMesh(USkeletalMesh* NewMesh, bool bReinitPose)
+{
+	// The overrides are sized for the old mesh; drop them before it goes.
+	ClearFurBake();
+	Super::SetSkeletalMesh(NewMesh, bReinitPose);
+	if (IsRegistered())
+	{
+		ApplyFurBake();
+	}
+}
+
+void UFurSkeletalMeshComponent::OnRegister()
+{
+	ApplyFurLayers();
+	Super::OnRegister();
+	ApplyFurBake();
+	if (GetWorld() && GetWorld()->IsGameWorld())
+	{
+		FFurShellBudget::Register(this);
+		if (ShouldRunDynamics())
+		{
+			FFurDynamicsSolver::Register(this);
+		}
+	}
+	if (bShadowAtlas && GetWorld() && GetWorld()->IsGameWorld())
+	{
+		FFurShadowAtlas::Register(this);
+		RefreshFurShadowTickEnabled();
+	}
+	else if (bBuiltInShadow && GetWorld() && GetWorld()->IsGameWorld())
+	{
+		CreateBuiltInShadow();
+	}
+
+	// Start at a random phase of the update interval so components spawned together don't capture together.
+	const float ShadowUpdateRate = GetShadowUpdateRate();
+	if (ShadowUpdateRate > 0.0f && GetWorld())
+	{
+		LastShadowCaptureTime = GetWorld()->GetTimeSeconds() - FMath::FRand() / ShadowUpdateRate;
+	}
+	bShadowCaptureDirty = true;
+
+	if (bUseOwnerPose && HasBegunPlay())
+	{
+		ApplyOwnerPose();
+	}
+}
+
+void UFurSkeletalMeshComponent::OnUnregister()
+{
+	ReleaseOwnerPose();
+	FFurDynamicsSolver::Unregister(this);
+	FFurShellBudget::Unregister(this);
+	DynamicsParameters = FFurDynamicsParameters();
+	FFurShadowAtlas::Unregister(this);
+	DestroyBuiltInShadow();
+	Super::OnUnregister();
+}
+
+void UFurSkeletalMeshComponent::BeginPlay()
+{
+	Super::BeginPlay();
+	if (bUseOwnerPose)
+	{
+		ApplyOwnerPose();
+	}
+	if (bFurSignificance && GetWorld() && GetWorld()->IsGameWorld())
+	{
+		FFurSignificance::Register(this);
+	}
+}
+
+void UFurSkeletalMeshComponent::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	FFurSignificance::Unregister(this);
+	ReleaseOwnerPose();
+	Super::EndPlay(EndPlayReason);
+}
+
+void UFurSkeletalMeshComponent::SetFurSignificance(bool bEnable)
+{
+	bFurSignificance = bEnable;
+	if (!HasBegunPlay() || GetWorld() == nullptr || !GetWorld()->IsGameWorld())
+	{
+		return;
+	}
+	if (bFurSignificance)
+	{
+		FFurSignificance::Register(this);
+	}
+	else
 	{
-		for (int i = 0; i < MultiPassMaterial.Num(); ++i)
+		FFurSignificance::Unregister(this);
+	}
+}
+
+const FFurSignificanceLevel* UFurSkeletalMeshComponent::GetSignificanceLevel() const
+{
+	return SignificanceLevels.IsValidIndex(SignificanceLevel) ? &SignificanceLevels[SignificanceLevel] : nullptr;
+}
+
+int32 UFurSkeletalMeshComponent::GetSignificanceShellCount() const
+{
+	const FFurSignificanceLevel* Level = GetSignificanceLevel();
+	return Level && Level->MaxShells >= 0 ? Level->MaxShells : -1;
+}
+
+float UFurSkeletalMeshComponent::GetShadowUpdateRate() const
+{
+	const FFurSignificanceLevel* Level = GetSignificanceLevel();
+	if (Level == nullptr || Level->MaxShadowUpdateRate <= 0.0f)
+	{
+		return MaxShadowUpdateRate;
+	}
+	return MaxShadowUpdateRate > 0.0f ? FMath::Min(MaxShadowUpdateRate, Level->MaxShadowUpdateRate) : Level->MaxShadowUpdateRate;
+}
+
+int32 UFurSkeletalMeshComponent::GetShadowResolution() const
+{
+	const FFurSignificanceLevel* Level = GetSignificanceLevel();
+	if (Level == nullptr || Level->MaxShadowResolution <= 0)
+	{
+		return BuiltInShadowResolution;
+	}
+	return FMath::Min(BuiltInShadowResolution, Level->MaxShadowResolution);
+}
+
+bool UFurSkeletalMeshComponent::ShouldDrawFins() const
+{
+	const FFurSignificanceLevel* Level = GetSignificanceLevel();
+	return bFurFins && FinMaterial && (Level == nullptr || Level->bFins);
+}
+
+bool UFurSkeletalMeshComponent::ShouldRunDynamics() const
+{
+	const FFurSignificanceLevel* Level = GetSignificanceLevel();
+	return bFurDynamics && (Level == nullptr || Level->bDynamics);
+}
+
+void UFurSkeletalMeshComponent::SetSignificanceLevel(int32 NewLevel)
+{
+	if (NewLevel == SignificanceLevel)
+	{
+		return;
+	}
+	const int32 OldShellCount = GetSignificanceShellCount();
+	const int32 OldShadowResolution = GetShadowResolution();
+	const bool bHadFins = ShouldDrawFins();
+	const bool bHadDynamics = ShouldRunDynamics();
+	SignificanceLevel = NewLevel;
+	const FFurSignificanceLevel* Level = GetSignificanceLevel();
+
+	FurSkeletalMeshSceneProxy* FurProxy = static_cast<FurSkeletalMeshSceneProxy*>(SceneProxy);
+	const int32 ShellCount = GetSignificanceShellCount();
+	if (ShellCount != OldShellCount && FurProxy)
+	{
+		ENQUEUE_RENDER_COMMAND(FurUpdateSignificanceShellCount)(
+			[FurProxy, ShellCount](FRHICommandListImmediate& RHICmdList)
+			{
+				FurProxy->SetSignificanceShellCount_RenderThread(ShellCount);
+			});
+	}
+
+	FurShadowTickFunction.UpdateTickIntervalAndCoolDown(Level ? Level->ParameterTickInterval : 0.0f);
+
+	const int32 ShadowResolution = GetShadowResolution();
+	if (ShadowResolution != OldShadowResolution && BuiltInShadowTarget)
+	{
+		BuiltInShadowTarget->ResizeTarget(ShadowResolution, ShadowResolution);
+		bShadowCaptureDirty = true;
+	}
+
+	if (ShouldRunDynamics() != bHadDynamics && GetWorld() && GetWorld()->IsGameWorld())
+	{
+		if (bHadDynamics)
+		{
+			// Without the solver the fur rests on the skin.
+			FFurDynamicsSolver::Unregister(this);
+			DynamicsParameters = FFurDynamicsParameters();
+			if (FurProxy)
+			{
+				ENQUEUE_RENDER_COMMAND(FurResetDynamicsParameters)(
+					[FurProxy](FRHICommandListImmediate& RHICmdList)
+					{
+						FurProxy->SetDynamicsParameters_RenderThread(FFurDynamicsParameters());
+					});
+			}
+		}
+		else
 		{
-			if (MultiPassMaterial[i] != nullptr)
+			FFurDynamicsSolver::Register(this);
+		}
+	}
+
+	const bool bFins = ShouldDrawFins();
+	if (bFins != bHadFins && FurProxy)
+	{
+		ENQUEUE_RENDER_COMMAND(FurUpdateSignificanceFins)(
+			[FurProxy, bFins](FRHICommandListImmediate& RHICmdList)
 			{
-				UMaterialInstanceDynamic* dynamicMat = Cast<UMaterialInstanceDynamic>(MultiPassMaterial[i]);
-				if (dynamicMat)
+				FurProxy->SetFinsEnabled_RenderThread(bFins);
+			});
+	}
+}
+
+void UFurSkeletalMeshComponent::SetUseOwnerPose(bool bEnable)
+{
+	bUseOwnerPose = bEnable;
+	if (!IsRegistered() || !HasBegunPlay())
+	{
+		return;
+	}
+	if (bUseOwnerPose)
+	{
+		ApplyOwnerPose();
+	}
+	else
+	{
+		ReleaseOwnerPose(true);
+	}
+}
+
+USkeletalMeshComponent* UFurSkeletalMeshComponent::FindOwnerPoseComponent() const
+{
+	if (USkeletalMeshComponent* Parent = Cast<USkeletalMeshComponent>(GetAttachParent()))
+	{
+		return Parent;
+	}
+	AActor* Owner = GetOwner();
+	if (Owner == nullptr)
+	{
+		return nullptr;
+	}
+	if (ACharacter* Character = Cast<ACharacter>(Owner))
+	{
+		if (Character->GetMesh() && Character->GetMesh() != this)
+		{
+			return Character->GetMesh();
+		}
+	}
+	TInlineComponentArray<USkeletalMeshComponent*> Components(Owner);
+	for (USkeletalMeshComponent* Component : Components)
+	{
+		if (Component != this && !Component->IsA<UFurSkeletalMeshComponent>())
+		{
+			return Component;
+		}
+	}
+	return nullptr;
+}
+
+void UFurSkeletalMeshComponent::ApplyOwnerPose()
+{
+	ReleaseOwnerPose();
+	USkeletalMeshComponent* Owner = FindOwnerPoseComponent();
+	if (Owner == nullptr || Owner->SkeletalMesh == nullptr)
+	{
+		return;
+	}
+	OwnerPoseComponent = Owner;
+
+	// Master pose bone transforms are in component space, so both components have to line up.
+	if (!bHasSavedAttachment)
+	{
+		SavedAttachParent = GetAttachParent();
+		SavedAttachSocketName = GetAttachSocketName();
+		SavedRelativeTransform = GetRelativeTransform();
+		bHasSavedAttachment = true;
+	}
+	if (GetAttachParent() != Owner)
+	{
+		AttachToComponent(Owner, FAttachmentTransformRules::SnapToTargetIncludingScale);
+	}
+	else
+	{
+		SetRelativeTransform(FTransform::Identity);
+	}
+
+	if (SkeletalMesh == nullptr)
+	{
+		SetSkeletalMesh(Owner->SkeletalMesh, false);
+	}
+	// A slave doesn't evaluate animation or keep bone transforms of its own; it reads the owner's.
+	SetMasterPoseComponent(Owner);
+
+	if (SkeletalMesh == Owner->SkeletalMesh && GetWorld() && GetWorld()->IsGameWorld())
+	{
+		// Same vertices: the skin is drawn here instead of in the owner's main pass. The owner keeps its pose,
+		// shadow and any other pass.
+		if (OverrideMaterials.Num() == 0)
+		{
+			for (int32 MaterialIndex = 0; MaterialIndex < Owner->OverrideMaterials.Num(); ++MaterialIndex)
+			{
+				if (Owner->OverrideMaterials[MaterialIndex])
 				{
-					FMatrix mat;
-					FIntPoint size;
-					size.X = InnerShadowCaster->TextureTarget->SizeX;
-					size.Y = InnerShadowCaster->TextureTarget->SizeY;
-					BuildProjectionMatrix(size, InnerShadowCaster->ProjectionType, InnerShadowCaster->FOVAngle, InnerShadowCaster->OrthoWidth, mat);
-					auto worldToLocal = InnerShadowCaster->GetComponentTransform().ToInverseMatrixWithScale();
-					FMatrix finalMat = /*FMatrix(
-						FPlane(0, 0, 1, 0),
-						FPlane(1, 0, 0, 0),
-						FPlane(0, 1, 0, 0),
-						FPlane(0, 0, 0, 1)) **/ worldToLocal * mat;
-					finalMat.GetColumn(1);
-					FVector4 col0(finalMat.M[0][0], finalMat.M[1][0], finalMat.M[2][0], finalMat.M[3][0]);
-					FVector4 col1(finalMat.M[0][1], finalMat.M[1][1], finalMat.M[2][1], finalMat.M[3][1]);
-					FVector4 col2(finalMat.M[0][2], finalMat.M[1][2], finalMat.M[2][2], finalMat.M[3][2]);
-					FVector4 col3(finalMat.M[0][3], finalMat.M[1][3], finalMat.M[2][3], finalMat.M[3][3]);
-					dynamicMat->SetTextureParameterValue("DirectShadowMap", InnerShadowCaster->TextureTarget);
-					//FLinearColor a;
-					dynamicMat->SetVectorParameterValue("ProjCol0", FLinearColor(col0.X, col0.Y, col0.Z, col0.W));
-					dynamicMat->SetVectorParameterValue("ProjCol1", FLinearColor(col1.X, col1.Y, col1.Z, col1.W));
-					dynamicMat->SetVectorParameterValue("ProjCol2", FLinearColor(col2.X, col2.Y, col2.Z, col2.W));
-					dynamicMat->SetVectorParameterValue("ProjCol3", FLinearColor(col3.X, col3.Y, col3.Z, col3.W));
-					dynamicMat->SetVectorParameterValue("SourcePos", InnerShadowCaster->GetComponentLocation());
-					dynamicMat->SetVectorParameterValue("SourceDir", InnerShadowCaster->GetForwardVector());
+					SetMaterial(MaterialIndex, Owner->OverrideMaterials[MaterialIndex]);
 				}
 			}
 		}
+		OwnerAnimTickOption = Owner->VisibilityBasedAnimTickOption;
+		bOwnerRenderInMainPass = Owner->bRenderInMainPass;
+		Owner->SetRenderInMainPass(false);
+		bDrawsOwnerSkin = true;
+		// The proxy leaves the shadow of the skin sections to the owner.
+		MarkRenderStateDirty();
+	}
+
+	// Guide bones are looked up on the pose source, which just changed.
+	if (ShouldRunDynamics() && GetWorld() && GetWorld()->IsGameWorld())
+	{
+		FFurDynamicsSolver::Register(this);
+	}
+	bShadowCaptureDirty = true;
+}
+
+void UFurSkeletalMeshComponent::ReleaseOwnerPose(bool bRestoreAttachment)
+{
+	if (bRestoreAttachment && bHasSavedAttachment)
+	{
+		bHasSavedAttachment = false;
+		USceneComponent* Parent = SavedAttachParent.Get();
+		if (Parent != GetAttachParent() || SavedAttachSocketName != GetAttachSocketName())
+		{
+			if (Parent)
+			{
+				AttachToComponent(Parent, FAttachmentTransformRules::KeepRelativeTransform, SavedAttachSocketName);
+			}
+			else
+			{
+				DetachFromComponent(FDetachmentTransformRules::KeepRelativeTransform);
+			}
+		}
+		SetRelativeTransform(SavedRelativeTransform);
+	}
+
+	USkeletalMeshComponent* Owner = OwnerPoseComponent.Get();
+	OwnerPoseComponent.Reset();
+	if (bDrawsOwnerSkin)
+	{
+		bDrawsOwnerSkin = false;
+		if (Owner && !Owner->IsPendingKill())
+		{
+			Owner->VisibilityBasedAnimTickOption = OwnerAnimTickOption;
+			Owner->SetRenderInMainPass(bOwnerRenderInMainPass);
+		}
+		MarkRenderStateDirty();
+	}
+	if (Owner == nullptr)
+	{
+		return;
+	}
+	if (MasterPoseComponent.Get() == Owner)
+	{
+		SetMasterPoseComponent(nullptr);
+		// Guide bones were looked up on the owner; look them up on this component again.
+		if (IsRegistered() && ShouldRunDynamics() && GetWorld() && GetWorld()->IsGameWorld())
+		{
+			FFurDynamicsSolver::Register(this);
+		}
+	}
+}
+
+const USkinnedMeshComponent* UFurSkeletalMeshComponent::GetPoseSource() const
+{
+	return MasterPoseComponent.IsValid() ? MasterPoseComponent.Get() : this;
+}
+
+void UFurSkeletalMeshComponent::SetShadowAtlas(bool bEnable)
+{
+	bShadowAtlas = bEnable;
+	if (!IsRegistered() || !GetWorld() || !GetWorld()->IsGameWorld())
+	{
+		return;
+	}
+	if (bShadowAtlas && !bInShadowAtlas)
+	{
+		DestroyBuiltInShadow();
+		FFurShadowAtlas::Register(this);
+	}
+	else if (!bShadowAtlas && bInShadowAtlas)
+	{
+		FFurShadowAtlas::Unregister(this);
+		SetShadowParameters(FFurShadowParameters());
+		if (bBuiltInShadow)
+		{
+			CreateBuiltInShadow();
+		}
+	}
+	bShadowCaptureDirty = true;
+	RefreshFurShadowTickEnabled();
+}
+
+void UFurSkeletalMeshComponent::SetBuiltInShadow(bool bEnable)
+{
+	bBuiltInShadow = bEnable;
+	if (!IsRegistered())
+	{
+		return;
+	}
+	if (bBuiltInShadow && !bInShadowAtlas && GetWorld() && GetWorld()->IsGameWorld())
+	{
+		CreateBuiltInShadow();
+	}
+	else if (!bBuiltInShadow)
+	{
+		DestroyBuiltInShadow();
+	}
+}
+
+void UFurSkeletalMeshComponent::CreateBuiltInShadow()
+{
+	if (BuiltInShadowCaster)
+	{
+		return;
+	}
+
+	BuiltInShadowTarget = NewObject<UTextureRenderTarget2D>(this, NAME_None, RF_Transient);
+	BuiltInShadowTarget->RenderTargetFormat = RTF_R32f;
+	BuiltInShadowTarget->ClearColor = FLinearColor::Black;
+	const int32 ShadowResolution = GetShadowResolution();
+	BuiltInShadowTarget->InitAutoFormat(ShadowResolution, ShadowResolution);
+
+	// Only this component, depth only, and nothing the depth doesn't need.
+	BuiltInShadowCaster = NewObject<USceneCaptureComponent2D>(this, NAME_None, RF_Transient);
+	ConfigureShadowDepthCapture(BuiltInShadowCaster);
+	BuiltInShadowCaster->ShowOnlyComponent(this);
+	BuiltInShadowCaster->TextureTarget = BuiltInShadowTarget;
+	BuiltInShadowCaster->RegisterComponentWithWorld(GetWorld());
+
+	InnerShadowCaster = BuiltInShadowCaster;
+	RefreshFurShadowTickEnabled();
+}
+
+void UFurSkeletalMeshComponent::ConfigureShadowDepthCapture(USceneCaptureComponent2D* Capture)
+{
+	Capture->bCaptureEveryFrame = false;
+	Capture->bCaptureOnMovement = false;
+	Capture->CaptureSource = ESceneCaptureSource::SCS_SceneDepth;
+	Capture->PrimitiveRenderMode = ESceneCapturePrimitiveRenderMode::PRM_UseShowOnlyList;
+	Capture->ProjectionType = ECameraProjectionMode::Orthographic;
+	Capture->ShowFlags.SetLighting(false);
+	Capture->ShowFlags.SetDynamicShadows(false);
+	Capture->ShowFlags.SetPostProcessing(false);
+	Capture->ShowFlags.SetAtmosphericFog(false);
+	Capture->ShowFlags.SetFog(false);
+	Capture->ShowFlags.SetTranslucency(false);
+	Capture->ShowFlags.SetParticles(false);
+	Capture->ShowFlags.SetAntiAliasing(false);
+}
+
+void UFurSkeletalMeshComponent::DestroyBuiltInShadow()
+{
+	if (BuiltInShadowCaster)
+	{
+		if (InnerShadowCaster == BuiltInShadowCaster)
+		{
+			InnerShadowCaster = nullptr;
+			RefreshFurShadowTickEnabled();
+		}
+		BuiltInShadowCaster->DestroyComponent();
+		BuiltInShadowCaster = nullptr;
+	}
+	if (BuiltInShadowTarget)
+	{
+		// The proxy holds the target as a raw pointer; drop it before the resource goes.
+		if (ShadowParameters.ShadowMap == BuiltInShadowTarget)
+		{
+			SetShadowParameters(FFurShadowParameters());
+			LastPushedShadowTarget = nullptr;
+		}
+		BuiltInShadowTarget->ReleaseResource();
+		BuiltInShadowTarget = nullptr;
+	}
+}
+
+void UFurSkeletalMeshComponent::GetBuiltInShadowPlacement(FTransform& OutTransform, float& OutOrthoWidth) const
+{
+	// Orthographic box around the component bounds, looking along the shadow direction.
+	const FVector Direction = BuiltInShadowRotation.Vector();
+	const float Radius = FMath::Max(Bounds.SphereRadius, 1.0f);
+	OutOrthoWidth = Radius * 2.0f;
+	OutTransform = FTransform(BuiltInShadowRotation, Bounds.Origin - Direction * Radius * 2.0f);
+}
+
+bool UFurSkeletalMeshComponent::HasShadowInputChanged(const FTransform& CasterTransform) const
+{
+	const float RotationThreshold = FMath::DegreesToRadians(ShadowRotationThreshold);
+	auto HasMoved = [this, RotationThreshold](const FTransform& Last, const FTransform& Current)
+	{
+		return FVector::DistSquared(Last.GetLocation(), Current.GetLocation()) > FMath::Square(ShadowLocationThreshold)
+			|| Last.GetRotation().AngularDistance(Current.GetRotation()) > RotationThreshold
+			|| !Last.GetScale3D().Equals(Current.GetScale3D());
+	};
+
+	if (HasMoved(LastCaptureCasterTransform, CasterTransform))
+	{
+		return true;
+	}
+	if (bTransformChangedSinceCapture && HasMoved(LastCaptureComponentTransform, GetComponentTransform()))
+	{
+		return true;
+	}
+	if (!bPoseChangedSinceCapture)
+	{
+		return false;
+	}
+
+	const TArray<FTransform>& Pose = GetPoseSource()->GetComponentSpaceTransforms();
+	if (Pose.Num() != LastCapturePose.Num())
+	{
+		return true;
+	}
+	const float PoseThresholdSquared = FMath::Square(ShadowPoseThreshold);
+	for (int32 BoneIndex = 0; BoneIndex < Pose.Num(); ++BoneIndex)
+	{
+		if (FVector::DistSquared(Pose[BoneIndex].GetLocation(), LastCapturePose[BoneIndex]) > PoseThresholdSquared)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+namespace
+{
+	struct FShadowCaptureBudget
+	{
+		uint64 Frame;
+		int32 Captures;
+	};
+	TMap<TWeakObjectPtr<UWorld>, FShadowCaptureBudget> GShadowCaptureBudgets;
+}
+
+bool UFurSkeletalMeshComponent::AcquireShadowCaptureBudget(UWorld* World)
+{
+	check(IsInGameThread());
+	FShadowCaptureBudget* Budget = GShadowCaptureBudgets.Find(World);
+	if (Budget == nullptr)
+	{
+		// Drop the budgets of worlds that went away before adding one.
+		for (auto It = GShadowCaptureBudgets.CreateIterator(); It; ++It)
+		{
+			if (!It.Key().IsValid())
+			{
+				It.RemoveCurrent();
+			}
+		}
+		Budget = &GShadowCaptureBudgets.Add(World, FShadowCaptureBudget{ 0, 0 });
+	}
+	if (Budget->Frame != GFrameCounter)
+	{
+		Budget->Frame = GFrameCounter;
+		Budget->Captures = 0;
+	}
+
+	const int32 MaxCaptures = CVarFurShadowMaxCapturesPerFrame.GetValueOnGameThread();
+	if (MaxCaptures > 0 && Budget->Captures >= MaxCaptures)
+	{
+		return false;
+	}
+	++Budget->Captures;
+	return true;
+}
+
+void UFurSkeletalMeshComponent::UpdateShadowCapture(float CurrentTime)
+{
+	const bool bBuiltIn = BuiltInShadowCaster && InnerShadowCaster == BuiltInShadowCaster;
+	if (!bBuiltIn && !bChangeDrivenShadowCapture)
+	{
+		// The caster captures on its own; just follow it.
+		UpdateShadowParameters();
+		return;
+	}
+
+	FTransform CasterTransform = InnerShadowCaster->GetComponentTransform();
+	float OrthoWidth = InnerShadowCaster->OrthoWidth;
+	if (bBuiltIn)
+	{
+		GetBuiltInShadowPlacement(CasterTransform, OrthoWidth);
+	}
+
+	if (!bShadowCaptureDirty && !HasShadowInputChanged(CasterTransform))
+	{
+		return;
+	}
+	bShadowCaptureDirty = true;
+
+	const float ShadowUpdateRate = GetShadowUpdateRate();
+	if (ShadowUpdateRate > 0.0f && CurrentTime - LastShadowCaptureTime < 1.0f / ShadowUpdateRate)
+	{
+		return;
+	}
+	if (!AcquireShadowCaptureBudget(GetWorld()))
+	{
+		return;
+	}
+
+	if (bBuiltIn)
+	{
+		InnerShadowCaster->OrthoWidth = OrthoWidth;
+		InnerShadowCaster->SetWorldTransform(CasterTransform);
+	}
+	InnerShadowCaster->CaptureSceneDeferred();
+	FUR_COUNTER_ADD(ShadowCaptures, 1);
+	RecordShadowCapture(CasterTransform, CurrentTime);
+
+	// The projection has to match the map that was just captured, so it only changes with a capture.
+	UpdateShadowParameters();
+}
+
+void UFurSkeletalMeshComponent::RecordShadowCapture(const FTransform& CasterTransform, float CurrentTime)
+{
+	LastCaptureCasterTransform = CasterTransform;
+	LastCaptureComponentTransform = GetComponentTransform();
+	const TArray<FTransform>& Pose = GetPoseSource()->GetComponentSpaceTransforms();
+	LastCapturePose.SetNumUninitialized(Pose.Num());
+	for (int32 BoneIndex = 0; BoneIndex < Pose.Num(); ++BoneIndex)
+	{
+		LastCapturePose[BoneIndex] = Pose[BoneIndex].GetLocation();
+	}
+	LastShadowCaptureTime = CurrentTime;
+	bShadowCaptureDirty = false;
+	bPoseChangedSinceCapture = false;
+	bTransformChangedSinceCapture = false;
+}
+
+void UFurSkeletalMeshComponent::ComputeShadowProjection(const FTransform& CasterTransform, FIntPoint RenderTargetSize, ECameraProjectionMode::Type ProjectionType, float FOVAngle, float OrthoWidth, FLinearColor OutProjCols[4])
+{
+	// BuildProjectionMatrix takes the half angle in radians, like the scene capture renderer.
+	FMatrix mat;
+	BuildProjectionMatrix(RenderTargetSize, ProjectionType, FOVAngle * (float)PI / 360.0f, OrthoWidth, mat);
+	auto worldToLocal = CasterTransform.ToInverseMatrixWithScale();
+
+	// Swizzle from UE's X-forward caster space into the Z-forward view space the projection expects.
+	FMatrix finalMat = worldToLocal * FMatrix(
+		FPlane(0, 0, 1, 0),
+		FPlane(1, 0, 0, 0),
+		FPlane(0, 1, 0, 0),
+		FPlane(0, 0, 0, 1)) * mat;
+	for (int32 col = 0; col < 4; ++col)
+	{
+		OutProjCols[col] = FLinearColor(finalMat.M[0][col], finalMat.M[1][col], finalMat.M[2][col], finalMat.M[3][col]);
+	}
+}
+
+bool UFurSkeletalMeshComponent::ComputeShadowParameters(const USceneCaptureComponent2D* Caster, FFurShadowParameters& OutParameters)
+{
+	OutParameters = FFurShadowParameters();
+	if (Caster == nullptr || Caster->TextureTarget == nullptr)
+	{
+		return false;
+	}
+
+	FIntPoint size;
+	size.X = Caster->TextureTarget->SizeX;
+	size.Y = Caster->TextureTarget->SizeY;
+	ComputeShadowProjection(Caster->GetComponentTransform(), size, Caster->ProjectionType, Caster->FOVAngle, Caster->OrthoWidth, OutParameters.ProjCol);
+	OutParameters.SourcePos = FLinearColor(Caster->GetComponentLocation());
+	OutParameters.SourceDir = FLinearColor(Caster->GetForwardVector());
+	OutParameters.ShadowMap = Caster->TextureTarget;
+	OutParameters.bValid = true;
+	return true;
+}
+
+void UFurSkeletalMeshComponent::UpdateShadowParameters(bool bForce)
+{
+	SCOPE_CYCLE_COUNTER(STAT_FurTickParameters);
+	CSV_SCOPED_TIMING_STAT(Fur, TickParameters);
+	const UTextureRenderTarget2D* Target = InnerShadowCaster ? InnerShadowCaster->TextureTarget : nullptr;
+	if (!bForce && Target && Target == LastPushedShadowTarget.Get())
+	{
+		const FTransform& CasterTransform = InnerShadowCaster->GetComponentTransform();
+		if (CasterTransform.Equals(LastPushedCasterTransform, 0.0f)
+			&& LastPushedShadowTargetSize == FIntPoint(Target->SizeX, Target->SizeY)
+			&& LastPushedProjectionType == InnerShadowCaster->ProjectionType
+			&& LastPushedFOV == InnerShadowCaster->FOVAngle
+			&& LastPushedOrthoWidth == InnerShadowCaster->OrthoWidth)
+		{
+			return;
+		}
+	}
+
+	LastPushedShadowTarget = Target;
+	if (Target)
+	{
+		LastPushedCasterTransform = InnerShadowCaster->GetComponentTransform();
+		LastPushedShadowTargetSize = FIntPoint(Target->SizeX, Target->SizeY);
+		LastPushedProjectionType = InnerShadowCaster->ProjectionType;
+		LastPushedFOV = InnerShadowCaster->FOVAngle;
+		LastPushedOrthoWidth = InnerShadowCaster->OrthoWidth;
+	}
+
+	FFurShadowParameters Parameters;
+	ComputeShadowParameters(InnerShadowCaster, Parameters);
+	SetShadowParameters(Parameters);
+}
+
+void UFurSkeletalMeshComponent::SetShadowParameters(const FFurShadowParameters& Parameters)
+{
+	ShadowParameters = Parameters;
+	FurSkeletalMeshSceneProxy* FurProxy = static_cast<FurSkeletalMeshSceneProxy*>(SceneProxy);
+	if (FurProxy)
+	{
+		ENQUEUE_RENDER_COMMAND(FurUpdateShadowParameters)(
+			[FurProxy, Parameters](FRHICommandListImmediate& RHICmdList)
+			{
+				FurProxy->SetShadowParameters_RenderThread(Parameters);
+			});
 	}
 }
 
@@ -107,8 +1157,20 @@ void UFurSkeletalMeshComponent::BuildProjectionMatrix(FIntPoint RenderTargetSize
 	}
 }
 
+void UFurSkeletalMeshComponent::GetSectionShellLimits(int32 LODIndex, const TArray<int32>& SectionMaterialIndices, TArray<int32>& OutShellLimits) const
+{
+	TArray<FName> SectionSlotNames;
+	SectionSlotNames.Reserve(SectionMaterialIndices.Num());
+	for (int32 MaterialIndex : SectionMaterialIndices)
+	{
+		SectionSlotNames.Add(SkeletalMesh && SkeletalMesh->Materials.IsValidIndex(MaterialIndex) ? SkeletalMesh->Materials[MaterialIndex].MaterialSlotName : NAME_None);
+	}
+	FFurShellHelpers::GetSectionShellLimits(LODIndex, SectionSlotNames, bFurOnUnlistedSections, FurMaterialSlots, FurSections, OutShellLimits);
+}
+
 FPrimitiveSceneProxy * UFurSkeletalMeshComponent::CreateSceneProxy()
 {
+	FUR_SCOPE_TIMING(CreateSceneProxy);
 	ERHIFeatureLevel::Type SceneFeatureLevel = GetWorld()->FeatureLevel;
 	FSkeletalMeshSceneProxy* Result = nullptr;
 	FSkeletalMeshRenderData* SkelMeshRenderData = GetSkeletalMeshRenderData();
@@ -135,53 +1197,126 @@ FPrimitiveSceneProxy * UFurSkeletalMeshComponent::CreateSceneProxy()
 	return Result;
 }
 
+float UFurSkeletalMeshComponent::GetFurScreenSize(float RecentlyRenderedTime) const
+{
+	UWorld* World = GetWorld();
+	if (World == nullptr || !WasRecentlyRendered(RecentlyRenderedTime))
+	{
+		return 0.0f;
+	}
+	float ScreenSize = 0.0f;
+	for (const FVector& ViewLocation : World->ViewLocationsRenderedLastFrame)
+	{
+		const float Distance = FMath::Max(FVector::Dist(ViewLocation, Bounds.Origin), 1.0f);
+		ScreenSize = FMath::Max(ScreenSize, FMath::Min(Bounds.SphereRadius / Distance, 1.0f));
+	}
+	return ScreenSize;
+}
+
+void UFurSkeletalMeshComponent::GetShellPassDemand(int32& OutMaxShells, int32& OutNumFurSections) const
+{
+	OutMaxShells = 0;
+	OutNumFurSections = 0;
+	for (UMaterialInterface* Material : GetShellMaterials())
+	{
+		OutMaxShells += Material ? 1 : 0;
+	}
+	// Shells significance takes away are not asked of the budget.
+	const int32 SignificanceShellCount = GetSignificanceShellCount();
+	if (SignificanceShellCount >= 0)
+	{
+		OutMaxShells = FMath::Min(OutMaxShells, SignificanceShellCount);
+	}
+
+	FSkeletalMeshRenderData* RenderData = SkeletalMesh ? SkeletalMesh->GetResourceForRendering() : nullptr;
+	if (RenderData == nullptr || RenderData->LODRenderData.Num() == 0)
+	{
+		return;
+	}
+	TArray<int32> SectionMaterialIndices;
+	for (const FSkelMeshRenderSection& Section : RenderData->LODRenderData[0].RenderSections)
+	{
+		SectionMaterialIndices.Add(Section.MaterialIndex);
+	}
+	TArray<int32> ShellLimits;
+	GetSectionShellLimits(0, SectionMaterialIndices, ShellLimits);
+	for (int32 ShellLimit : ShellLimits)
+	{
+		OutNumFurSections += ShellLimit != 0 ? 1 : 0;
+	}
+}
+
+float UFurSkeletalMeshComponent::GetFurBoundsExtension() const
+{
+	float Extension = MaxFurLength;
+	if (bFurFins && FinMaterial)
+	{
+		Extension = FMath::Max(Extension, FinLength);
+	}
+	if (bFurDynamics)
+	{
+		Extension += FurMaxDisplacement;
+	}
+	return Extension;
+}
+
+FBoxSphereBounds UFurSkeletalMeshComponent::CalcBounds(const FTransform& LocalToWorld) const
+{
+	FBoxSphereBounds Bounds = Super::CalcBounds(LocalToWorld);
+	const float Extension = GetFurBoundsExtension();
+	Bounds.BoxExtent += FVector(Extension);
+	Bounds.SphereRadius += Extension;
+	return Bounds;
+}
+
 void UFurSkeletalMeshComponent::GetUsedMaterials(TArray<UMaterialInterface*>& OutMaterials, bool bGetDebugMaterials) const
 {
 	Super::Super::GetUsedMaterials(OutMaterials, bGetDebugMaterials);
-	OutMaterials.Append(MultiPassMaterial);
+	OutMaterials.Append(GetShellMaterials());
+	if (UMaterialInterface* Instanced = GetInstancedShellMaterial())
+	{
+		OutMaterials.Add(Instanced);
+	}
+	if (FinMaterial)
+	{
+		OutMaterials.Add(FinMaterial);
+	}
 }
 
 void UFurSkeletalMeshComponent::TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction * ThisTickFunction)
 {
+	FUR_SCOPE_TIMING(TickComponent);
 	Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
+	if (MasterPoseComponent.IsValid())
+	{
+		// Bones are finalized on the master, so this component is never told its pose changed.
+		bPoseChangedSinceCapture = true;
+	}
+	UpdateOwnerAnimTickOption();
+}
+
+void UFurSkeletalMeshComponent::UpdateOwnerAnimTickOption()
+{
+	USkeletalMeshComponent* Owner = OwnerPoseComponent.Get();
+	if (!bDrawsOwnerSkin || Owner == nullptr)
+	{
+		return;
+	}
+	// Out of the main pass the owner may not count as rendered and stop refreshing its bones, which this component
+	// draws with. Keep them refreshed while this component is seen; otherwise the owner goes back to its own option.
+	const EVisibilityBasedAnimTickOption TickOption = WasRecentlyRendered()
+		? EVisibilityBasedAnimTickOption::AlwaysTickPoseAndRefreshBones : OwnerAnimTickOption;
+	if (Owner->VisibilityBasedAnimTickOption != TickOption)
+	{
+		Owner->VisibilityBasedAnimTickOption = TickOption;
+	}
+}
+
+void UFurSkeletalMeshComponent::TickFurShadow(float DeltaTime)
+{
+	FUR_SCOPE_TIMING(ShadowTick);
 	if (InnerShadowCaster)
 	{
-		
-		for (int i = 0; i < MultiPassMaterial.Num(); ++i)
-		{
-			if (MultiPassMaterial[i] != nullptr)
-			{
-				UMaterialInstanceDynamic* dynamicMat = Cast<UMaterialInstanceDynamic>(MultiPassMaterial[i]);
-				if (dynamicMat)
-				{
-					FMatrix mat;
-					FIntPoint size;
-					size.X = InnerShadowCaster->TextureTarget->SizeX;
-					size.Y = InnerShadowCaster->TextureTarget->SizeY;
-					BuildProjectionMatrix(size, InnerShadowCaster->ProjectionType, InnerShadowCaster->FOVAngle, InnerShadowCaster->OrthoWidth, mat);
-					auto worldToLocal = InnerShadowCaster->GetComponentTransform().ToInverseMatrixWithScale();
-					InnerShadowCaster->GetForwardVector();
-
-					FMatrix finalMat =  worldToLocal * FMatrix(
-						FPlane(0, 0, 1, 0),
-						FPlane(1, 0, 0, 0),
-						FPlane(0, 1, 0, 0),
-						FPlane(0, 0, 0, 1)) * mat;
-					finalMat.GetColumn(1);
-					FVector4 col0(finalMat.M[0][0], finalMat.M[1][0], finalMat.M[2][0], finalMat.M[3][0]);
-					FVector4 col1(finalMat.M[0][1], finalMat.M[1][1], finalMat.M[2][1], finalMat.M[3][1]);
-					FVector4 col2(finalMat.M[0][2], finalMat.M[1][2], finalMat.M[2][2], finalMat.M[3][2]);
-					FVector4 col3(finalMat.M[0][3], finalMat.M[1][3], finalMat.M[2][3], finalMat.M[3][3]);
-					//dynamicMat->SetTextureParameterValue("DirectShadowMap", InnerShadowCaster->TextureTarget);
-					//FLinearColor a;
-					dynamicMat->SetVectorParameterValue("ProjCol0", FLinearColor(col0.X, col0.Y, col0.Z, col0.W));
-					dynamicMat->SetVectorParameterValue("ProjCol1", FLinearColor(col1.X, col1.Y, col1.Z, col1.W));
-					dynamicMat->SetVectorParameterValue("ProjCol2", FLinearColor(col2.X, col2.Y, col2.Z, col2.W));
-					dynamicMat->SetVectorParameterValue("ProjCol3", FLinearColor(col3.X, col3.Y, col3.Z, col3.W));
-					dynamicMat->SetVectorParameterValue("SourcePos", InnerShadowCaster->GetComponentLocation());
-					dynamicMat->SetVectorParameterValue("SourceDir", InnerShadowCaster->GetForwardVector());
-				}
-			}
-		}
+		UpdateShadowCapture(GetWorld()->GetTimeSeconds());
 	}
 }
@@ -5,8 +5,155 @@
 #include "CoreMinimal.h"
 #include "Components/SkeletalMeshComponent.h"
 #include "Camera/CameraTypes.h"
+#include "FurShellMaterialRenderProxy.h"
+#include "FurBake.h"
 #include "FurSkeletalMeshComponent.generated.h"
 
+/** One entry of the shell-count LOD table. */
+USTRUCT(BlueprintType)
+struct FFurShellLOD
+{
+	GENERATED_BODY()
+
+	/** Entry is used once the component's screen size drops below this value. Ignored for the first entry. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Fur LOD", meta = (ClampMin = "0.0"))
+	float ScreenSize;
+
+	/** Number of shells drawn at this LOD. 0 draws no fur at all. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Fur LOD", meta = (ClampMin = "0"))
+	int32 ShellCount;
+
+	FFurShellLOD()
+		: ScreenSize(0.0f)
+		, ShellCount(0)
+	{
+	}
+};
+
+/** Fur override for every section that uses a material slot. */
+USTRUCT(BlueprintType)
+struct FFurMaterialSlotSettings
+{
+	GENERATED_BODY()
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Fur Sections")
+	FName MaterialSlotName;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Fur Sections")
+	bool bHasFur;
+
+	/** Most shells drawn on these sections. Negative uses the component's shell count. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Fur Sections")
+	int32 ShellCount;
+
+	FFurMaterialSlotSettings()
+		: bHasFur(true)
+		, ShellCount(-1)
+	{
+	}
+};
+
+/** Fur override for one render section, takes precedence over the material slot settings. */
+USTRUCT(BlueprintType)
+struct FFurSectionSettings
+{
+	GENERATED_BODY()
+
+	/** Skeletal mesh LOD the section belongs to. Negative applies to that section index in every LOD. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Fur Sections")
+	int32 LODIndex;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Fur Sections", meta = (ClampMin = "0"))
+	int32 SectionIndex;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Fur Sections")
+	bool bHasFur;
+
+	/** Most shells drawn on this section. Negative uses the component's shell count. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Fur Sections")
+	int32 ShellCount;
+
+	FFurSectionSettings()
+		: LODIndex(-1)
+		, SectionIndex(0)
+		, bHasFur(true)
+		, ShellCount(-1)
+	{
+	}
+};
+
+/** Fur settings for components of at least some significance. Zero or negative limits keep the component's own value. */
+USTRUCT(BlueprintType)
+struct FFurSignificanceLevel
+{
+	GENERATED_BODY()
+
+	/** Row is used once the component's significance reaches this value: its screen size from the closest player view. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Fur Significance", meta = (ClampMin = "0.0"))
+	float MinSignificance;
+
+	/** Most shells drawn, on top of the shell LOD and budget. Negative for no limit, 0 draws no fur. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Fur Significance")
+	int32 MaxShells;
+
+	/** Seconds between fur shadow parameter updates. 0 updates every frame. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Fur Significance", meta = (ClampMin = "0.0"))
+	float ParameterTickInterval;
+
+	/** Most shadow captures per second. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Fur Significance", meta = (ClampMin = "0.0"))
+	float MaxShadowUpdateRate;
+
+	/** Largest built-in shadow map or shadow atlas tile, in texels. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Fur Significance", meta = (ClampMin = "0"))
+	int32 MaxShadowResolution;
+
+	/** Whether fins are drawn, if the component has them. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Fur Significance")
+	bool bFins;
+
+	/** Whether the fur dynamics run, if the component has them. Turned off, the fur rests on the skin. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Fur Significance")
+	bool bDynamics;
+
+	FFurSignificanceLevel()
+		: MinSignificance(0.0f)
+		, MaxShells(-1)
+		, ParameterTickInterval(0.0f)
+		, MaxShadowUpdateRate(0.0f)
+		, MaxShadowResolution(0)
+		, bFins(true)
+		, bDynamics(true)
+	{
+	}
+};
+
+/** Tick for the fur shadow work, separate from the skeletal mesh tick so it can be off while there is no caster. */
+USTRUCT()
+struct FFurShadowTickFunction : public FTickFunction
+{
+	GENERATED_USTRUCT_BODY()
+
+	class UFurSkeletalMeshComponent* Target;
+
+	FFurShadowTickFunction()
+		: Target(nullptr)
+	{
+	}
+
+	virtual void ExecuteTick(float DeltaTime, ELevelTick TickType, ENamedThreads::Type CurrentThread, const FGraphEventRef& MyCompletionGraphEvent) override;
+	virtual FString DiagnosticMessage() override;
+};
+
+template<>
+struct TStructOpsTypeTraits<FFurShadowTickFunction> : public TStructOpsTypeTraitsBase2<FFurShadowTickFunction>
+{
+	enum
+	{
+		WithCopy = false
+	};
+};
+
 /**
  * 
  */
@@ -18,6 +165,137 @@ private:
 	UPROPERTY()
 	class USceneCaptureComponent2D* InnerShadowCaster;
 
+	/** Shadow lookup values for this frame, shared by every shell material through the scene proxy. */
+	FFurShadowParameters ShadowParameters;
+
+	/** Caster state ShadowParameters was last computed from. */
+	TWeakObjectPtr<const class UTextureRenderTarget2D> LastPushedShadowTarget;
+	FTransform LastPushedCasterTransform;
+	FIntPoint LastPushedShadowTargetSize;
+	float LastPushedFOV;
+	float LastPushedOrthoWidth;
+	TEnumAsByte<ECameraProjectionMode::Type> LastPushedProjectionType;
+
+	/**
+	 * Recomputes ShadowParameters from the caster and sends them to the scene proxy.
+	 * Does nothing if the caster state is the one last pushed, unless bForce is set.
+	 */
+	void UpdateShadowParameters(bool bForce = false);
+
+	/** Depth-only capture of this component, owned by it when bBuiltInShadow is set. */
+	UPROPERTY(Transient)
+	class USceneCaptureComponent2D* BuiltInShadowCaster;
+
+	UPROPERTY(Transient)
+	class UTextureRenderTarget2D* BuiltInShadowTarget;
+
+	void CreateBuiltInShadow();
+	void DestroyBuiltInShadow();
+	/** Where the built-in capture has to be to fit the component bounds. */
+	void GetBuiltInShadowPlacement(FTransform& OutTransform, float& OutOrthoWidth) const;
+
+	/** State of the last shadow capture, compared against to decide if a new one is needed. */
+	FTransform LastCaptureCasterTransform;
+	FTransform LastCaptureComponentTransform;
+	TArray<FVector> LastCapturePose;
+	float LastShadowCaptureTime;
+	bool bShadowCaptureDirty;
+	/** Set when bones or the component transform were updated after the last capture. */
+	bool bPoseChangedSinceCapture;
+	bool bTransformChangedSinceCapture;
+
+	/** Whether FFurShadowAtlas drives this component's fur shadow. */
+	bool bInShadowAtlas;
+	friend class FFurShadowAtlas;
+	/** Remembers the caster, component and pose a shadow was just captured with. */
+	void RecordShadowCapture(const FTransform& CasterTransform, float CurrentTime);
+	/** Stores the shadow parameters and sends them to the scene proxy. */
+	void SetShadowParameters(const FFurShadowParameters& Parameters);
+
+	/** Shell cap from the world's fur budget, negative for none. Written by FFurShellBudget. */
+	int32 BudgetShellCount;
+	friend class FFurShellBudget;
+
+	/** Row of SignificanceLevels this component is in, INDEX_NONE while it uses its own settings. Written by FFurSignificance. */
+	int32 SignificanceLevel;
+	friend class FFurSignificance;
+	/** Moves to another row of SignificanceLevels, or back to the own settings, updating only what the change affects. */
+	void SetSignificanceLevel(int32 NewLevel);
+
+	/** Guide point offsets from the last dynamics step, written by FFurDynamicsSolver. */
+	FFurDynamicsParameters DynamicsParameters;
+	friend class FFurDynamicsSolver;
+
+	FFurShadowTickFunction FurShadowTickFunction;
+	friend struct FFurShadowTickFunction;
+
+	/** Owner mesh followed while bUseOwnerPose is set. */
+	TWeakObjectPtr<USkeletalMeshComponent> OwnerPoseComponent;
+	/** Set while the owner's skin is out of its main pass because this component draws it. */
+	bool bDrawsOwnerSkin;
+	/** Owner's anim tick option and main pass setting, restored when it draws its skin again. */
+	EVisibilityBasedAnimTickOption OwnerAnimTickOption;
+	bool bOwnerRenderInMainPass;
+	/** Attachment from before ApplyOwnerPose snapped this component to the owner, put back when bUseOwnerPose is turned off. */
+	TWeakObjectPtr<USceneComponent> SavedAttachParent;
+	FName SavedAttachSocketName;
+	FTransform SavedRelativeTransform;
+	bool bHasSavedAttachment;
+
+	/** The attach parent if it is a skeletal mesh, otherwise the owner's character mesh or first other skeletal mesh. */
+	USkeletalMeshComponent* FindOwnerPoseComponent() const;
+	/** Slaves this component to the owner mesh and takes over drawing its skin if both use the same mesh. */
+	void ApplyOwnerPose();
+	/**
+	 * Gives the skin back to the owner and looks the dynamics guide bones up on this component again.
+	 * With bRestoreAttachment, also puts the component back where it was attached before ApplyOwnerPose.
+	 */
+	void ReleaseOwnerPose(bool bRestoreAttachment = false);
+	/** Makes the owner refresh its bones while this component draws its skin and is rendered. */
+	void UpdateOwnerAnimTickOption();
+
+	/** Enables the fur shadow tick only while there is a caster to drive. */
+	void RefreshFurShadowTickEnabled();
+
+	/** Shell materials of FurLayers, kept apart from MultiPassMaterial so they are never saved with the component. */
+	UPROPERTY(Transient)
+	TArray<UMaterialInterface*> FurLayerShellMaterials;
+
+	/** Instanced shell material of FurLayers, pulled only while bInstancedShells is set. */
+	UPROPERTY(Transient)
+	UMaterialInterface* FurLayerInstancedShellMaterial;
+
+	/** Pulls the shell materials from FurLayers into FurLayerShellMaterials and FurLayerInstancedShellMaterial. */
+	void ApplyFurLayers();
+	/**
+	 * Sends the shell materials and counts to the existing scene proxy. Recreates the proxy instead
+	 * if the new materials need render passes the old ones didn't.
+	 */
+	void UpdateShellMaterials();
+
+	/** Bake and furry sections per LOD the vertex colours were last overridden with, so they are only set again when either changes. */
+	TSharedPtr<const FFurBakedMesh> AppliedFurBake;
+	TArray<TBitArray<>> AppliedFurBakeSections;
+	/** LODs whose vertex colours the bake overrides. */
+	TBitArray<> FurBakeOverrideLODs;
+	/** Bake of the mesh and FurBakeSettings, saved only into cooked packages. */
+	UPROPERTY()
+	FFurCookedBake CookedFurBake;
+	/** Bakes the current mesh if bBakeFur is set and swaps the vertex colours of its furry sections for the baked stream. */
+	void ApplyFurBake();
+	/** Drops the vertex colour overrides of the applied bake. */
+	void ClearFurBake();
+	/** Per LOD, the render sections of the current mesh that get fur. */
+	void GetFurrySections(TArray<TBitArray<>>& OutFurrySections) const;
+	void TickFurShadow(float DeltaTime);
+
+	/** Whether caster, component or pose moved past the thresholds since the last capture. */
+	bool HasShadowInputChanged(const FTransform& CasterTransform) const;
+	/** Captures the shadow if its inputs changed and rate and frame budget allow it, then refreshes the shadow parameters. */
+	void UpdateShadowCapture(float CurrentTime);
+	/** Takes one capture from the per-frame budget shared by all fur components of World. */
+	static bool AcquireShadowCaptureBudget(UWorld* World);
+
 public:
 	UFUNCTION(BlueprintCallable, BlueprintPure, Category = "FurSkeletal")
 	class USceneCaptureComponent2D* ShadowCaster() const;
@@ -27,9 +305,321 @@ public:
 	UFUNCTION(BlueprintCallable, Category = "FurSkeletal|Help")
 	static void BuildProjectionMatrix(FIntPoint RenderTargetSize, ECameraProjectionMode::Type ProjectionType, float FOV, float InOrthoWidth, FMatrix& ProjectionMatrix);
 
+	/**
+	 * World to shadow clip space for a caster, as the four matrix columns the shell materials read as ProjCol0..3.
+	 * FOVAngle is the caster's full horizontal angle in degrees.
+	 */
+	static void ComputeShadowProjection(const FTransform& CasterTransform, FIntPoint RenderTargetSize, ECameraProjectionMode::Type ProjectionType, float FOVAngle, float OrthoWidth, FLinearColor OutProjCols[4]);
+
+	/** Sets up a scene capture to render the depth of its show only components, as the fur shadow captures do. */
+	static void ConfigureShadowDepthCapture(class USceneCaptureComponent2D* Capture);
+
+	/** Builds the shell shadow lookup values for a caster. Returns false if the caster has no render target. */
+	static bool ComputeShadowParameters(const class USceneCaptureComponent2D* Caster, FFurShadowParameters& OutParameters);
+
+	const FFurShadowParameters& GetShadowParameters() const { return ShadowParameters; }
+	const FFurDynamicsParameters& GetDynamicsParameters() const { return DynamicsParameters; }
+	/** Whether this component draws the owner's skin, whose shadow the owner keeps casting. */
+	bool DrawsOwnerSkin() const { return bDrawsOwnerSkin; }
+
+	UFurSkeletalMeshComponent(const FObjectInitializer& ObjectInitializer);
+
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Multy Pass Component")
 	TArray<UMaterialInterface*> MultiPassMaterial;
+
+	/**
+	 * Shell stack description. When set, its shared shell materials are drawn instead of MultiPassMaterial,
+	 * which is left as authored.
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Multy Pass Component")
+	class UFurLayerAsset* FurLayers;
+
+	UFUNCTION(BlueprintCallable, Category = "FurSkeletal")
+	void SetFurLayers(class UFurLayerAsset* NewFurLayers);
+
+	/** Shell materials drawn, innermost first: those of FurLayers if set, otherwise MultiPassMaterial. May hold nulls. */
+	const TArray<UMaterialInterface*>& GetShellMaterials() const { return FurLayers ? FurLayerShellMaterials : MultiPassMaterial; }
+
+	/**
+	 * Replaces MultiPassMaterial, innermost shell first. Updates the scene proxy in place.
+	 * Like the other MultiPassMaterial edits below, it only shows while FurLayers is not set.
+	 */
+	UFUNCTION(BlueprintCallable, Category = "FurSkeletal")
+	void SetShellMaterials(const TArray<UMaterialInterface*>& NewMaterials);
+
+	/** Inserts a shell at Index, or on the outside if Index is out of range. */
+	UFUNCTION(BlueprintCallable, Category = "FurSkeletal")
+	void AddShellMaterial(UMaterialInterface* Material, int32 Index = -1);
+
+	UFUNCTION(BlueprintCallable, Category = "FurSkeletal")
+	void RemoveShellMaterial(int32 Index);
+
+	UFUNCTION(BlueprintCallable, Category = "FurSkeletal")
+	void MoveShellMaterial(int32 FromIndex, int32 ToIndex);
+
+	/**
+	 * Draw the shells of each furry section as one instanced mesh batch, one instance per shell, instead of one
+	 * batch per shell. The instance count and shell LOD are those of the shell materials, which still draw the
+	 * sections the instanced path can't: sections in the GPU skin cache, CPU skinned meshes, sections with more than
+	 * four bone influences or cloth, and feature levels below SM5.
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Multy Pass Component")
+	bool bInstancedShells;
+
+	/**
+	 * Shell material drawn by the instanced batches, when FurLayers is not set. It takes its layer, 0 at the skin,
+	 * from Particle Relative Time rather than from a per shell Offset parameter. Needs Used with Skeletal Mesh and
+	 * Used with Instanced Static Meshes, which compiles it for the fur shell vertex factory.
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Multy Pass Component", meta = (EditCondition = "bInstancedShells"))
+	UMaterialInterface* InstancedShellMaterial;
+
+	/** Turns instanced shells on or off and sets their material. Material is ignored while FurLayers is set. */
+	UFUNCTION(BlueprintCallable, Category = "FurSkeletal")
+	void SetInstancedShells(bool bEnable, UMaterialInterface* Material);
+
+	/** Material of the instanced shell batches, null when they are off: that of FurLayers if set, otherwise InstancedShellMaterial. */
+	UMaterialInterface* GetInstancedShellMaterial() const
+	{
+		return bInstancedShells ? (FurLayers ? FurLayerInstancedShellMaterial : InstancedShellMaterial) : nullptr;
+	}
+
+	/** Relevance of every material the fur draws on top of the skin, for the given feature level. */
+	FMaterialRelevance GetShellMaterialRelevance(ERHIFeatureLevel::Type FeatureLevel) const;
+
+	/**
+	 * Shell count by screen size, ordered from closest to farthest. Picked per view, like skeletal mesh LODs.
+	 * Empty draws every shell at any distance.
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Fur LOD")
+	TArray<FFurShellLOD> ShellLODs;
+
+	/** Screen size margin an entry has to be crossed by before switching back to more shells. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Fur LOD", meta = (ClampMin = "0.0"))
+	float ShellLODHysteresis;
+
+	/** Upper bound on the shell count per skeletal mesh LOD index. Missing or negative entries don't limit. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Fur LOD")
+	TArray<int32> MaxShellsPerMeshLOD;
+
+	/** Weight of this component in the world's fur shell budget, on top of its screen size. 0 only gets fur.Budget.MinShells. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Fur LOD", meta = (ClampMin = "0.0"))
+	float FurBudgetImportance;
+
+	int32 GetBudgetShellCount() const { return BudgetShellCount; }
+
+	/** Bounds radius over distance to the closest view rendered last frame, or 0 if not rendered within RecentlyRenderedTime. */
+	float GetFurScreenSize(float RecentlyRenderedTime = 0.2f) const;
+
+	/** Most shells drawn per section and number of furry sections, at the first mesh LOD. */
+	void GetShellPassDemand(int32& OutMaxShells, int32& OutNumFurSections) const;
+
+	/** Farthest the outermost shell reaches out of the skin, in cm. Grows the bounds so shells are not culled early. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Fur Sections", meta = (ClampMin = "0.0"))
+	float MaxFurLength;
+
+	/**
+	 * Skip the shells of sections outside a view, using bounds skinned from per-bone boxes. Needs Allow CPU Access
+	 * on the mesh LODs; LODs without it draw every section.
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Fur Sections")
+	bool bFurSectionCulling;
+
+	/** How far fur, fins and dynamics offsets can reach out of the skin. */
+	float GetFurBoundsExtension() const;
+
+	/** Whether sections not matched by FurMaterialSlots or FurSections get shells. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Fur Sections")
+	bool bFurOnUnlistedSections;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Fur Sections")
+	TArray<FFurMaterialSlotSettings> FurMaterialSlots;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Fur Sections")
+	TArray<FFurSectionSettings> FurSections;
+
+	/** Resolves the section settings for one LOD: 0 = no fur, negative = all shells, otherwise the shell limit. */
+	void GetSectionShellLimits(int32 LODIndex, const TArray<int32>& SectionMaterialIndices, TArray<int32>& OutShellLimits) const;
+
+	/**
+	 * Draw fins, quads standing up from the surface, on the silhouette edges of the furry sections.
+	 * Fills in the silhouette at grazing angles, where shells look thin. Fins are skinned on the CPU whenever the pose
+	 * changes; SignificanceLevels can turn them off for less significant fur.
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Fur Fins")
+	bool bFurFins;
+
+	/** Material drawn on fins. UV V runs from 1 at the root to 0 at the tip, vertex alpha fades fins near the threshold. */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Fur Fins", meta = (EditCondition = "bFurFins"))
+	UMaterialInterface* FinMaterial;
+
+	/** Fin height in cm, usually the fur length. */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Fur Fins", meta = (EditCondition = "bFurFins", ClampMin = "0.0"))
+	float FinLength;
+
+	/** Edges whose faces are this close to edge-on also get a fin, faded. 0 only draws exact silhouette edges. */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Fur Fins", meta = (EditCondition = "bFurFins", ClampMin = "0.0", ClampMax = "1.0"))
+	float FinSilhouetteThreshold;
+
+	/**
+	 * Let the fur lag behind the skin under acceleration, gravity and wind. Each guide point is a damped spring
+	 * pulled towards its bone; its offset reaches the shell materials as FurDisplacement0..3.
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Fur Dynamics")
+	bool bFurDynamics;
+
+	/** Bones the guide points follow, at most four. Empty uses one guide at the component origin. Read on register. */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Fur Dynamics", meta = (EditCondition = "bFurDynamics"))
+	TArray<FName> FurDynamicsGuideBones;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Fur Dynamics", meta = (EditCondition = "bFurDynamics", ClampMin = "0.0", ClampMax = "2000.0"))
+	float FurStiffness;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Fur Dynamics", meta = (EditCondition = "bFurDynamics", ClampMin = "0.0"))
+	float FurDamping;
+
+	/** Fraction of world gravity pulling on the fur. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Fur Dynamics", meta = (EditCondition = "bFurDynamics"))
+	float FurGravityScale;
+
+	/** Wind acceleration in cm/s^2, world space. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Fur Dynamics", meta = (EditCondition = "bFurDynamics"))
+	FVector FurWind;
+
+	/** Longest offset in cm the fur can lag behind. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Fur Dynamics", meta = (EditCondition = "bFurDynamics", ClampMin = "0.0"))
+	float FurMaxDisplacement;
+
+	/**
+	 * Render a depth map of this component only and feed it to the shell materials,
+	 * instead of using a scene capture set through SetShadowCaster.
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Fur Shadow")
+	bool bBuiltInShadow;
+
+	UFUNCTION(BlueprintCallable, Category = "FurSkeletal")
+	void SetBuiltInShadow(bool bEnable);
+
+	/**
+	 * Keep the fur shadow in a tile of the world's shared fur shadow atlas texture instead of a render target of its own.
+	 * The shadow is still captured per component, so this saves render target memory, not captures.
+	 * Takes precedence over bBuiltInShadow. Uses BuiltInShadowRotation and the shadow update settings below.
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Fur Shadow")
+	bool bShadowAtlas;
+
+	UFUNCTION(BlueprintCallable, Category = "FurSkeletal")
+	void SetShadowAtlas(bool bEnable);
+
+	/** Direction the built-in fur shadow is cast along. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Fur Shadow", meta = (EditCondition = "bBuiltInShadow"))
+	FRotator BuiltInShadowRotation;
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Fur Shadow", meta = (EditCondition = "bBuiltInShadow", ClampMin = "32", ClampMax = "4096"))
+	int32 BuiltInShadowResolution;
+
+	/**
+	 * Only recapture the fur shadow when the caster, the component or the pose changed.
+	 * Always on for the built-in shadow and the shadow atlas. For a caster set through SetShadowCaster it takes over
+	 * its capturing, turning off the caster's own bCaptureEveryFrame and bCaptureOnMovement; off, the caster is left alone.
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Fur Shadow")
+	bool bChangeDrivenShadowCapture;
+
+	/** Distance in cm the caster or the component has to move before the shadow is recaptured. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Fur Shadow", meta = (ClampMin = "0.0"))
+	float ShadowLocationThreshold;
+
+	/** Angle in degrees the caster or the component has to turn before the shadow is recaptured. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Fur Shadow", meta = (ClampMin = "0.0"))
+	float ShadowRotationThreshold;
+
+	/** Distance in cm any bone has to move, in component space, before the shadow is recaptured. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Fur Shadow", meta = (ClampMin = "0.0"))
+	float ShadowPoseThreshold;
+
+	/** Most shadow captures per second for this component. 0 for no limit. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Fur Shadow", meta = (ClampMin = "0.0"))
+	float MaxShadowUpdateRate;
+
+	/**
+	 * Let the world's significance manager pick a row of SignificanceLevels for this component from how large it
+	 * is in the players' views, lowering its fur cost when it matters less. Applied on begin play. Off by default,
+	 * since the shipped rows thin out distant fur and turn off its fins and dynamics.
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Fur Significance")
+	bool bFurSignificance;
+
+	UFUNCTION(BlueprintCallable, Category = "FurSkeletal")
+	void SetFurSignificance(bool bEnable);
+
+	/**
+	 * Settings by significance, ordered from most to least significant. The last row also takes everything below it.
+	 * Defaults come from [/Script/FurTest.FurSkeletalMeshComponent] in DefaultEngine.ini.
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, config, Category = "Fur Significance", meta = (EditCondition = "bFurSignificance"))
+	TArray<FFurSignificanceLevel> SignificanceLevels;
+
+	/** Row of SignificanceLevels in use, null while the component uses its own settings. */
+	const FFurSignificanceLevel* GetSignificanceLevel() const;
+
+	/** Shell cap from significance, negative for none. */
+	int32 GetSignificanceShellCount() const;
+	/** MaxShadowUpdateRate, lowered by significance. 0 for no limit. */
+	float GetShadowUpdateRate() const;
+	/** BuiltInShadowResolution, lowered by significance. */
+	int32 GetShadowResolution() const;
+	bool ShouldDrawFins() const;
+	bool ShouldRunDynamics() const;
+
+	/**
+	 * Bake fur direction, length and density per vertex from FurBakeSettings and render them as the mesh's
+	 * vertex colours: R/G octahedral tangent space direction, B length, A density. Only the furry sections take the
+	 * baked colours; the skin and other sections keep their own. LODs that can't be baked are reported by map check.
+	 * The bake is saved with cooked packages.
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Fur Bake")
+	bool bBakeFur;
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Fur Bake", meta = (EditCondition = "bBakeFur"))
+	FFurBakeSettings FurBakeSettings;
+
+	UFUNCTION(BlueprintCallable, Category = "FurSkeletal")
+	void SetFurBake(bool bEnable, const FFurBakeSettings& Settings);
+
+	/**
+	 * Take the bone transforms of the owner's skeletal mesh as a master pose instead of animating this component.
+	 * If both use the same mesh, the skin is drawn here instead of in the owner's main pass, so the main pass skins it once.
+	 * The owner keeps its pose and casts the skin's shadow as before; this component then casts no shadow from the skin
+	 * sections, only from its fur. Applied on begin play; turning it off puts the component back where it was attached.
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Fur Pose")
+	bool bUseOwnerPose;
+
+	UFUNCTION(BlueprintCallable, Category = "FurSkeletal")
+	void SetUseOwnerPose(bool bEnable);
+
+	/** Mesh the pose is taken from while bUseOwnerPose is set, null if none was found. */
+	USkeletalMeshComponent* GetOwnerPoseComponent() const { return OwnerPoseComponent.Get(); }
+
+	/** Component whose bone transforms this one is drawn with: its master pose component, or itself. */
+	const USkinnedMeshComponent* GetPoseSource() const;
+
 	virtual FPrimitiveSceneProxy* CreateSceneProxy() override;
+	virtual FBoxSphereBounds CalcBounds(const FTransform& LocalToWorld) const override;
 	virtual void GetUsedMaterials(TArray<UMaterialInterface*>& OutMaterials, bool bGetDebugMaterials = false) const override;
 	virtual void TickComponent(float DeltaTime, enum ELevelTick TickType, FActorComponentTickFunction *ThisTickFunction) override;
+	virtual void FinalizeBoneTransform() override;
+	virtual void SetSkeletalMesh(class USkeletalMesh* NewMesh, bool bReinitPose = true) override;
+#if WITH_EDITOR
+	virtual void PreSave(const class ITargetPlatform* TargetPlatform) override;
+	virtual void CheckForErrors() override;
+#endif
+protected:
+	virtual void OnRegister() override;
+	virtual void OnUnregister() override;
+	virtual void BeginPlay() override;
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+	virtual void RegisterComponentTickFunctions(bool bRegister) override;
+	virtual void OnUpdateTransform(EUpdateTransformFlags UpdateTransformFlags, ETeleportType Teleport = ETeleportType::None) override;
 };
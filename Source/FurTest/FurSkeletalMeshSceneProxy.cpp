@@ -5,6 +5,42 @@
 #include "FurSkeletalMeshComponent.h"
 #include "SkeletalRenderPublic.h"
 #include "Rendering/SkeletalMeshRenderData.h"
+#include "GPUSkinCache.h"
+#include "Rendering/ColorVertexBuffer.h"
+#include "FurStats.h"
+#include "FurMeshCache.h"
+#include "FurShellSkinning.h"
+#include "FurShellHelpers.h"
+#include "DynamicMeshBuilder.h"
+#include "Async/ParallelFor.h"
+#include "Misc/App.h"
+
+static TAutoConsoleVariable<int32> CVarFurParallelGather(
+	TEXT("fur.ParallelGather"),
+	1,
+	TEXT("Whether the per section and per view planning of fur batches, section culling and fin building,\n")
+	TEXT("runs as task graph jobs. The batches are still handed to the renderer on the rendering thread."),
+	ECVF_RenderThreadSafe);
+
+static TAutoConsoleVariable<int32> CVarFurParallelGatherMinWork(
+	TEXT("fur.ParallelGather.MinWork"),
+	1024,
+	TEXT("Least work, in bone boxes transformed, fin vertices skinned or fin edges tested, for a fur gather step to run\n")
+	TEXT("as task graph jobs. Smaller steps run inline, where they are cheaper than waking worker threads."),
+	ECVF_RenderThreadSafe);
+
+/** Frames a view can go without rendering this proxy before its shell LOD history is dropped. */
+static const uint32 ShellLODViewStateLifetime = 120;
+
+/**
+ * Whether gather work over NumItems independent items should be spread over worker threads. TotalWork estimates
+ * the whole step in the units of fur.ParallelGather.MinWork.
+ */
+static bool ShouldGatherInParallel(int32 NumItems, int32 TotalWork)
+{
+	return NumItems > 1 && TotalWork >= CVarFurParallelGatherMinWork.GetValueOnRenderThread()
+		&& CVarFurParallelGather.GetValueOnRenderThread() != 0 && FApp::ShouldUseThreadingForPerformance();
+}
 
 class FSkeletalMeshSectionIter
 {
@@ -100,12 +136,342 @@ FurSkeletalMeshSceneProxy::FurSkeletalMeshSceneProxy(const USkinnedMeshComponent
 	:FSkeletalMeshSceneProxy(Component, InSkelMeshRenderData)
 {
 	auto* tem = Cast<UFurSkeletalMeshComponent>(Component);
-	MultiPassMaterial = tem->MultiPassMaterial;
+	MultiPassMaterial = tem->GetShellMaterials();
+	ShadowParameters = tem->GetShadowParameters();
+	DynamicsParameters = tem->GetDynamicsParameters();
+	ShellLODs = tem->ShellLODs;
+	ShellLODHysteresis = tem->ShellLODHysteresis;
+	MaxShellsPerMeshLOD = tem->MaxShellsPerMeshLOD;
+	BudgetShellCount = tem->GetBudgetShellCount();
+	SignificanceShellCount = tem->GetSignificanceShellCount();
+	ShellLODEvictionFrameNumber = 0;
+
+	SectionShellLimits.SetNum(LODSections.Num());
+	for (int32 LODIndex = 0; LODIndex < LODSections.Num(); ++LODIndex)
+	{
+		TArray<int32> SectionMaterialIndices;
+		for (const FSectionElementInfo& SectionElement : LODSections[LODIndex].SectionElements)
+		{
+			SectionMaterialIndices.Add(SectionElement.UseMaterialIndex);
+		}
+		tem->GetSectionShellLimits(LODIndex, SectionMaterialIndices, SectionShellLimits[LODIndex]);
+	}
+
+	bSkinCastsShadow = !tem->DrawsOwnerSkin();
+	FurBoundsExtension = tem->GetFurBoundsExtension();
+	if (tem->bFurSectionCulling && tem->SkeletalMesh)
+	{
+		SectionBounds.SetNum(InSkelMeshRenderData->LODRenderData.Num());
+		for (int32 LODIndex = 0; LODIndex < SectionBounds.Num(); ++LODIndex)
+		{
+			SectionBounds[LODIndex] = FFurMeshCache::GetSectionBounds(tem->SkeletalMesh, LODIndex);
+		}
+	}
+
+	// Fins are set up whenever the component has them, so significance can turn them on and off without a new proxy.
+	FinMaterial = tem->bFurFins ? tem->FinMaterial : nullptr;
+	bFinsEnabled = tem->ShouldDrawFins();
+	FinLength = tem->FinLength;
+	FinSilhouetteThreshold = tem->FinSilhouetteThreshold;
+	if (FinMaterial && tem->SkeletalMesh)
+	{
+		FinTopologies.SetNum(InSkelMeshRenderData->LODRenderData.Num());
+		for (int32 LODIndex = 0; LODIndex < FinTopologies.Num(); ++LODIndex)
+		{
+			FinTopologies[LODIndex] = FFurMeshCache::GetFinTopology(tem->SkeletalMesh, LODIndex);
+		}
+	}
+
+	ShellMaterialRelevance = tem->GetShellMaterialRelevance(GetScene().GetFeatureLevel());
+	MaterialRelevance |= ShellMaterialRelevance;
+
+	// Sets the usage flags in the editor. Cooked materials without them leave every shell to the shell materials.
+	InstancedShellMaterial = tem->GetInstancedShellMaterial();
+	bCreatedWithInstancedShells = InstancedShellMaterial != nullptr;
+	if (InstancedShellMaterial && !(InstancedShellMaterial->CheckMaterialUsage_Concurrent(MATUSAGE_SkeletalMesh)
+		&& InstancedShellMaterial->CheckMaterialUsage_Concurrent(MATUSAGE_InstancedStaticMeshes)))
+	{
+		InstancedShellMaterial = nullptr;
+	}
+	if (bCreatedWithInstancedShells && GetScene().GetFeatureLevel() >= ERHIFeatureLevel::SM5)
+	{
+		ShellVertexFactories.SetNum(InSkelMeshRenderData->LODRenderData.Num());
+		for (int32 LODIndex = 0; LODIndex < ShellVertexFactories.Num(); ++LODIndex)
+		{
+			const FSkeletalMeshLODRenderData& LODData = InSkelMeshRenderData->LODRenderData[LODIndex];
+			if (LODData.SkinWeightVertexBuffer.HasExtraBoneInfluences())
+			{
+				continue;
+			}
+			// The baked fur colours, when the component overrides the vertex colours of this LOD.
+			const FColorVertexBuffer* OverrideColors = tem->LODInfo.IsValidIndex(LODIndex) ? tem->LODInfo[LODIndex].OverrideVertexColors : nullptr;
+			ShellVertexFactories[LODIndex] = MakeUnique<FFurShellVertexFactory>(GetScene().GetFeatureLevel());
+			ShellVertexFactories[LODIndex]->InitFromLOD(LODData, OverrideColors);
+		}
+	}
+
+	BuildShellDrawLists();
+}
+
+FurSkeletalMeshSceneProxy::~FurSkeletalMeshSceneProxy()
+{
+	for (TUniquePtr<FFurShellVertexFactory>& ShellVertexFactory : ShellVertexFactories)
+	{
+		if (ShellVertexFactory.IsValid())
+		{
+			ShellVertexFactory->ReleaseResource();
+		}
+	}
+}
+
+void FurSkeletalMeshSceneProxy::BuildShellDrawLists()
+{
+	ShellMaterials.Reset();
+	ShellRenderProxies.Reset();
+	for (UMaterialInterface* Material : MultiPassMaterial)
+	{
+		if (Material != nullptr)
+		{
+			ShellMaterials.Add(Material);
+		}
+	}
+	for (UMaterialInterface* Material : ShellMaterials)
+	{
+		ShellRenderProxies.Add(Material->GetRenderProxy());
+	}
+
+	ShellDrawLists.Reset();
+	ShellDrawLists.SetNum(SectionShellLimits.Num());
+	for (int32 LODIndex = 0; LODIndex < SectionShellLimits.Num(); ++LODIndex)
+	{
+		FShellDrawList& DrawList = ShellDrawLists[LODIndex];
+		const TArray<int32>& Limits = SectionShellLimits[LODIndex];
+		for (int32 SectionIndex = 0; SectionIndex < Limits.Num(); ++SectionIndex)
+		{
+			if (Limits[SectionIndex] == 0)
+			{
+				continue;
+			}
+			const int32 LimitIndex = DrawList.ShellLimits.AddUnique(Limits[SectionIndex]);
+			for (int32 ShellIndex = 0; ShellIndex < ShellMaterials.Num(); ++ShellIndex)
+			{
+				FShellDrawItem& Item = DrawList.Items.AddDefaulted_GetRef();
+				Item.SectionIndex = SectionIndex;
+				Item.ShellIndex = ShellIndex;
+				Item.LimitIndex = LimitIndex;
+			}
+		}
+	}
+}
+
+bool FurSkeletalMeshSceneProxy::IsFurShadowView(const FSceneView* View) const
+{
+	return View->bIsSceneCapture
+		&& View->ShowOnlyPrimitives.IsSet()
+		&& View->ShowOnlyPrimitives->Num() == 1
+		&& View->ShowOnlyPrimitives->Contains(GetPrimitiveComponentId());
+}
+
+int32 FurSkeletalMeshSceneProxy::GetShellCountForView(const FSceneView* View, int32 LODIndex, int32 MaxShells) const
+{
+	// The fur shadow map only needs the skin.
+	if (IsFurShadowView(View))
+	{
+		return 0;
+	}
+
+	int32 ShellCount = MaxShells;
+	if (MaxShellsPerMeshLOD.IsValidIndex(LODIndex) && MaxShellsPerMeshLOD[LODIndex] >= 0)
+	{
+		ShellCount = FMath::Min(ShellCount, MaxShellsPerMeshLOD[LODIndex]);
+	}
+	if (BudgetShellCount >= 0)
+	{
+		ShellCount = FMath::Min(ShellCount, BudgetShellCount);
+	}
+	if (SignificanceShellCount >= 0)
+	{
+		ShellCount = FMath::Min(ShellCount, SignificanceShellCount);
+	}
+
+	if (ShellLODs.Num() == 0 || !View->Family || !View->Family->EngineShowFlags.LOD)
+	{
+		return ShellCount;
+	}
+
+	const FBoxSphereBounds& ProxyBounds = GetBounds();
+	const float ScreenRadiusSquared = ComputeBoundsScreenRadiusSquared(ProxyBounds.Origin, ProxyBounds.SphereRadius, *View);
+
+	// Views without a state, like thumbnails and most scene captures, are new every frame and keep no history.
+	const uint32 FrameNumber = View->Family->FrameNumber;
+	if (FrameNumber - ShellLODEvictionFrameNumber >= ShellLODViewStateLifetime)
+	{
+		for (auto It = ShellLODLevelPerView.CreateIterator(); It; ++It)
+		{
+			if (FrameNumber - It.Value().LastFrameNumber >= ShellLODViewStateLifetime)
+			{
+				It.RemoveCurrent();
+			}
+		}
+		ShellLODEvictionFrameNumber = FrameNumber;
+	}
+	FShellLODViewState* ViewState = View->State ? ShellLODLevelPerView.Find(View->State->GetViewKey()) : nullptr;
+	const int32 CurrentLevel = ViewState ? ViewState->Level : 0;
+
+	// Same walk as the skeletal mesh LOD: from the farthest entry towards the closest, biased towards staying put.
+	int32 NewLevel = 0;
+	for (int32 Level = ShellLODs.Num() - 1; Level > 0; --Level)
+	{
+		float ScreenSize = ShellLODs[Level].ScreenSize;
+		if (Level <= CurrentLevel)
+		{
+			ScreenSize += ShellLODHysteresis;
+		}
+		if (FMath::Square(ScreenSize * 0.5f) > ScreenRadiusSquared)
+		{
+			NewLevel = Level;
+			break;
+		}
+	}
+	if (View->State)
+	{
+		FShellLODViewState& NewViewState = ViewState ? *ViewState : ShellLODLevelPerView.Add(View->State->GetViewKey());
+		NewViewState.Level = NewLevel;
+		NewViewState.LastFrameNumber = FrameNumber;
+	}
+
+	return FMath::Clamp(ShellLODs[NewLevel].ShellCount, 0, ShellCount);
+}
+
+void FurSkeletalMeshSceneProxy::GetSectionViewMasks(const TArray<const FSceneView*>& Views, uint32 VisibilityMap, int32 LODIndex,
+	const FSectionStates& SectionStates, FSectionViewMasks& OutMasks) const
+{
+	const TArray<int32>& LODShellLimits = SectionShellLimits[LODIndex];
+	OutMasks.SetNumUninitialized(SectionStates.Num());
+	for (int32 SectionIndex = 0; SectionIndex < SectionStates.Num(); ++SectionIndex)
+	{
+		const bool bHasFur = LODShellLimits.IsValidIndex(SectionIndex) && LODShellLimits[SectionIndex] != 0;
+		OutMasks[SectionIndex] = bHasFur && SectionStates[SectionIndex] != SectionSkipped ? VisibilityMap : 0;
+	}
+
+	if (!SectionBounds.IsValidIndex(LODIndex) || !SectionBounds[LODIndex].IsValid())
+	{
+		return;
+	}
+	const TArray<TArray<FFurSectionBounds::FBoneBox>>& BoneBoxes = SectionBounds[LODIndex]->Sections;
+	const TArray<FMatrix>& ReferenceToLocal = MeshObject->GetReferenceToLocalMatrices();
+	if (ReferenceToLocal.Num() == 0 || BoneBoxes.Num() != OutMasks.Num())
+	{
+		return;
+	}
+
+	const FMatrix& LocalToWorld = GetLocalToWorld();
+	TArray<int32, TInlineAllocator<64>> NumCulledPerSection;
+	NumCulledPerSection.AddZeroed(OutMasks.Num());
+	int32 NumBoneBoxes = 0;
+	for (int32 SectionIndex = 0; SectionIndex < OutMasks.Num(); ++SectionIndex)
+	{
+		NumBoneBoxes += OutMasks[SectionIndex] != 0 ? BoneBoxes[SectionIndex].Num() : 0;
+	}
+	ParallelFor(OutMasks.Num(), [this, &Views, &BoneBoxes, &ReferenceToLocal, &LocalToWorld, &OutMasks, &NumCulledPerSection](int32 SectionIndex)
+	{
+		if (OutMasks[SectionIndex] == 0)
+		{
+			return;
+		}
+
+		// Each bone's reference box moved by that bone bounds the vertices it influences.
+		FBox LocalBox(ForceInit);
+		for (const FFurSectionBounds::FBoneBox& BoneBox : BoneBoxes[SectionIndex])
+		{
+			if (ReferenceToLocal.IsValidIndex(BoneBox.BoneIndex))
+			{
+				LocalBox += BoneBox.Box.TransformBy(ReferenceToLocal[BoneBox.BoneIndex]);
+			}
+		}
+		if (!LocalBox.IsValid)
+		{
+			return;
+		}
+		const FBox WorldBox = LocalBox.TransformBy(LocalToWorld).ExpandBy(FurBoundsExtension);
+		const FVector Center = WorldBox.GetCenter();
+		const FVector Extent = WorldBox.GetExtent();
+
+		for (int32 ViewIndex = 0; ViewIndex < Views.Num(); ViewIndex++)
+		{
+			const uint32 ViewBit = 1 << ViewIndex;
+			if ((OutMasks[SectionIndex] & ViewBit) && !Views[ViewIndex]->ViewFrustum.IntersectBox(Center, Extent))
+			{
+				OutMasks[SectionIndex] &= ~ViewBit;
+				++NumCulledPerSection[SectionIndex];
+			}
+		}
+	}, !ShouldGatherInParallel(OutMasks.Num(), NumBoneBoxes));
+
+	int32 NumCulled = 0;
+	for (int32 SectionCulled : NumCulledPerSection)
+	{
+		NumCulled += SectionCulled;
+	}
+	FUR_COUNTER_ADD(SectionsCulled, NumCulled);
+}
+
+void FurSkeletalMeshSceneProxy::SetShadowParameters_RenderThread(const FFurShadowParameters& InShadowParameters)
+{
+	check(IsInRenderingThread());
+	ShadowParameters = InShadowParameters;
+}
+
+void FurSkeletalMeshSceneProxy::SetDynamicsParameters_RenderThread(const FFurDynamicsParameters& InDynamicsParameters)
+{
+	check(IsInRenderingThread());
+	DynamicsParameters = InDynamicsParameters;
+}
+
+void FurSkeletalMeshSceneProxy::SetShellMaterials_RenderThread(const FShellMaterialUpdate& Update)
+{
+	check(IsInRenderingThread());
+	MultiPassMaterial = Update.MultiPassMaterial;
+	InstancedShellMaterial = Update.InstancedShellMaterial;
+#if WITH_EDITOR
+	SetUsedMaterialForVerification(Update.UsedMaterials);
+#endif
+	BuildShellDrawLists();
+}
+
+void FurSkeletalMeshSceneProxy::SetBudgetShellCount_RenderThread(int32 InBudgetShellCount)
+{
+	check(IsInRenderingThread());
+	BudgetShellCount = InBudgetShellCount;
+}
+
+void FurSkeletalMeshSceneProxy::SetSignificanceShellCount_RenderThread(int32 InSignificanceShellCount)
+{
+	check(IsInRenderingThread());
+	SignificanceShellCount = InSignificanceShellCount;
+}
+
+void FurSkeletalMeshSceneProxy::SetFinsEnabled_RenderThread(bool bInFinsEnabled)
+{
+	check(IsInRenderingThread());
+	bFinsEnabled = bInFinsEnabled;
+}
+
+const FMaterialRenderProxy* FurSkeletalMeshSceneProxy::GetShellMaterialProxy(const FMaterialRenderProxy* ShellProxy, FMeshElementCollector& Collector) const
+{
+	if (!ShadowParameters.bValid && !DynamicsParameters.bValid)
+	{
+		return ShellProxy;
+	}
+	FFurShellMaterialRenderProxy* WrappedProxy = new FFurShellMaterialRenderProxy(ShellProxy, ShadowParameters, DynamicsParameters);
+	Collector.RegisterOneFrameMaterialProxy(WrappedProxy);
+	return WrappedProxy;
 }
 
 void FurSkeletalMeshSceneProxy::GetDynamicMeshElements(const TArray<const FSceneView*>& Views, const FSceneViewFamily & ViewFamily, uint32 VisibilityMap, FMeshElementCollector & Collector) const
 {
 	QUICK_SCOPE_CYCLE_COUNTER(STAT_FSkeletalMeshSceneProxy_GetMeshElements);
+	FUR_SCOPE_TIMING(GetDynamicMeshElements);
 	GetMeshElementsConditionallySelectable(Views, ViewFamily, true, VisibilityMap, Collector);
 }
 bool FSkeletalMeshObject::IsMaterialHidden(int32 InLODIndex, int32 MaterialIdx) const
@@ -199,6 +565,10 @@ void FurSkeletalMeshSceneProxy::GetMeshElementsConditionallySelectable(const TAr
 
 		check(LODSection.SectionElements.Num() == LODData.RenderSections.Num());
 
+		// Base pass, remembering which sections were drawn (and selected) for the shell walk below.
+		FSectionStates SectionStates;
+		SectionStates.AddZeroed(LODData.RenderSections.Num());
+
 		for (FSkeletalMeshSectionIter Iter(LODIndex, *MeshObject, LODData, LODSection); Iter; ++Iter)
 		{
 			const FSkelMeshRenderSection& Section = Iter.GetSection();
@@ -225,15 +595,225 @@ void FurSkeletalMeshSceneProxy::GetMeshElementsConditionallySelectable(const TAr
 				continue;
 			}
 			
-			GetDynamicElementsSection(Views, ViewFamily, VisibilityMap, LODData, LODIndex, SectionIndex, bSectionSelected, SectionElementInfo, bInSelectable, Collector);
-			for (int i = 0; i < MultiPassMaterial.Num(); ++i)
+			if (bSkinCastsShadow)
+			{
+				GetDynamicElementsSection(Views, ViewFamily, VisibilityMap, LODData, LODIndex, SectionIndex, bSectionSelected, SectionElementInfo, bInSelectable, Collector);
+			}
+			else
+			{
+				FSectionElementInfo NoShadowElementInfo = SectionElementInfo;
+				NoShadowElementInfo.bEnableShadowCasting = false;
+				GetDynamicElementsSection(Views, ViewFamily, VisibilityMap, LODData, LODIndex, SectionIndex, bSectionSelected, NoShadowElementInfo, bInSelectable, Collector);
+			}
+			SectionStates[SectionIndex] = bSectionSelected ? SectionDrawnSelected : SectionDrawn;
+		}
+
+		const FShellDrawList& DrawList = ShellDrawLists[LODIndex];
+		const bool bDrawFins = bFinsEnabled && FinMaterial != nullptr && FinTopologies.IsValidIndex(LODIndex) && FinTopologies[LODIndex].IsValid();
+		if (DrawList.Items.Num() > 0 || bDrawFins)
+		{
+			SCOPE_CYCLE_COUNTER(STAT_FurShellLoop);
+			CSV_SCOPED_TIMING_STAT(Fur, ShellLoop);
+
+			// Pick the shell count per view, then turn it into a view mask per (section limit, shell).
+			// Fins follow the shell LOD: they are drawn in every view that gets at least one shell.
+			const int32 TotalShells = ShellRenderProxies.Num();
+			int32 ViewShellCounts[32] = { 0 };
+			uint32 FinVisibilityMap = 0;
+			for (int32 ViewIndex = 0; ViewIndex < Views.Num(); ViewIndex++)
+			{
+				if (VisibilityMap & (1 << ViewIndex))
+				{
+					const int32 ViewShells = GetShellCountForView(Views[ViewIndex], LODIndex, FMath::Max(TotalShells, 1));
+					ViewShellCounts[ViewIndex] = FMath::Min(ViewShells, TotalShells);
+					FinVisibilityMap |= ViewShells > 0 ? (1 << ViewIndex) : 0;
+				}
+			}
+
+			// Instanced shells need the LOD's vertex factory and a material compiled for it. Sections they can't
+			// draw are left to the shell materials.
+			const FMaterialRenderProxy* InstancedShellRenderProxy = nullptr;
+			if (InstancedShellMaterial && ViewFamily.GetFeatureLevel() >= ERHIFeatureLevel::SM5
+				&& ShellVertexFactories.IsValidIndex(LODIndex) && ShellVertexFactories[LODIndex].IsValid())
+			{
+				const FMaterialRenderProxy* RenderProxy = InstancedShellMaterial->GetRenderProxy();
+				const FMaterialRenderProxy* FallbackRenderProxy = nullptr;
+				const FMaterial& Material = RenderProxy->GetMaterialWithFallback(ViewFamily.GetFeatureLevel(), FallbackRenderProxy);
+				if (FallbackRenderProxy == nullptr && FFurShellVertexFactory::HasShaders(Material))
+				{
+					InstancedShellRenderProxy = RenderProxy;
+				}
+			}
+
+			// Sections the skin cache holds were skinned once by PreGDMECallback, and the passthrough vertex factory
+			// lets their shells read the cached vertices. The others are skinned again by every shell, either in one
+			// instanced draw or in a draw per shell.
+			FFurShellSkinningInputs SkinningInputs;
+			SkinningInputs.bSkinCacheSupported = ViewFamily.Scene && ViewFamily.Scene->GetGPUSkinCache() && ViewFamily.GetFeatureLevel() >= ERHIFeatureLevel::SM5;
+			SkinningInputs.bSkinCacheEnabled = GEnableGPUSkinCache != 0;
+			SkinningInputs.bCPUSkinned = MeshObject->IsCPUSkinned();
+			const int32 PerShellMaxShells = FFurShellSkinning::GetPerShellMaxShells();
+
+			// Furry sections the base pass didn't draw, and shells the LOD took off the drawn ones.
+			int32 NumSectionsSkipped = 0;
+			int32 NumShellsCulled = 0;
+			int32 NumSectionsSkinCached = 0;
+			int32 NumSectionsSkinnedPerShell = 0;
+			int32 NumSectionsInstanced = 0;
+			const TArray<int32>& LODShellLimits = SectionShellLimits[LODIndex];
+			TArray<EFurShellSkinning, TInlineAllocator<64>> SectionSkinning;
+			SectionSkinning.Init(EFurShellSkinning::None, LODShellLimits.Num());
+			TArray<int32, TInlineAllocator<64>> SectionShellCounts;
+			SectionShellCounts.Init(0, LODShellLimits.Num());
+			for (int32 SectionIndex = 0; SectionIndex < LODShellLimits.Num(); ++SectionIndex)
 			{
-				if (MultiPassMaterial[i] == nullptr)
+				const int32 ShellLimit = LODShellLimits[SectionIndex];
+				if (ShellLimit == 0)
+				{
 					continue;
-				FSectionElementInfo info(SectionElementInfo);
-				info.Material = MultiPassMaterial[i];
-				
-				GetDynamicElementsSection(Views, ViewFamily, VisibilityMap, LODData, LODIndex, SectionIndex, bSectionSelected, info, bInSelectable, Collector);
+				}
+				if (SectionStates[SectionIndex] == SectionSkipped)
+				{
+					++NumSectionsSkipped;
+					continue;
+				}
+				int32 SectionShells = ShellLimit > 0 ? FMath::Min(ShellLimit, TotalShells) : TotalShells;
+
+				SkinningInputs.bSectionCached = MeshObject->SkinCacheEntry && FGPUSkinCache::IsEntryValid(MeshObject->SkinCacheEntry, SectionIndex);
+				// Cached sections only have the passthrough factory, without the bone matrices the instanced draw skins with.
+				SkinningInputs.bInstancingSupported = InstancedShellRenderProxy != nullptr && !SkinningInputs.bSectionCached
+					&& !LODData.RenderSections[SectionIndex].HasClothingData();
+				SkinningInputs.NumShells = SectionShells;
+				SectionSkinning[SectionIndex] = FFurShellSkinning::Select(SkinningInputs);
+				if (SectionSkinning[SectionIndex] == EFurShellSkinning::SkinCache)
+				{
+					++NumSectionsSkinCached;
+				}
+				else if (FFurShellSkinning::SkinsPerShell(SectionSkinning[SectionIndex]))
+				{
+					if (SectionSkinning[SectionIndex] == EFurShellSkinning::Instanced)
+					{
+						++NumSectionsInstanced;
+					}
+					else
+					{
+						++NumSectionsSkinnedPerShell;
+					}
+					if (PerShellMaxShells > 0)
+					{
+						SectionShells = FMath::Min(SectionShells, PerShellMaxShells);
+					}
+				}
+				SectionShellCounts[SectionIndex] = SectionShells;
+
+				for (int32 ViewIndex = 0; ViewIndex < Views.Num(); ViewIndex++)
+				{
+					if (VisibilityMap & (1 << ViewIndex))
+					{
+						NumShellsCulled += SectionShells - FMath::Min(ViewShellCounts[ViewIndex], SectionShells);
+					}
+				}
+			}
+			FUR_COUNTER_ADD(SectionsSkipped, NumSectionsSkipped);
+			FUR_COUNTER_ADD(ShellsCulledByLOD, NumShellsCulled);
+			FUR_COUNTER_ADD(SectionsSkinCached, NumSectionsSkinCached);
+			FUR_COUNTER_ADD(SectionsSkinnedPerShell, NumSectionsSkinnedPerShell);
+			FUR_COUNTER_ADD(SectionsInstanced, NumSectionsInstanced);
+
+			FSectionViewMasks SectionViewMasks;
+			GetSectionViewMasks(Views, VisibilityMap, LODIndex, SectionStates, SectionViewMasks);
+
+			// One batch per view for each instanced section, whatever the shell count.
+			if (NumSectionsInstanced > 0)
+			{
+				const FMaterialRenderProxy* InstancedShellProxy = GetShellMaterialProxy(InstancedShellRenderProxy, Collector);
+				for (int32 SectionIndex = 0; SectionIndex < SectionSkinning.Num(); ++SectionIndex)
+				{
+					if (SectionSkinning[SectionIndex] != EFurShellSkinning::Instanced)
+					{
+						continue;
+					}
+					int32 SectionViewShells[32] = { 0 };
+					uint32 SectionVisibilityMap = 0;
+					for (int32 ViewIndex = 0; ViewIndex < Views.Num(); ViewIndex++)
+					{
+						if (SectionViewMasks[SectionIndex] & (1 << ViewIndex))
+						{
+							SectionViewShells[ViewIndex] = FMath::Min(ViewShellCounts[ViewIndex], SectionShellCounts[SectionIndex]);
+							SectionVisibilityMap |= SectionViewShells[ViewIndex] > 0 ? (1 << ViewIndex) : 0;
+						}
+					}
+					if (SectionVisibilityMap != 0)
+					{
+						GetDynamicElementsShell(Views, ViewFamily, SectionVisibilityMap, LODData, LODIndex, SectionIndex, SectionStates[SectionIndex] == SectionDrawnSelected,
+							LODSection.SectionElements[SectionIndex], InstancedShellProxy, bInSelectable, Collector, SectionViewShells, TotalShells);
+					}
+				}
+			}
+
+			// The remaining sections draw one batch per shell material.
+			if (NumSectionsSkinCached + NumSectionsSkinnedPerShell > 0)
+			{
+				// Shell proxies carry this frame's shadow parameters and are shared by every section.
+				TArray<const FMaterialRenderProxy*, TInlineAllocator<32>> ShellProxies;
+				for (const FMaterialRenderProxy* ShellRenderProxy : ShellRenderProxies)
+				{
+					ShellProxies.Add(GetShellMaterialProxy(ShellRenderProxy, Collector));
+				}
+
+				// Section limits the shells are picked with, plus their per shell skinning caps when a section needs them.
+				TArray<int32, TInlineAllocator<8>> ShellLimits(DrawList.ShellLimits);
+				TArray<int32, TInlineAllocator<8>> PerShellLimitIndices;
+				if (PerShellMaxShells > 0 && NumSectionsSkinnedPerShell > 0)
+				{
+					for (int32 ShellLimit : DrawList.ShellLimits)
+					{
+						PerShellLimitIndices.Add(ShellLimits.AddUnique(ShellLimit > 0 ? FMath::Min(ShellLimit, PerShellMaxShells) : PerShellMaxShells));
+					}
+				}
+				const int32 NumLimits = ShellLimits.Num();
+
+				TArray<uint32, TInlineAllocator<64>> ShellVisibilityMaps;
+				ShellVisibilityMaps.AddZeroed(NumLimits * TotalShells);
+				for (int32 LimitIndex = 0; LimitIndex < NumLimits; ++LimitIndex)
+				{
+					const int32 ShellLimit = ShellLimits[LimitIndex];
+					uint32* LimitMaps = ShellVisibilityMaps.GetData() + LimitIndex * TotalShells;
+					for (int32 ViewIndex = 0; ViewIndex < Views.Num(); ViewIndex++)
+					{
+						const int32 ViewShells = ShellLimit > 0 ? FMath::Min(ViewShellCounts[ViewIndex], ShellLimit) : ViewShellCounts[ViewIndex];
+						for (int32 i = 0; i < ViewShells; ++i)
+						{
+							LimitMaps[FFurShellHelpers::GetLODShellIndex(i, ViewShells, TotalShells)] |= (1 << ViewIndex);
+						}
+					}
+				}
+
+				for (const FShellDrawItem& Item : DrawList.Items)
+				{
+					const uint8 SectionState = SectionStates[Item.SectionIndex];
+					if (SectionState == SectionSkipped || SectionSkinning[Item.SectionIndex] == EFurShellSkinning::Instanced)
+					{
+						continue;
+					}
+					const bool bSectionSelected = SectionState == SectionDrawnSelected;
+					const FSectionElementInfo& SectionElementInfo = LODSection.SectionElements[Item.SectionIndex];
+					const int32 LimitIndex = PerShellLimitIndices.Num() > 0 && SectionSkinning[Item.SectionIndex] == EFurShellSkinning::PerShell
+						? PerShellLimitIndices[Item.LimitIndex]
+						: Item.LimitIndex;
+
+					const uint32 ShellVisibilityMap = ShellVisibilityMaps[LimitIndex * TotalShells + Item.ShellIndex] & SectionViewMasks[Item.SectionIndex];
+					if (ShellVisibilityMap != 0)
+					{
+						GetDynamicElementsShell(Views, ViewFamily, ShellVisibilityMap, LODData, LODIndex, Item.SectionIndex, bSectionSelected, SectionElementInfo,
+							ShellProxies[Item.ShellIndex], bInSelectable, Collector);
+					}
+				}
+			}
+
+			if (bDrawFins && FinVisibilityMap != 0)
+			{
+				GetDynamicElementsFins(Views, ViewFamily, FinVisibilityMap, LODData, LODIndex, SectionViewMasks, Collector);
 			}
 		}
 	}
@@ -280,3 +860,266 @@ void FurSkeletalMeshSceneProxy::GetMeshElementsConditionallySelectable(const TAr
 #endif
 }
 
+
+void FurSkeletalMeshSceneProxy::GetDynamicElementsShell(const TArray<const FSceneView*>& Views, const FSceneViewFamily & ViewFamily, uint32 VisibilityMap,
+	const FSkeletalMeshLODRenderData & LODData, const int32 LODIndex, const int32 SectionIndex, bool bSectionSelected,
+	const FSectionElementInfo & SectionElementInfo, const FMaterialRenderProxy * ShellMaterialProxy,
+	bool bInSelectable, FMeshElementCollector & Collector, const int32* ViewInstanceCounts, int32 TotalShells) const
+{
+	if (ShellMaterialProxy == nullptr)
+	{
+		return;
+	}
+
+	const FSkelMeshRenderSection& Section = LODData.RenderSections[SectionIndex];
+
+#if !WITH_EDITOR
+	const bool bIsSelected = false;
+#else
+	bool bIsSelected = IsSelected();
+	if (!bIsSelected && bSectionSelected && bCanHighlightSelectedSections)
+	{
+		bIsSelected = true;
+	}
+	if (WantsEditorEffects())
+	{
+		bIsSelected = true;
+	}
+#endif
+
+	for (int32 ViewIndex = 0; ViewIndex < Views.Num(); ViewIndex++)
+	{
+		if (VisibilityMap & (1 << ViewIndex))
+		{
+			const FSceneView* View = Views[ViewIndex];
+
+			FMeshBatch& Mesh = Collector.AllocateMesh();
+			FMeshBatchElement& BatchElement = Mesh.Elements[0];
+			Mesh.LCI = NULL;
+			Mesh.bWireframe |= bForceWireframe;
+			Mesh.Type = PT_TriangleList;
+			// The passthrough factory over the skin cache output when the section is cached, so the shell doesn't skin again.
+			const FVertexFactory* SkinVertexFactory = MeshObject->GetSkinVertexFactory(View, LODIndex, SectionIndex);
+
+			if (!SkinVertexFactory)
+			{
+				continue;
+			}
+
+			if (ViewInstanceCounts)
+			{
+				// The fur shell factory skins with the bone matrices the section's own factory was updated with this frame.
+				FShaderResourceViewRHIRef BoneMatrices = FFurShellVertexFactory::GetBoneMatrices(SkinVertexFactory);
+				if (!BoneMatrices.IsValid())
+				{
+					continue;
+				}
+				FFurShellVertexFactory::FBatchElementParams& Params = Collector.AllocateOneFrameResource<FFurShellVertexFactory::FBatchElementParams>();
+				Params.BoneMatrices = BoneMatrices;
+				Params.NumShells = ViewInstanceCounts[ViewIndex];
+				Params.TotalShells = TotalShells;
+				Mesh.VertexFactory = ShellVertexFactories[LODIndex].Get();
+				BatchElement.VertexFactoryUserData = &Params;
+				BatchElement.NumInstances = Params.NumShells;
+			}
+			else
+			{
+				Mesh.VertexFactory = SkinVertexFactory;
+				BatchElement.VertexFactoryUserData = FGPUSkinCache::GetFactoryUserData(MeshObject->SkinCacheEntry, SectionIndex);
+			}
+
+			Mesh.bSelectable = bInSelectable;
+			BatchElement.FirstIndex = Section.BaseIndex;
+			BatchElement.IndexBuffer = LODData.MultiSizeIndexContainer.GetIndexBuffer();
+			BatchElement.MaxVertexIndex = LODData.GetNumVertices() - 1;
+			BatchElement.PrimitiveUniformBuffer = GetUniformBuffer();
+			BatchElement.NumPrimitives = Section.NumTriangles;
+			BatchElement.MinVertexIndex = Section.BaseVertexIndex;
+
+			Mesh.MaterialRenderProxy = ShellMaterialProxy;
+			Mesh.ReverseCulling = IsLocalToWorldDeterminantNegative();
+			Mesh.CastShadow = SectionElementInfo.bEnableShadowCasting;
+			Mesh.bCanApplyViewModeOverrides = true;
+			Mesh.bUseWireframeSelectionColoring = bIsSelected;
+
+#if WITH_EDITOR
+			Mesh.BatchHitProxyId = SectionElementInfo.HitProxy ? SectionElementInfo.HitProxy->Id : FHitProxyId();
+			if (bSectionSelected && bCanHighlightSelectedSections)
+			{
+				Mesh.bUseSelectionOutline = true;
+			}
+			else
+			{
+				Mesh.bUseSelectionOutline = !bCanHighlightSelectedSections && bIsSelected;
+			}
+#endif
+
+			Collector.AddMesh(ViewIndex, Mesh);
+			FUR_COUNTER_ADD(ShellBatches, 1);
+			FUR_COUNTER_ADD(Triangles, Section.NumTriangles * BatchElement.NumInstances);
+		}
+	}
+}
+
+/** Component space positions of the given render vertices, skinned on the CPU with the current bone matrices. */
+template<bool bExtraBoneInfluences>
+static void SkinFinVertices(const FSkeletalMeshLODRenderData& LODData, const FSkelMeshRenderSection& Section, const TArray<FMatrix>& ReferenceToLocal,
+	const TArray<uint32>& Vertices, TArray<FVector>& OutPositions)
+{
+	typedef TSkinWeightInfo<bExtraBoneInfluences> FWeightInfo;
+	const FPositionVertexBuffer& PositionBuffer = LODData.StaticVertexBuffers.PositionVertexBuffer;
+	OutPositions.SetNumUninitialized(Vertices.Num());
+	for (int32 Index = 0; Index < Vertices.Num(); ++Index)
+	{
+		const uint32 VertexIndex = Vertices[Index];
+		const FWeightInfo* Weights = LODData.SkinWeightVertexBuffer.GetSkinWeightPtr<bExtraBoneInfluences>(VertexIndex);
+		const FVector Position = PositionBuffer.VertexPosition(VertexIndex);
+		FVector Skinned = FVector::ZeroVector;
+		for (int32 Influence = 0; Influence < FWeightInfo::NumInfluences; ++Influence)
+		{
+			const uint8 Weight = Weights->InfluenceWeights[Influence];
+			if (Weight == 0)
+			{
+				continue;
+			}
+			const FBoneIndexType BoneIndex = Section.BoneMap[Weights->InfluenceBones[Influence]];
+			Skinned += ReferenceToLocal[BoneIndex].TransformPosition(Position) * (Weight / 255.0f);
+		}
+		OutPositions[Index] = Skinned;
+	}
+}
+
+void FurSkeletalMeshSceneProxy::GetDynamicElementsFins(const TArray<const FSceneView*>& Views, const FSceneViewFamily& ViewFamily, uint32 VisibilityMap,
+	const FSkeletalMeshLODRenderData& LODData, const int32 LODIndex, const FSectionViewMasks& SectionViewMasks, FMeshElementCollector& Collector) const
+{
+	const FFurFinTopology& Topology = *FinTopologies[LODIndex];
+	const TArray<FMatrix>& ReferenceToLocal = MeshObject->GetReferenceToLocalMatrices();
+	if (ReferenceToLocal.Num() == 0 || Topology.Sections.Num() != LODData.RenderSections.Num())
+	{
+		return;
+	}
+
+	// Main view, shadow depths and fur shadow captures all gather the fins, often with the same pose; the skinned
+	// vertices are kept until the bone matrices change, which also covers poses that hold still over frames.
+	FFinSkinningCache& SkinningCache = FinSkinningCache;
+	if (SkinningCache.LODIndex != LODIndex || SkinningCache.ReferenceToLocal.Num() != ReferenceToLocal.Num()
+		|| FMemory::Memcmp(SkinningCache.ReferenceToLocal.GetData(), ReferenceToLocal.GetData(), ReferenceToLocal.Num() * sizeof(FMatrix)) != 0)
+	{
+		SkinningCache.LODIndex = LODIndex;
+		SkinningCache.ReferenceToLocal = ReferenceToLocal;
+		SkinningCache.Sections.Reset();
+		SkinningCache.Sections.SetNum(Topology.Sections.Num());
+	}
+
+	// Skin the furry sections not skinned yet, then pick silhouette edges per view. Both run per section and per
+	// view on worker threads; only handing the meshes to the collector stays on the rendering thread.
+	TArray<TArray<FVector>>& SkinnedSections = SkinningCache.Sections;
+	int32 NumVerticesToSkin = 0;
+	int32 NumEdges = 0;
+	for (int32 SectionIndex = 0; SectionIndex < Topology.Sections.Num(); ++SectionIndex)
+	{
+		if ((SectionViewMasks[SectionIndex] & VisibilityMap) != 0 && Topology.Sections[SectionIndex].Edges.Num() > 0)
+		{
+			NumVerticesToSkin += SkinnedSections[SectionIndex].Num() == 0 ? Topology.Sections[SectionIndex].Vertices.Num() : 0;
+			NumEdges += Topology.Sections[SectionIndex].Edges.Num();
+		}
+	}
+	ParallelFor(Topology.Sections.Num(), [&Topology, &LODData, &ReferenceToLocal, &SectionViewMasks, &SkinnedSections, VisibilityMap](int32 SectionIndex)
+	{
+		if ((SectionViewMasks[SectionIndex] & VisibilityMap) == 0 || Topology.Sections[SectionIndex].Edges.Num() == 0
+			|| SkinnedSections[SectionIndex].Num() > 0)
+		{
+			return;
+		}
+		if (LODData.SkinWeightVertexBuffer.HasExtraBoneInfluences())
+		{
+			SkinFinVertices<true>(LODData, LODData.RenderSections[SectionIndex], ReferenceToLocal, Topology.Sections[SectionIndex].Vertices, SkinnedSections[SectionIndex]);
+		}
+		else
+		{
+			SkinFinVertices<false>(LODData, LODData.RenderSections[SectionIndex], ReferenceToLocal, Topology.Sections[SectionIndex].Vertices, SkinnedSections[SectionIndex]);
+		}
+	}, !ShouldGatherInParallel(Topology.Sections.Num(), NumVerticesToSkin));
+
+	const FMaterialRenderProxy* FinMaterialProxy = GetShellMaterialProxy(FinMaterial->GetRenderProxy(), Collector);
+	const FMatrix& LocalToWorld = GetLocalToWorld();
+	const FMatrix WorldToLocal = LocalToWorld.Inverse();
+
+	struct FFinViewGeometry
+	{
+		TArray<FDynamicMeshVertex> Vertices;
+		TArray<uint32> Indices;
+	};
+	TArray<FFinViewGeometry, TInlineAllocator<4>> ViewGeometry;
+	ViewGeometry.SetNum(Views.Num());
+	ParallelFor(Views.Num(), [this, &Views, &Topology, &SkinnedSections, &SectionViewMasks, &WorldToLocal, &ViewGeometry, VisibilityMap](int32 ViewIndex)
+	{
+		if (!(VisibilityMap & (1 << ViewIndex)))
+		{
+			return;
+		}
+		const FSceneView* View = Views[ViewIndex];
+		const bool bPerspective = View->IsPerspectiveProjection();
+		const FVector LocalViewOrigin = WorldToLocal.TransformPosition(View->ViewMatrices.GetViewOrigin());
+		const FVector LocalViewDirection = WorldToLocal.TransformVector(View->GetViewDirection()).GetSafeNormal();
+
+		TArray<FDynamicMeshVertex>& Vertices = ViewGeometry[ViewIndex].Vertices;
+		TArray<uint32>& Indices = ViewGeometry[ViewIndex].Indices;
+		for (int32 SectionIndex = 0; SectionIndex < Topology.Sections.Num(); ++SectionIndex)
+		{
+			const TArray<FVector>& Positions = SkinnedSections[SectionIndex];
+			if (Positions.Num() == 0 || !(SectionViewMasks[SectionIndex] & (1 << ViewIndex)))
+			{
+				continue;
+			}
+			for (const FFurFinSection::FEdge& Edge : Topology.Sections[SectionIndex].Edges)
+			{
+				const FVector& P0 = Positions[Edge.V0];
+				const FVector& P1 = Positions[Edge.V1];
+				const FVector EdgeVector = P1 - P0;
+				const FVector NormalA = FVector::CrossProduct(Positions[Edge.OppositeA] - P0, EdgeVector).GetSafeNormal();
+				const FVector NormalB = FVector::CrossProduct(EdgeVector, Positions[Edge.OppositeB] - P0).GetSafeNormal();
+				const FVector ViewVector = bPerspective ? ((P0 + P1) * 0.5f - LocalViewOrigin).GetSafeNormal() : LocalViewDirection;
+				const float FacingA = FVector::DotProduct(NormalA, ViewVector);
+				const float FacingB = FVector::DotProduct(NormalB, ViewVector);
+
+				// On the silhouette when one side faces the view and the other doesn't, or both are close to edge-on.
+				const float EdgeOn = FMath::Abs(FacingA + FacingB) * 0.5f;
+				const bool bSilhouette = FacingA * FacingB <= 0.0f;
+				if (!bSilhouette && EdgeOn >= FinSilhouetteThreshold)
+				{
+					continue;
+				}
+
+				const FVector FinNormal = (NormalA + NormalB).GetSafeNormal();
+				const FVector Tip = FinNormal * FinLength;
+				const FVector TangentX = EdgeVector.GetSafeNormal();
+				const FVector TangentZ = FVector::CrossProduct(TangentX, FinNormal);
+				// Alpha fades fins out towards the threshold so they don't pop.
+				const FColor Color(255, 255, 255, bSilhouette ? 255 : (uint8)FMath::RoundToInt(255.0f * (1.0f - EdgeOn / FinSilhouetteThreshold)));
+
+				const uint32 Base = Vertices.Num();
+				Vertices.Add(FDynamicMeshVertex(P0, TangentX, TangentZ, FVector2D(0.0f, 1.0f), Color));
+				Vertices.Add(FDynamicMeshVertex(P1, TangentX, TangentZ, FVector2D(1.0f, 1.0f), Color));
+				Vertices.Add(FDynamicMeshVertex(P1 + Tip, TangentX, TangentZ, FVector2D(1.0f, 0.0f), Color));
+				Vertices.Add(FDynamicMeshVertex(P0 + Tip, TangentX, TangentZ, FVector2D(0.0f, 0.0f), Color));
+				Indices.Append({ Base, Base + 1, Base + 2, Base, Base + 2, Base + 3 });
+			}
+		}
+	}, !ShouldGatherInParallel(FMath::CountBits(VisibilityMap), NumEdges * FMath::CountBits(VisibilityMap)));
+
+	for (int32 ViewIndex = 0; ViewIndex < Views.Num(); ViewIndex++)
+	{
+		const FFinViewGeometry& Geometry = ViewGeometry[ViewIndex];
+		if (Geometry.Indices.Num() == 0)
+		{
+			continue;
+		}
+		FDynamicMeshBuilder MeshBuilder(ViewFamily.GetFeatureLevel());
+		MeshBuilder.AddVertices(Geometry.Vertices);
+		MeshBuilder.AddTriangles(Geometry.Indices);
+		MeshBuilder.GetMesh(LocalToWorld, FinMaterialProxy, GetDepthPriorityGroup(Views[ViewIndex]), true, false, ViewIndex, Collector);
+		FUR_COUNTER_ADD(ShellBatches, 1);
+		FUR_COUNTER_ADD(Triangles, Geometry.Indices.Num() / 3);
+	}
+}
@@ -4,6 +4,12 @@
 
 #include "CoreMinimal.h"
 #include "SkeletalMeshTypes.h"
+#include "FurShellMaterialRenderProxy.h"
+#include "FurSkeletalMeshComponent.h"
+#include "FurShellVertexFactory.h"
+
+struct FFurFinTopology;
+struct FFurSectionBounds;
 /**
  * 
  */
@@ -13,9 +19,156 @@ public:
 	virtual SIZE_T GetTypeHash() const;
 
 	FurSkeletalMeshSceneProxy(const USkinnedMeshComponent* Component, FSkeletalMeshRenderData* InSkelMeshRenderData);
+	virtual ~FurSkeletalMeshSceneProxy();
 	TArray<UMaterialInterface*> MultiPassMaterial;
+	FFurShadowParameters ShadowParameters;
+	FFurDynamicsParameters DynamicsParameters;
+	TArray<FFurShellLOD> ShellLODs;
+	float ShellLODHysteresis;
+	TArray<int32> MaxShellsPerMeshLOD;
+	/** Shell cap from the world's fur budget, negative for none. */
+	int32 BudgetShellCount;
+	/** Shell cap from the component's significance, negative for none. */
+	int32 SignificanceShellCount;
+	/** Per LOD, per render section shell limit resolved from the component: 0 = no fur, negative = no limit. */
+	TArray<TArray<int32>> SectionShellLimits;
+
+	/** One shell draw: a furry render section drawn with one shell material. */
+	struct FShellDrawItem
+	{
+		int32 SectionIndex;
+		/** Index into ShellMaterials. */
+		int32 ShellIndex;
+		/** Index into FShellDrawList::ShellLimits. */
+		int32 LimitIndex;
+	};
+
+	/** Prebuilt shell draws of one LOD, in emission order. */
+	struct FShellDrawList
+	{
+		TArray<FShellDrawItem> Items;
+		/** Distinct section shell limits referenced by Items, negative for no limit. */
+		TArray<int32> ShellLimits;
+	};
+
+	/** Non-null shell materials in draw order, with their render proxies. */
+	TArray<UMaterialInterface*> ShellMaterials;
+	TArray<const FMaterialRenderProxy*> ShellRenderProxies;
+	/** Shell draws per LOD, rebuilt only when the shell materials or LOD data change. */
+	TArray<FShellDrawList> ShellDrawLists;
+
+	/** Material of the instanced shell batches, null when instanced shells are off. */
+	UMaterialInterface* InstancedShellMaterial;
+	/** Whether the component had instanced shells on when this proxy was made, which is the only time ShellVertexFactories are. */
+	bool bCreatedWithInstancedShells;
+	/**
+	 * Per LOD, the vertex factory instanced shells are drawn with. Null for LODs it can't draw, which have more
+	 * than four bone influences, and for all of them below SM5.
+	 */
+	TArray<TUniquePtr<FFurShellVertexFactory>> ShellVertexFactories;
+
+	/** How far fur reaches out of the skin, added to section bounds before culling. */
+	float FurBoundsExtension;
+	/** Per LOD section bone boxes for per-view section culling. Empty when culling is off. */
+	TArray<TSharedPtr<const FFurSectionBounds, ESPMode::ThreadSafe>> SectionBounds;
+
+	/** False while the component draws the owner's skin; the owner already casts its shadow. */
+	bool bSkinCastsShadow;
+
+	/** Fin material, null when the component has no fins. */
+	UMaterialInterface* FinMaterial;
+	/** Whether fins are drawn at the component's significance. The fin topology is kept while they are off. */
+	bool bFinsEnabled;
+	float FinLength;
+	float FinSilhouetteThreshold;
+	/** Edge adjacency per LOD, shared with every proxy of the mesh. Null for LODs without CPU data. */
+	TArray<TSharedPtr<const FFurFinTopology, ESPMode::ThreadSafe>> FinTopologies;
+
+	/** Fin vertices of one LOD skinned with ReferenceToLocal, reused by later gathers until the bone matrices change. */
+	struct FFinSkinningCache
+	{
+		int32 LODIndex = INDEX_NONE;
+		TArray<FMatrix> ReferenceToLocal;
+		/** Per section; empty for sections not skinned yet. */
+		TArray<TArray<FVector>> Sections;
+	};
+	mutable FFinSkinningCache FinSkinningCache;
+
+	/** Relevance of the shell and fin materials, merged into the view relevance. Fixed after construction. */
+	FMaterialRelevance ShellMaterialRelevance;
+
+	/** Rebuilds ShellMaterials and ShellDrawLists from the shell materials and SectionShellLimits. */
+	void BuildShellDrawLists();
+
+	/** New shell materials and counts from the component, with the same relevance as the ones replaced. */
+	struct FShellMaterialUpdate
+	{
+		TArray<UMaterialInterface*> MultiPassMaterial;
+		UMaterialInterface* InstancedShellMaterial = nullptr;
+#if WITH_EDITOR
+		/** Everything the component draws, for material verification. */
+		TArray<UMaterialInterface*> UsedMaterials;
+#endif
+	};
+	void SetShellMaterials_RenderThread(const FShellMaterialUpdate& Update);
+
+	void SetShadowParameters_RenderThread(const FFurShadowParameters& InShadowParameters);
+	void SetDynamicsParameters_RenderThread(const FFurDynamicsParameters& InDynamicsParameters);
+	void SetBudgetShellCount_RenderThread(int32 InBudgetShellCount);
+	void SetSignificanceShellCount_RenderThread(int32 InSignificanceShellCount);
+	void SetFinsEnabled_RenderThread(bool bInFinsEnabled);
 	virtual void GetDynamicMeshElements(const TArray<const FSceneView*>& Views, const FSceneViewFamily& ViewFamily,
 		uint32 VisibilityMap, FMeshElementCollector& Collector) const override;
 	void GetMeshElementsConditionallySelectable(const TArray<const FSceneView*>& Views, 
 		const FSceneViewFamily& ViewFamily, bool bInSelectable, uint32 VisibilityMap, FMeshElementCollector& Collector) const;
+
+protected:
+	/** What the base pass did with each render section of the drawn LOD. */
+	enum : uint8 { SectionSkipped = 0, SectionDrawn = 1, SectionDrawnSelected = 3 };
+	typedef TArray<uint8, TInlineAllocator<64>> FSectionStates;
+	/** Per render section, the views its fur is drawn in. */
+	typedef TArray<uint32, TInlineAllocator<64>> FSectionViewMasks;
+
+	/**
+	 * Views each section's fur is drawn in: none for sections without fur or skipped by the base pass,
+	 * otherwise the views whose frustum the section's skinned bounds, grown by the fur length, touch.
+	 */
+	void GetSectionViewMasks(const TArray<const FSceneView*>& Views, uint32 VisibilityMap, int32 LODIndex,
+		const FSectionStates& SectionStates, FSectionViewMasks& OutMasks) const;
+
+	/** Shell LOD entry last picked for a persistent view, and the frame it was picked on. */
+	struct FShellLODViewState
+	{
+		int32 Level;
+		uint32 LastFrameNumber;
+	};
+	/**
+	 * Shell LOD history used for hysteresis, keyed by view state so only views that persist between frames get one.
+	 * Entries not used for a while are dropped. Only touched on the rendering thread.
+	 */
+	mutable TMap<uint32, FShellLODViewState> ShellLODLevelPerView;
+	mutable uint32 ShellLODEvictionFrameNumber;
+
+	/** Whether View is a scene capture that only renders this primitive, i.e. a fur shadow depth capture. */
+	bool IsFurShadowView(const FSceneView* View) const;
+
+	/** Picks the number of shells to draw for a view, out of MaxShells. */
+	int32 GetShellCountForView(const FSceneView* View, int32 LODIndex, int32 MaxShells) const;
+
+	/** Returns the render proxy to draw a shell with, wrapped with this frame's shadow and dynamics parameters when there are any. */
+	const FMaterialRenderProxy* GetShellMaterialProxy(const FMaterialRenderProxy* ShellProxy, FMeshElementCollector& Collector) const;
+
+	/**
+	 * Same as GetDynamicElementsSection, but with an explicit material proxy. With ViewInstanceCounts, draws all
+	 * shells of the section instead, as ViewInstanceCounts[ViewIndex] instances out of TotalShells with the LOD's
+	 * fur shell vertex factory.
+	 */
+	void GetDynamicElementsShell(const TArray<const FSceneView*>& Views, const FSceneViewFamily& ViewFamily, uint32 VisibilityMap,
+		const FSkeletalMeshLODRenderData& LODData, const int32 LODIndex, const int32 SectionIndex, bool bSectionSelected,
+		const FSectionElementInfo& SectionElementInfo, const FMaterialRenderProxy* ShellMaterialProxy,
+		bool bInSelectable, FMeshElementCollector& Collector, const int32* ViewInstanceCounts = nullptr, int32 TotalShells = 0) const;
+
+	/** CPU skins the furry sections visible in any view and emits a fin quad on each silhouette edge, per view. */
+	void GetDynamicElementsFins(const TArray<const FSceneView*>& Views, const FSceneViewFamily& ViewFamily, uint32 VisibilityMap,
+		const FSkeletalMeshLODRenderData& LODData, const int32 LODIndex, const FSectionViewMasks& SectionViewMasks, FMeshElementCollector& Collector) const;
 };
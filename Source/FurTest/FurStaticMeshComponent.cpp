@@ -0,0 +1,104 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "FurStaticMeshComponent.h"
+#include "FurStaticMeshSceneProxy.h"
+#include "FurLayerAsset.h"
+#include "FurStats.h"
+#include "FurShellHelpers.h"
+#include "Engine/StaticMesh.h"
+#include "StaticMeshResources.h"
+#include "Materials/MaterialInstanceDynamic.h"
+
+UFurStaticMeshComponent::UFurStaticMeshComponent(const FObjectInitializer& ObjectInitializer)
+	: Super(ObjectInitializer)
+	, FurLayers(nullptr)
+	, MaxFurLength(2.0f)
+	, bFurOnUnlistedSections(true)
+{
+}
+
+void UFurStaticMeshComponent::SetFurLayers(UFurLayerAsset* NewFurLayers)
+{
+	FurLayers = NewFurLayers;
+	ApplyFurLayers();
+	MarkRenderStateDirty();
+}
+
+void UFurStaticMeshComponent::SetShellMaterials(const TArray<UMaterialInterface*>& NewMaterials)
+{
+	MultiPassMaterial = NewMaterials;
+	// The shells are cached static draws; new materials need them registered again.
+	MarkRenderStateDirty();
+}
+
+void UFurStaticMeshComponent::ApplyFurLayers()
+{
+	FurLayerShellMaterials.Reset();
+	if (FurLayers)
+	{
+		FurLayerShellMaterials.Append(FurLayers->GetShellMaterials());
+	}
+}
+
+void UFurStaticMeshComponent::OnRegister()
+{
+	ApplyFurLayers();
+	Super::OnRegister();
+}
+
+void UFurStaticMeshComponent::GetSectionShellLimits(int32 LODIndex, TArray<int32>& OutShellLimits) const
+{
+	OutShellLimits.Reset();
+	UStaticMesh* Mesh = GetStaticMesh();
+	if (Mesh == nullptr || Mesh->RenderData == nullptr || !Mesh->RenderData->LODResources.IsValidIndex(LODIndex))
+	{
+		return;
+	}
+
+	const FStaticMeshLODResources& LODResources = Mesh->RenderData->LODResources[LODIndex];
+	TArray<FName> SectionSlotNames;
+	SectionSlotNames.Reserve(LODResources.Sections.Num());
+	for (const FStaticMeshSection& Section : LODResources.Sections)
+	{
+		SectionSlotNames.Add(Mesh->StaticMaterials.IsValidIndex(Section.MaterialIndex) ? Mesh->StaticMaterials[Section.MaterialIndex].MaterialSlotName : NAME_None);
+	}
+	FFurShellHelpers::GetSectionShellLimits(LODIndex, SectionSlotNames, bFurOnUnlistedSections, FurMaterialSlots, FurSections, OutShellLimits);
+}
+
+FMaterialRelevance UFurStaticMeshComponent::GetShellMaterialRelevance(ERHIFeatureLevel::Type FeatureLevel) const
+{
+	return FFurShellHelpers::GetMaterialRelevance(GetShellMaterials(), FeatureLevel);
+}
+
+FPrimitiveSceneProxy* UFurStaticMeshComponent::CreateSceneProxy()
+{
+	FUR_SCOPE_TIMING(CreateSceneProxy);
+	UStaticMesh* Mesh = GetStaticMesh();
+	if (Mesh == nullptr || Mesh->RenderData == nullptr)
+	{
+		return nullptr;
+	}
+
+	const FStaticMeshLODResourcesArray& LODResources = Mesh->RenderData->LODResources;
+	if (LODResources.Num() == 0 || LODResources[FMath::Clamp<int32>(Mesh->MinLOD.Default, 0, LODResources.Num() - 1)].VertexBuffers.StaticMeshVertexBuffer.GetNumVertices() == 0)
+	{
+		return nullptr;
+	}
+
+	return ::new FurStaticMeshSceneProxy(this);
+}
+
+FBoxSphereBounds UFurStaticMeshComponent::CalcBounds(const FTransform& LocalToWorld) const
+{
+	FBoxSphereBounds Bounds = Super::CalcBounds(LocalToWorld);
+	Bounds.BoxExtent += FVector(MaxFurLength);
+	Bounds.SphereRadius += MaxFurLength;
+	return Bounds;
+}
+
+void UFurStaticMeshComponent::GetUsedMaterials(TArray<UMaterialInterface*>& OutMaterials, bool bGetDebugMaterials) const
+{
+	Super::GetUsedMaterials(OutMaterials, bGetDebugMaterials);
+	OutMaterials.Append(GetShellMaterials());
+}
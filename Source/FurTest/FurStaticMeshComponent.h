@@ -0,0 +1,81 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Components/StaticMeshComponent.h"
+#include "FurSkeletalMeshComponent.h"
+#include "FurStaticMeshComponent.generated.h"
+
+/**
+ * Fur shells on a static mesh, for props that never deform. The shells are static draws like the mesh itself,
+ * so the renderer caches their draw commands instead of rebuilding them every frame. The shell count follows
+ * the static mesh LOD. There are no fur shadow or dynamics parameters; changing the shells recreates the render state.
+ */
+UCLASS(ClassGroup = (Rendering, Common), hidecategories = Object, editinlinenew, meta = (BlueprintSpawnableComponent))
+class FURTEST_API UFurStaticMeshComponent : public UStaticMeshComponent
+{
+	GENERATED_BODY()
+
+public:
+	UFurStaticMeshComponent(const FObjectInitializer& ObjectInitializer);
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Multy Pass Component")
+	TArray<UMaterialInterface*> MultiPassMaterial;
+
+	/**
+	 * Shell stack description. When set, its shared shell materials are drawn instead of MultiPassMaterial,
+	 * which is left as authored.
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Multy Pass Component")
+	class UFurLayerAsset* FurLayers;
+
+	UFUNCTION(BlueprintCallable, Category = "FurStatic")
+	void SetFurLayers(class UFurLayerAsset* NewFurLayers);
+
+	/** Shell materials drawn, innermost first: those of FurLayers if set, otherwise MultiPassMaterial. May hold nulls. */
+	const TArray<UMaterialInterface*>& GetShellMaterials() const { return FurLayers ? FurLayerShellMaterials : MultiPassMaterial; }
+
+	/** Replaces MultiPassMaterial, innermost shell first. Only shows while FurLayers is not set. */
+	UFUNCTION(BlueprintCallable, Category = "FurStatic")
+	void SetShellMaterials(const TArray<UMaterialInterface*>& NewMaterials);
+
+	/** Upper bound on the shell count per static mesh LOD index. Missing or negative entries don't limit. */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Fur LOD")
+	TArray<int32> MaxShellsPerMeshLOD;
+
+	/** Farthest the outermost shell reaches out of the surface, in cm. Grows the bounds so shells are not culled early. */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Fur Sections", meta = (ClampMin = "0.0"))
+	float MaxFurLength;
+
+	/** Whether sections not matched by FurMaterialSlots or FurSections get shells. */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Fur Sections")
+	bool bFurOnUnlistedSections;
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Fur Sections")
+	TArray<FFurMaterialSlotSettings> FurMaterialSlots;
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Fur Sections")
+	TArray<FFurSectionSettings> FurSections;
+
+	/** Resolves the section settings for one LOD: 0 = no fur, negative = all shells, otherwise the shell limit. */
+	void GetSectionShellLimits(int32 LODIndex, TArray<int32>& OutShellLimits) const;
+
+	/** Relevance of every material the fur draws on top of the mesh, for the given feature level. */
+	FMaterialRelevance GetShellMaterialRelevance(ERHIFeatureLevel::Type FeatureLevel) const;
+
+	virtual FPrimitiveSceneProxy* CreateSceneProxy() override;
+	virtual FBoxSphereBounds CalcBounds(const FTransform& LocalToWorld) const override;
+	virtual void GetUsedMaterials(TArray<UMaterialInterface*>& OutMaterials, bool bGetDebugMaterials = false) const override;
+
+protected:
+	virtual void OnRegister() override;
+
+private:
+	/** Shell materials of FurLayers, kept apart from MultiPassMaterial so they are never saved with the component. */
+	UPROPERTY(Transient)
+	TArray<UMaterialInterface*> FurLayerShellMaterials;
+
+	/** Pulls the shell materials from FurLayers into FurLayerShellMaterials. */
+	void ApplyFurLayers();
+};
@@ -0,0 +1,140 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "FurStaticMeshSceneProxy.h"
+#include "FurStaticMeshComponent.h"
+#include "FurStats.h"
+#include "FurShellHelpers.h"
+#include "Engine/StaticMesh.h"
+
+FurStaticMeshSceneProxy::FurStaticMeshSceneProxy(UFurStaticMeshComponent* Component)
+	: FStaticMeshSceneProxy(Component, false)
+{
+	for (UMaterialInterface* Material : Component->GetShellMaterials())
+	{
+		if (Material != nullptr)
+		{
+			ShellMaterials.Add(Material);
+		}
+	}
+	MaxShellsPerMeshLOD = Component->MaxShellsPerMeshLOD;
+
+	SectionShellLimits.SetNum(RenderData->LODResources.Num());
+	for (int32 LODIndex = 0; LODIndex < SectionShellLimits.Num(); ++LODIndex)
+	{
+		Component->GetSectionShellLimits(LODIndex, SectionShellLimits[LODIndex]);
+	}
+
+	MaterialRelevance |= Component->GetShellMaterialRelevance(GetScene().GetFeatureLevel());
+}
+
+SIZE_T FurStaticMeshSceneProxy::GetTypeHash() const
+{
+	static size_t UniquePointer;
+	return reinterpret_cast<size_t>(&UniquePointer);
+}
+
+int32 FurStaticMeshSceneProxy::GetShellCount(int32 LODIndex) const
+{
+	int32 ShellCount = ShellMaterials.Num();
+	if (MaxShellsPerMeshLOD.IsValidIndex(LODIndex) && MaxShellsPerMeshLOD[LODIndex] >= 0)
+	{
+		ShellCount = FMath::Min(ShellCount, MaxShellsPerMeshLOD[LODIndex]);
+	}
+	return ShellCount;
+}
+
+template<typename DrawFunctionType>
+void FurStaticMeshSceneProxy::ForEachShell(int32 LODIndex, DrawFunctionType&& Draw) const
+{
+	if (ShellMaterials.Num() == 0 || !SectionShellLimits.IsValidIndex(LODIndex))
+	{
+		return;
+	}
+	const int32 TotalShells = ShellMaterials.Num();
+	const int32 LODShells = GetShellCount(LODIndex);
+	const TArray<int32>& Limits = SectionShellLimits[LODIndex];
+	for (int32 SectionIndex = 0; SectionIndex < Limits.Num(); ++SectionIndex)
+	{
+		const int32 SectionShells = Limits[SectionIndex] < 0 ? LODShells : FMath::Min(Limits[SectionIndex], LODShells);
+		if (SectionShells <= 0)
+		{
+			continue;
+		}
+		for (int32 i = 0; i < SectionShells; ++i)
+		{
+			Draw(SectionIndex, FFurShellHelpers::GetLODShellIndex(i, SectionShells, TotalShells));
+		}
+	}
+}
+
+bool FurStaticMeshSceneProxy::GetShellMeshElement(int32 LODIndex, int32 SectionIndex, int32 ShellIndex, uint8 DepthPriorityGroup,
+	bool bUseSelectionOutline, FMeshBatch& OutMeshBatch) const
+{
+	if (!GetMeshElement(LODIndex, 0, SectionIndex, DepthPriorityGroup, bUseSelectionOutline, true, OutMeshBatch))
+	{
+		return false;
+	}
+	OutMeshBatch.MaterialRenderProxy = ShellMaterials[ShellIndex]->GetRenderProxy();
+	OutMeshBatch.bUseAsOccluder = false;
+	return true;
+}
+
+void FurStaticMeshSceneProxy::DrawStaticElements(FStaticPrimitiveDrawInterface* PDI)
+{
+	FStaticMeshSceneProxy::DrawStaticElements(PDI);
+
+	if (!HasViewDependentDPG())
+	{
+		const uint8 PrimitiveDPG = GetStaticDepthPriorityGroup();
+		for (int32 LODIndex = 0; LODIndex < RenderData->LODResources.Num(); ++LODIndex)
+		{
+			const float ScreenSize = GetScreenSize(LODIndex);
+			ForEachShell(LODIndex, [this, PDI, LODIndex, PrimitiveDPG, ScreenSize](int32 SectionIndex, int32 ShellIndex)
+			{
+				FMeshBatch MeshBatch;
+				if (GetShellMeshElement(LODIndex, SectionIndex, ShellIndex, PrimitiveDPG, false, MeshBatch))
+				{
+					PDI->DrawMesh(MeshBatch, ScreenSize);
+				}
+			});
+		}
+	}
+}
+
+void FurStaticMeshSceneProxy::GetDynamicMeshElements(const TArray<const FSceneView*>& Views, const FSceneViewFamily& ViewFamily,
+	uint32 VisibilityMap, FMeshElementCollector& Collector) const
+{
+	FUR_SCOPE_TIMING(GetDynamicMeshElements);
+	FStaticMeshSceneProxy::GetDynamicMeshElements(Views, ViewFamily, VisibilityMap, Collector);
+
+	// Only views the static draws don't cover get here, such as selected or debug view modes in the editor.
+	if (ViewFamily.EngineShowFlags.Collision)
+	{
+		return;
+	}
+#if WITH_EDITOR
+	const bool bUseSelectionOutline = IsSelected();
+#else
+	const bool bUseSelectionOutline = false;
+#endif
+	for (int32 ViewIndex = 0; ViewIndex < Views.Num(); ViewIndex++)
+	{
+		if (!(VisibilityMap & (1 << ViewIndex)))
+		{
+			continue;
+		}
+		const FSceneView* View = Views[ViewIndex];
+		const int32 LODIndex = GetLOD(View);
+		const uint8 DepthPriorityGroup = GetDepthPriorityGroup(View);
+		ForEachShell(LODIndex, [this, &Collector, ViewIndex, LODIndex, DepthPriorityGroup, bUseSelectionOutline](int32 SectionIndex, int32 ShellIndex)
+		{
+			FMeshBatch& MeshBatch = Collector.AllocateMesh();
+			if (GetShellMeshElement(LODIndex, SectionIndex, ShellIndex, DepthPriorityGroup, bUseSelectionOutline, MeshBatch))
+			{
+				Collector.AddMesh(ViewIndex, MeshBatch);
+				FUR_COUNTER_ADD(ShellBatches, 1);
+			}
+		});
+	}
+}
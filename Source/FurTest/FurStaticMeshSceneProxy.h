@@ -0,0 +1,44 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "StaticMeshResources.h"
+
+class UFurStaticMeshComponent;
+
+/**
+ * Static mesh proxy that adds the fur shells to the static draws, one batch per (LOD, section, shell).
+ * Views that need dynamic relevance get the same batches dynamically.
+ */
+class FURTEST_API FurStaticMeshSceneProxy : public FStaticMeshSceneProxy
+{
+public:
+	FurStaticMeshSceneProxy(UFurStaticMeshComponent* Component);
+
+	virtual SIZE_T GetTypeHash() const override;
+	virtual void DrawStaticElements(FStaticPrimitiveDrawInterface* PDI) override;
+	virtual void GetDynamicMeshElements(const TArray<const FSceneView*>& Views, const FSceneViewFamily& ViewFamily,
+		uint32 VisibilityMap, FMeshElementCollector& Collector) const override;
+
+private:
+	/** Non-null shell materials in draw order. */
+	TArray<UMaterialInterface*> ShellMaterials;
+	TArray<int32> MaxShellsPerMeshLOD;
+	/** Per LOD, per section shell limit resolved from the component: 0 = no fur, negative = no limit. */
+	TArray<TArray<int32>> SectionShellLimits;
+
+	/** Shells drawn at a mesh LOD, before section limits. */
+	int32 GetShellCount(int32 LODIndex) const;
+
+	/**
+	 * Calls Draw(SectionIndex, ShellIndex) for every shell batch of a LOD.
+	 * ShellIndex indexes ShellMaterials; shells are spread over the full stack when a limit drops some.
+	 */
+	template<typename DrawFunctionType>
+	void ForEachShell(int32 LODIndex, DrawFunctionType&& Draw) const;
+
+	/** Fills a mesh batch for one shell of a section from the base batch of that section. */
+	bool GetShellMeshElement(int32 LODIndex, int32 SectionIndex, int32 ShellIndex, uint8 DepthPriorityGroup,
+		bool bUseSelectionOutline, FMeshBatch& OutMeshBatch) const;
+};
@@ -0,0 +1,45 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "FurStats.h"
+
+DEFINE_STAT(STAT_FurShellBatches);
+DEFINE_STAT(STAT_FurSectionsSkipped);
+DEFINE_STAT(STAT_FurShellsCulledByLOD);
+DEFINE_STAT(STAT_FurSectionsCulled);
+DEFINE_STAT(STAT_FurSectionsSkinCached);
+DEFINE_STAT(STAT_FurSectionsSkinnedPerShell);
+DEFINE_STAT(STAT_FurSectionsInstanced);
+DEFINE_STAT(STAT_FurTriangles);
+DEFINE_STAT(STAT_FurShadowCaptures);
+DEFINE_STAT(STAT_FurShellLoop);
+DEFINE_STAT(STAT_FurTickParameters);
+DEFINE_STAT(STAT_FurDynamics);
+
+CSV_DEFINE_CATEGORY_MODULE(FURTEST_API, Fur, true);
+
+bool FFurTimings::bEnabled = false;
+TAtomic<uint64> FFurTimings::Cycles[(int32)EFurTiming::Num];
+TAtomic<uint64> FFurTimings::Calls[(int32)EFurTiming::Num];
+
+void FFurTimings::Reset()
+{
+	for (int32 i = 0; i < (int32)EFurTiming::Num; ++i)
+	{
+		Cycles[i] = 0;
+		Calls[i] = 0;
+	}
+}
+
+const TCHAR* FFurTimings::GetName(EFurTiming Timing)
+{
+	switch (Timing)
+	{
+	case EFurTiming::TickComponent: return TEXT("TickComponent");
+	case EFurTiming::ShadowTick: return TEXT("ShadowTick");
+	case EFurTiming::CreateSceneProxy: return TEXT("CreateSceneProxy");
+	case EFurTiming::GetDynamicMeshElements: return TEXT("GetDynamicMeshElements");
+	case EFurTiming::Dynamics: return TEXT("Dynamics");
+	default: return TEXT("Unknown");
+	}
+}
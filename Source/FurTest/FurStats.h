@@ -0,0 +1,99 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Templates/Atomic.h"
+#include "Stats/Stats.h"
+#include "ProfilingDebugging/CsvProfiler.h"
+
+/** Fur cost per frame, shown by `stat fur`. The main values are also written to CSV captures under the Fur category. */
+DECLARE_STATS_GROUP(TEXT("Fur"), STATGROUP_Fur, STATCAT_Advanced);
+
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Shell batches"), STAT_FurShellBatches, STATGROUP_Fur, FURTEST_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Sections skipped"), STAT_FurSectionsSkipped, STATGROUP_Fur, FURTEST_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Shells culled by LOD"), STAT_FurShellsCulledByLOD, STATGROUP_Fur, FURTEST_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Sections frustum culled"), STAT_FurSectionsCulled, STATGROUP_Fur, FURTEST_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Sections skinned once (skin cache)"), STAT_FurSectionsSkinCached, STATGROUP_Fur, FURTEST_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Sections skinned per shell"), STAT_FurSectionsSkinnedPerShell, STATGROUP_Fur, FURTEST_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Sections drawn instanced"), STAT_FurSectionsInstanced, STATGROUP_Fur, FURTEST_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Fur triangles"), STAT_FurTriangles, STATGROUP_Fur, FURTEST_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Shadow captures"), STAT_FurShadowCaptures, STATGROUP_Fur, FURTEST_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Shell loop"), STAT_FurShellLoop, STATGROUP_Fur, FURTEST_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Tick parameter update"), STAT_FurTickParameters, STATGROUP_Fur, FURTEST_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Dynamics"), STAT_FurDynamics, STATGROUP_Fur, FURTEST_API);
+
+CSV_DECLARE_CATEGORY_MODULE_EXTERN(FURTEST_API, Fur);
+
+/** Adds to a fur counter stat and to its CSV column of the same name. */
+#define FUR_COUNTER_ADD(Counter, Amount) \
+	do \
+	{ \
+		INC_DWORD_STAT_BY(STAT_Fur##Counter, Amount); \
+		CSV_CUSTOM_STAT(Fur, Counter, (int32)(Amount), ECsvCustomStatOp::Accumulate); \
+	} while (0)
+
+/** Fur code paths timed for the crowd benchmark. */
+enum class EFurTiming : uint8
+{
+	/** UFurSkeletalMeshComponent::TickComponent, animation included. */
+	TickComponent,
+	/** Fur shadow capture and parameter update tick. */
+	ShadowTick,
+	CreateSceneProxy,
+	GetDynamicMeshElements,
+	/** Fur dynamics step for a whole world, all components at once. */
+	Dynamics,
+	Num
+};
+
+/**
+ * Cycle and call totals for fur work, summed over every component and thread.
+ * Off by default; the benchmark commandlet enables and reads them.
+ */
+struct FURTEST_API FFurTimings
+{
+	static bool IsEnabled() { return bEnabled; }
+	static void SetEnabled(bool bInEnabled) { bEnabled = bInEnabled; }
+	static void Reset();
+
+	static void Add(EFurTiming Timing, uint64 InCycles)
+	{
+		Cycles[(int32)Timing] += InCycles;
+		Calls[(int32)Timing] += 1;
+	}
+
+	static double GetMilliseconds(EFurTiming Timing) { return FPlatformTime::ToMilliseconds64(Cycles[(int32)Timing].Load()); }
+	static uint64 GetCalls(EFurTiming Timing) { return Calls[(int32)Timing].Load(); }
+	static const TCHAR* GetName(EFurTiming Timing);
+
+private:
+	static bool bEnabled;
+	static TAtomic<uint64> Cycles[(int32)EFurTiming::Num];
+	static TAtomic<uint64> Calls[(int32)EFurTiming::Num];
+};
+
+/** Adds the time spent in its scope to an EFurTiming when timings are enabled. */
+class FFurScopeTiming
+{
+public:
+	explicit FFurScopeTiming(EFurTiming InTiming)
+		: Timing(InTiming)
+		, StartCycles(FFurTimings::IsEnabled() ? FPlatformTime::Cycles64() : 0)
+	{
+	}
+
+	~FFurScopeTiming()
+	{
+		if (StartCycles != 0)
+		{
+			FFurTimings::Add(Timing, FPlatformTime::Cycles64() - StartCycles);
+		}
+	}
+
+private:
+	EFurTiming Timing;
+	uint64 StartCycles;
+};
+
+#define FUR_SCOPE_TIMING(Timing) FFurScopeTiming PREPROCESSOR_JOIN(FurScopeTiming_, __LINE__)(EFurTiming::Timing)
@@ -9,5 +9,11 @@ public class FurTest : ModuleRules
 		PCHUsage = PCHUsageMode.UseExplicitOrSharedPCHs;
 
 		PublicDependencyModuleNames.AddRange(new string[] { "Core", "CoreUObject", "Engine", "InputCore", "HeadMountedDisplay" });
+		PrivateDependencyModuleNames.AddRange(new string[] { "SignificanceManager", "FurShells" });
+
+		if (Target.bBuildEditor)
+		{
+			PrivateDependencyModuleNames.AddRange(new string[] { "DerivedDataCache", "AssetRegistry" });
+		}
 	}
 }
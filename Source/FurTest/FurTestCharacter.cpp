@@ -9,7 +9,7 @@
 #include "GameFramework/Controller.h"
 #include "GameFramework/SpringArmComponent.h"
 #include "FurSkeletalMeshComponent.h"
-#include "Materials/MaterialInstanceDynamic.h"
+#include "FurLayerAsset.h"
 //////////////////////////////////////////////////////////////////////////
 // AFurTestCharacter
 const FName AFurTestCharacter::FurSkeletalMeshName("FurSkeletalMesh");
@@ -35,7 +35,9 @@ AFurTestCharacter::AFurTestCharacter(const FObjectInitializer& ObjectInitializer
     furMesh = CreateDefaultSubobject<UFurSkeletalMeshComponent>(AFurTestCharacter::FurSkeletalMeshName);
     if(furMesh != nullptr)
     {
-        furMesh->SetupAttachment(RootComponent);
+        furMesh->SetupAttachment(GetMesh());
+        furMesh->bUseOwnerPose = true;
+        furMesh->bFurSignificance = true;
     }
 	// Create a camera boom (pulls in towards the player if there is a collision)
 	CameraBoom = CreateDefaultSubobject<USpringArmComponent>(TEXT("CameraBoom"));
@@ -139,19 +141,18 @@ void AFurTestCharacter::MoveRight(float Value)
 }
 void AFurTestCharacter::BeginPlay()
 {
-	if (PassMaterials != nullptr && furMesh != nullptr)
+	if (furMesh != nullptr && furMesh->FurLayers == nullptr)
 	{
-		for (int i = 0; i < 15; ++i)
+		// Shells are shared by every character using the same layers, so spawning doesn't create any.
+		UFurLayerAsset* layers = FurLayers;
+		if (layers == nullptr && PassMaterials != nullptr)
 		{
-			auto tempMat = UMaterialInstanceDynamic::Create(PassMaterials, this);
-			//tempMat->SetVectorParameterValue(FName("Param"), FLinearColor(FMath::VRand()));
-			tempMat->SetScalarParameterValue(FName("Offset"), i);
-			tempMat->SetScalarParameterValue(FName("MaxLayer"), 15);
-			tempMat->SetScalarParameterValue(FName("DarkBase"), 0.0f);
-			furMesh->MultiPassMaterial.Add(tempMat);
+			layers = UFurLayerAsset::FindOrCreateTransient(GetWorld(), PassMaterials, 15, 0.0f);
+		}
+		if (layers != nullptr)
+		{
+			furMesh->SetFurLayers(layers);
 		}
-
-		furMesh->MarkRenderStateDirty();
 	}
     bool ss =furMesh != nullptr;
     Super::BeginPlay();
@@ -26,6 +26,10 @@ public:
     
     UPROPERTY(Category="FurTestCharacter", EditAnywhere, BlueprintReadWrite)
     UMaterialInterface* PassMaterials;
+
+    /** Shell stack for furMesh. Takes precedence over PassMaterials. */
+    UPROPERTY(Category="FurTestCharacter", EditAnywhere, BlueprintReadWrite)
+    class UFurLayerAsset* FurLayers;
     
 	/** Base turn rate, in deg/sec. Other scaling may affect final turn rate. */
 	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category=Camera)
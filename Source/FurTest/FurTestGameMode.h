@@ -13,6 +13,9 @@ class AFurTestGameMode : public AGameModeBase
 
 public:
 	AFurTestGameMode();
+
+	/** Updates the world's significance manager from every player's view point. */
+	virtual void Tick(float DeltaSeconds) override;
 };
 
 
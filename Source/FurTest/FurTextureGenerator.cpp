@@ -0,0 +1,437 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "FurTextureGenerator.h"
+#include "Engine/Texture2D.h"
+#include "Async/ParallelFor.h"
+#include "Math/VectorRegister.h"
+#include "Math/RandomStream.h"
+#include "Serialization/MemoryReader.h"
+#include "Serialization/MemoryWriter.h"
+#if WITH_EDITOR
+#include "DerivedDataCacheInterface.h"
+#include "AssetRegistryModule.h"
+#include "Misc/PackageName.h"
+#include "UObject/Package.h"
+#endif
+
+DEFINE_LOG_CATEGORY_STATIC(LogFurTexture, Log, All);
+
+// Change to invalidate every cached texture after a change to the generator.
+#define FURTEXTURE_DERIVEDDATA_VER TEXT("A3C95E1F0B7D4B28916E2D4F8C0A57B3")
+
+namespace
+{
+	const int32 MinResolution = 32;
+	const int32 MaxResolution = 2048;
+
+	/** Generated textures by cache key. Game thread only. */
+	TMap<FString, TSharedPtr<const FFurGeneratedTextures>> GFurTextureCache;
+
+	uint32 HashLattice(int32 X, int32 Y, int32 Octave, int32 Seed)
+	{
+		uint32 Hash = (uint32)X * 73856093u ^ (uint32)Y * 19349663u ^ (uint32)Octave * 83492791u ^ (uint32)Seed * 2654435761u;
+		Hash ^= Hash >> 13;
+		Hash *= 0x5bd1e995u;
+		Hash ^= Hash >> 15;
+		return Hash;
+	}
+
+	float LatticeValue(int32 X, int32 Y, int32 Period, int32 Octave, int32 Seed)
+	{
+		X = ((X % Period) + Period) % Period;
+		Y = ((Y % Period) + Period) % Period;
+		return (HashLattice(X, Y, Octave, Seed) & 0xffff) / 65535.0f;
+	}
+
+	/** Tileable value noise summed over octaves, in [0, 1]. U and V are in texture space, [0, 1) per tile. */
+	float DensityNoise(float U, float V, const FFurTextureSettings& Settings)
+	{
+		float Sum = 0.0f;
+		float Amplitude = 1.0f;
+		float TotalAmplitude = 0.0f;
+		int32 Period = FMath::Max(Settings.DensityFrequency, 1);
+		for (int32 Octave = 0; Octave < Settings.DensityOctaves; ++Octave)
+		{
+			const float X = U * Period;
+			const float Y = V * Period;
+			const int32 X0 = FMath::FloorToInt(X);
+			const int32 Y0 = FMath::FloorToInt(Y);
+			const float FracX = FMath::SmoothStep(0.0f, 1.0f, X - X0);
+			const float FracY = FMath::SmoothStep(0.0f, 1.0f, Y - Y0);
+			const float Value = FMath::Lerp(
+				FMath::Lerp(LatticeValue(X0, Y0, Period, Octave, Settings.Seed), LatticeValue(X0 + 1, Y0, Period, Octave, Settings.Seed), FracX),
+				FMath::Lerp(LatticeValue(X0, Y0 + 1, Period, Octave, Settings.Seed), LatticeValue(X0 + 1, Y0 + 1, Period, Octave, Settings.Seed), FracX),
+				FracY);
+			Sum += Value * Amplitude;
+			TotalAmplitude += Amplitude;
+			Amplitude *= 0.5f;
+			Period *= 2;
+		}
+		return TotalAmplitude > 0.0f ? Sum / TotalAmplitude : 1.0f;
+	}
+
+	/** Appends 2x2 box filtered mips down to 1x1. */
+	void BuildMips(int32 Size, TArray<TArray<uint8>>& Mips)
+	{
+		for (int32 MipSize = Size / 2; MipSize >= 1; MipSize /= 2)
+		{
+			const TArray<uint8>& Source = Mips.Last();
+			const int32 SourceSize = MipSize * 2;
+			TArray<uint8> Mip;
+			Mip.SetNumUninitialized(MipSize * MipSize);
+			for (int32 Y = 0; Y < MipSize; ++Y)
+			{
+				for (int32 X = 0; X < MipSize; ++X)
+				{
+					const int32 First = Y * 2 * SourceSize + X * 2;
+					Mip[Y * MipSize + X] = (uint8)((Source[First] + Source[First + 1] + Source[First + SourceSize] + Source[First + SourceSize + 1] + 2) / 4);
+				}
+			}
+			Mips.Add(MoveTemp(Mip));
+		}
+	}
+
+	/** Strands near one strand cell, positions shifted to undo wrapping. Padded to a multiple of four with empty strands. */
+	struct FStrandCandidates
+	{
+		TArray<float, TInlineAllocator<32>> X;
+		TArray<float, TInlineAllocator<32>> Y;
+		TArray<float, TInlineAllocator<32>> Height;
+		TArray<float, TInlineAllocator<32>> InvRadius;
+
+		void Reset()
+		{
+			X.Reset();
+			Y.Reset();
+			Height.Reset();
+			InvRadius.Reset();
+		}
+
+		void Add(float InX, float InY, float InHeight, float InInvRadius)
+		{
+			X.Add(InX);
+			Y.Add(InY);
+			Height.Add(InHeight);
+			InvRadius.Add(InInvRadius);
+		}
+
+		void Pad()
+		{
+			while (X.Num() % 4 != 0)
+			{
+				Add(0.0f, 0.0f, 0.0f, 0.0f);
+			}
+		}
+	};
+
+	/**
+	 * Highest layer fraction any candidate strand covers a texel at. A strand is a cone of height H and root
+	 * radius R, so at distance D it reaches H * (1 - D / R). Evaluated four strands at a time.
+	 */
+	float StrandReach(const FStrandCandidates& Candidates, float PixelX, float PixelY)
+	{
+		const VectorRegister PX = VectorSetFloat1(PixelX);
+		const VectorRegister PY = VectorSetFloat1(PixelY);
+		const VectorRegister Epsilon = VectorSetFloat1(1e-8f);
+		VectorRegister Best = VectorZero();
+		for (int32 Index = 0; Index < Candidates.X.Num(); Index += 4)
+		{
+			const VectorRegister DX = VectorSubtract(VectorLoad(&Candidates.X[Index]), PX);
+			const VectorRegister DY = VectorSubtract(VectorLoad(&Candidates.Y[Index]), PY);
+			const VectorRegister DistanceSquared = VectorMultiplyAdd(DX, DX, VectorMultiply(DY, DY));
+			const VectorRegister Distance = VectorMultiply(DistanceSquared, VectorReciprocalSqrt(VectorAdd(DistanceSquared, Epsilon)));
+			const VectorRegister Profile = VectorSubtract(VectorOne(), VectorMultiply(Distance, VectorLoad(&Candidates.InvRadius[Index])));
+			Best = VectorMax(Best, VectorMultiply(VectorLoad(&Candidates.Height[Index]), Profile));
+		}
+		float Lanes[4];
+		VectorStore(Best, Lanes);
+		return FMath::Max(FMath::Max(Lanes[0], Lanes[1]), FMath::Max(Lanes[2], Lanes[3]));
+	}
+
+	UTexture2D* CreateTransientTexture(int32 Size, const TArray<TArray<uint8>>& Mips)
+	{
+		UTexture2D* Texture = UTexture2D::CreateTransient(Size, Size, PF_G8);
+		if (Texture == nullptr)
+		{
+			return nullptr;
+		}
+		Texture->SRGB = false;
+		Texture->CompressionSettings = TC_Grayscale;
+
+		FTexturePlatformData* PlatformData = Texture->PlatformData;
+		for (int32 MipIndex = 0; MipIndex < Mips.Num(); ++MipIndex)
+		{
+			if (!PlatformData->Mips.IsValidIndex(MipIndex))
+			{
+				FTexture2DMipMap* NewMip = new FTexture2DMipMap();
+				NewMip->SizeX = FMath::Max(Size >> MipIndex, 1);
+				NewMip->SizeY = NewMip->SizeX;
+				PlatformData->Mips.Add(NewMip);
+			}
+			FTexture2DMipMap& Mip = PlatformData->Mips[MipIndex];
+			Mip.BulkData.Lock(LOCK_READ_WRITE);
+			void* Data = Mip.BulkData.Realloc(Mips[MipIndex].Num());
+			FMemory::Memcpy(Data, Mips[MipIndex].GetData(), Mips[MipIndex].Num());
+			Mip.BulkData.Unlock();
+		}
+		Texture->UpdateResource();
+		return Texture;
+	}
+
+#if WITH_EDITOR
+	UTexture2D* SaveTextureAsset(int32 Size, const TArray<uint8>& Pixels, const FString& PackagePath, const FString& AssetName)
+	{
+		const FString PackageName = PackagePath / AssetName;
+		UPackage* Package = CreatePackage(nullptr, *PackageName);
+		Package->FullyLoad();
+
+		UTexture2D* Texture = FindObject<UTexture2D>(Package, *AssetName);
+		if (Texture == nullptr)
+		{
+			Texture = NewObject<UTexture2D>(Package, *AssetName, RF_Public | RF_Standalone);
+			FAssetRegistryModule::AssetCreated(Texture);
+		}
+		Texture->PreEditChange(nullptr);
+		// Mips are rebuilt by the texture build from the top level.
+		Texture->Source.Init(Size, Size, 1, 1, TSF_G8, Pixels.GetData());
+		Texture->SRGB = false;
+		Texture->CompressionSettings = TC_Grayscale;
+		Texture->PostEditChange();
+		Package->MarkPackageDirty();
+
+		const FString Filename = FPackageName::LongPackageNameToFilename(PackageName, FPackageName::GetAssetPackageExtension());
+		if (!UPackage::SavePackage(Package, Texture, RF_Public | RF_Standalone, *Filename))
+		{
+			UE_LOG(LogFurTexture, Error, TEXT("Could not save %s."), *Filename);
+			return nullptr;
+		}
+		return Texture;
+	}
+#endif
+}
+
+int32 FFurTextureGenerator::GetResolution(const FFurTextureSettings& Settings, int32 LayerCount)
+{
+	if (Settings.Resolution > 0)
+	{
+		return FMath::Clamp<int32>(FMath::RoundUpToPowerOfTwo(Settings.Resolution), MinResolution, MaxResolution * 2);
+	}
+	// A strand's radius shrinks to zero over the layers; each layer should take at least half a texel off it,
+	// so the root radius needs LayerCount / 2 texels and the spacing between strands LayerCount / StrandThickness.
+	const float TexelsPerStrand = FMath::Max(LayerCount, 1) / FMath::Max(Settings.StrandThickness, 0.01f);
+	const int32 Size = FMath::CeilToInt(TexelsPerStrand * FMath::Max(Settings.Density, 1));
+	return FMath::Clamp<int32>(FMath::RoundUpToPowerOfTwo(Size), MinResolution, MaxResolution);
+}
+
+float FFurTextureGenerator::GetLayerAlphaThreshold(const FFurTextureSettings& Settings, int32 Layer, int32 LayerCount)
+{
+	const float Alpha = LayerCount > 1 ? FMath::Clamp((float)Layer / (LayerCount - 1), 0.0f, 1.0f) : 0.0f;
+	return FMath::Lerp(Settings.RootAlphaThreshold, Settings.TipAlphaThreshold, Alpha);
+}
+
+FString FFurTextureGenerator::GetCacheKey(const FFurTextureSettings& Settings, int32 Size)
+{
+	return FString::Printf(TEXT("%d_%d_%.4f_%.4f_%d_%.4f_%.4f_%d_%d_%d"), Size, Settings.Density, Settings.StrandThickness,
+		Settings.Clumping, Settings.ClumpsPerSide, Settings.HeightVariation, Settings.DensityVariation,
+		Settings.DensityFrequency, Settings.DensityOctaves, Settings.Seed);
+}
+
+TSharedPtr<const FFurGeneratedTextures> FFurTextureGenerator::GetOrBuild(const FFurTextureSettings& Settings, int32 LayerCount)
+{
+	check(IsInGameThread());
+	const int32 Size = GetResolution(Settings, LayerCount);
+	const FString Key = GetCacheKey(Settings, Size);
+	if (const TSharedPtr<const FFurGeneratedTextures>* Cached = GFurTextureCache.Find(Key))
+	{
+		return *Cached;
+	}
+
+	TSharedPtr<FFurGeneratedTextures> Generated;
+#if WITH_EDITOR
+	const FString DerivedDataKey = FDerivedDataCacheInterface::BuildCacheKey(TEXT("FURTEX"), FURTEXTURE_DERIVEDDATA_VER, *Key);
+	TArray<uint8> DerivedData;
+	if (GetDerivedDataCacheRef().GetSynchronous(*DerivedDataKey, DerivedData))
+	{
+		Generated = MakeShared<FFurGeneratedTextures>();
+		FMemoryReader Ar(DerivedData);
+		Ar << Generated->Size << Generated->StrandMips << Generated->DensityMips;
+	}
+	else
+	{
+		Generated = Build(Settings, Size);
+		FMemoryWriter Ar(DerivedData);
+		Ar << Generated->Size << Generated->StrandMips << Generated->DensityMips;
+		GetDerivedDataCacheRef().Put(*DerivedDataKey, DerivedData);
+	}
+#else
+	Generated = Build(Settings, Size);
+#endif
+
+	GFurTextureCache.Add(Key, Generated);
+	return Generated;
+}
+
+TSharedPtr<FFurGeneratedTextures> FFurTextureGenerator::Build(const FFurTextureSettings& Settings, int32 Size)
+{
+	TSharedPtr<FFurGeneratedTextures> Generated = MakeShared<FFurGeneratedTextures>();
+	Generated->Size = Size;
+	const float InvSize = 1.0f / Size;
+
+	// Density first, the strands sample it to thin themselves out.
+	TArray<uint8> Density;
+	Density.SetNumUninitialized(Size * Size);
+	ParallelFor(Size, [&](int32 Y)
+	{
+		for (int32 X = 0; X < Size; ++X)
+		{
+			const float Noise = DensityNoise((X + 0.5f) * InvSize, (Y + 0.5f) * InvSize, Settings);
+			Density[Y * Size + X] = (uint8)FMath::RoundToInt(FMath::Lerp(1.0f, Noise, Settings.DensityVariation) * 255.0f);
+		}
+	});
+
+	// One jittered strand per cell, pulled towards its clump, and dropped where the density is low.
+	const int32 NumCells = FMath::Max(Settings.Density, 1);
+	const float CellSize = (float)Size / NumCells;
+	const float InvRadius = 2.0f / (FMath::Max(Settings.StrandThickness, 0.01f) * CellSize);
+	const int32 NumClumps = FMath::Max(Settings.ClumpsPerSide, 1);
+	const float ClumpSize = (float)Size / NumClumps;
+
+	FRandomStream Random(Settings.Seed);
+	TArray<FVector2D> ClumpCenters;
+	ClumpCenters.SetNumUninitialized(NumClumps * NumClumps);
+	for (int32 ClumpIndex = 0; ClumpIndex < ClumpCenters.Num(); ++ClumpIndex)
+	{
+		ClumpCenters[ClumpIndex] = FVector2D((ClumpIndex % NumClumps + Random.FRand()) * ClumpSize, (ClumpIndex / NumClumps + Random.FRand()) * ClumpSize);
+	}
+
+	TArray<FVector2D> StrandPositions;
+	TArray<float> StrandHeights;
+	TArray<int32> StrandCells;
+	for (int32 CellIndex = 0; CellIndex < NumCells * NumCells; ++CellIndex)
+	{
+		FVector2D Position((CellIndex % NumCells + Random.FRand()) * CellSize, (CellIndex / NumCells + Random.FRand()) * CellSize);
+		const float Height = 1.0f - Settings.HeightVariation * Random.FRand();
+		const float Keep = Random.FRand();
+
+		// Nearest clump centre across the wrap; the clump grid cell and its neighbours are enough.
+		const int32 ClumpX = FMath::FloorToInt(Position.X / ClumpSize);
+		const int32 ClumpY = FMath::FloorToInt(Position.Y / ClumpSize);
+		FVector2D ToClump(0.0f, 0.0f);
+		float BestDistance = MAX_flt;
+		for (int32 OffsetY = -1; OffsetY <= 1; ++OffsetY)
+		{
+			for (int32 OffsetX = -1; OffsetX <= 1; ++OffsetX)
+			{
+				const int32 WrappedX = (ClumpX + OffsetX + NumClumps) % NumClumps;
+				const int32 WrappedY = (ClumpY + OffsetY + NumClumps) % NumClumps;
+				const FVector2D Shift((ClumpX + OffsetX - WrappedX) * ClumpSize, (ClumpY + OffsetY - WrappedY) * ClumpSize);
+				const FVector2D Delta = ClumpCenters[WrappedY * NumClumps + WrappedX] + Shift - Position;
+				if (Delta.SizeSquared() < BestDistance)
+				{
+					BestDistance = Delta.SizeSquared();
+					ToClump = Delta;
+				}
+			}
+		}
+		Position += ToClump * Settings.Clumping;
+		Position.X = FMath::Fmod(Position.X + Size, (float)Size);
+		Position.Y = FMath::Fmod(Position.Y + Size, (float)Size);
+
+		const int32 TexelX = FMath::Clamp(FMath::FloorToInt(Position.X), 0, Size - 1);
+		const int32 TexelY = FMath::Clamp(FMath::FloorToInt(Position.Y), 0, Size - 1);
+		if (Keep * 255.0f > Density[TexelY * Size + TexelX])
+		{
+			continue;
+		}
+		StrandPositions.Add(Position);
+		StrandHeights.Add(Height);
+		StrandCells.Add(FMath::Min(FMath::FloorToInt(Position.Y / CellSize), NumCells - 1) * NumCells + FMath::Min(FMath::FloorToInt(Position.X / CellSize), NumCells - 1));
+	}
+
+	// Bin strands by the cell they ended up in; a strand's radius is at most half a cell, so a texel only sees its cell and the neighbours.
+	TArray<int32> CellStart;
+	CellStart.SetNumZeroed(NumCells * NumCells + 1);
+	for (int32 Cell : StrandCells)
+	{
+		++CellStart[Cell + 1];
+	}
+	for (int32 CellIndex = 0; CellIndex < NumCells * NumCells; ++CellIndex)
+	{
+		CellStart[CellIndex + 1] += CellStart[CellIndex];
+	}
+	TArray<int32> CellStrands;
+	CellStrands.SetNumUninitialized(StrandCells.Num());
+	{
+		TArray<int32> Fill = CellStart;
+		for (int32 StrandIndex = 0; StrandIndex < StrandCells.Num(); ++StrandIndex)
+		{
+			CellStrands[Fill[StrandCells[StrandIndex]]++] = StrandIndex;
+		}
+	}
+
+	TArray<uint8> Strands;
+	Strands.SetNumUninitialized(Size * Size);
+	ParallelFor(NumCells, [&](int32 CellY)
+	{
+		const int32 FirstRow = FMath::Clamp(FMath::CeilToInt(CellY * CellSize - 0.5f), 0, Size);
+		const int32 EndRow = FMath::Clamp(FMath::CeilToInt((CellY + 1) * CellSize - 0.5f), 0, Size);
+		FStrandCandidates Candidates;
+		for (int32 CellX = 0; CellX < NumCells; ++CellX)
+		{
+			Candidates.Reset();
+			for (int32 OffsetY = -1; OffsetY <= 1; ++OffsetY)
+			{
+				for (int32 OffsetX = -1; OffsetX <= 1; ++OffsetX)
+				{
+					const int32 WrappedX = (CellX + OffsetX + NumCells) % NumCells;
+					const int32 WrappedY = (CellY + OffsetY + NumCells) % NumCells;
+					const float ShiftX = (CellX + OffsetX - WrappedX) * CellSize;
+					const float ShiftY = (CellY + OffsetY - WrappedY) * CellSize;
+					const int32 Cell = WrappedY * NumCells + WrappedX;
+					for (int32 Index = CellStart[Cell]; Index < CellStart[Cell + 1]; ++Index)
+					{
+						const int32 StrandIndex = CellStrands[Index];
+						Candidates.Add(StrandPositions[StrandIndex].X + ShiftX, StrandPositions[StrandIndex].Y + ShiftY, StrandHeights[StrandIndex], InvRadius);
+					}
+				}
+			}
+			Candidates.Pad();
+
+			const int32 FirstColumn = FMath::Clamp(FMath::CeilToInt(CellX * CellSize - 0.5f), 0, Size);
+			const int32 EndColumn = FMath::Clamp(FMath::CeilToInt((CellX + 1) * CellSize - 0.5f), 0, Size);
+			for (int32 Y = FirstRow; Y < EndRow; ++Y)
+			{
+				for (int32 X = FirstColumn; X < EndColumn; ++X)
+				{
+					const float Reach = StrandReach(Candidates, X + 0.5f, Y + 0.5f);
+					Strands[Y * Size + X] = (uint8)FMath::RoundToInt(FMath::Clamp(Reach, 0.0f, 1.0f) * 255.0f);
+				}
+			}
+		}
+	});
+
+	Generated->StrandMips.Add(MoveTemp(Strands));
+	Generated->DensityMips.Add(MoveTemp(Density));
+	BuildMips(Size, Generated->StrandMips);
+	BuildMips(Size, Generated->DensityMips);
+
+	UE_LOG(LogFurTexture, Verbose, TEXT("Generated %dx%d fur textures with %d strands."), Size, Size, StrandPositions.Num());
+	return Generated;
+}
+
+void FFurTextureGenerator::CreateTransientTextures(const FFurGeneratedTextures& Generated, UTexture2D*& OutStrandTexture, UTexture2D*& OutDensityTexture)
+{
+	OutStrandTexture = CreateTransientTexture(Generated.Size, Generated.StrandMips);
+	OutDensityTexture = CreateTransientTexture(Generated.Size, Generated.DensityMips);
+}
+
+#if WITH_EDITOR
+bool FFurTextureGenerator::SaveTextureAssets(const FFurGeneratedTextures& Generated, const FString& PackagePath, const FString& BaseName,
+	UTexture2D*& OutStrandTexture, UTexture2D*& OutDensityTexture)
+{
+	OutStrandTexture = SaveTextureAsset(Generated.Size, Generated.StrandMips[0], PackagePath, BaseName + TEXT("_Strand"));
+	OutDensityTexture = SaveTextureAsset(Generated.Size, Generated.DensityMips[0], PackagePath, BaseName + TEXT("_Density"));
+	return OutStrandTexture != nullptr && OutDensityTexture != nullptr;
+}
+#endif
@@ -0,0 +1,121 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "FurTextureGenerator.generated.h"
+
+class UTexture2D;
+
+/**
+ * Inputs of the procedural fur textures. Both textures tile and are single channel:
+ * the strand texture holds, per texel, the highest layer fraction a strand still covers it at,
+ * the density texture a multi-octave noise that thins strands out.
+ */
+USTRUCT(BlueprintType)
+struct FFurTextureSettings
+{
+	GENERATED_BODY()
+
+	/** Strands along one side of the texture, before density thins them out. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Fur Texture", meta = (ClampMin = "1", ClampMax = "512"))
+	int32 Density;
+
+	/** Root diameter of a strand, as a fraction of the spacing between strands. Strands taper to a point at their tip. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Fur Texture", meta = (ClampMin = "0.01", ClampMax = "1.0"))
+	float StrandThickness;
+
+	/** How far strands are pulled towards the centre of their clump. 0 spreads them evenly. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Fur Texture", meta = (ClampMin = "0.0", ClampMax = "1.0"))
+	float Clumping;
+
+	/** Clumps along one side of the texture. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Fur Texture", meta = (ClampMin = "1", ClampMax = "128"))
+	int32 ClumpsPerSide;
+
+	/** How much shorter than full length a strand can be, at random. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Fur Texture", meta = (ClampMin = "0.0", ClampMax = "1.0"))
+	float HeightVariation;
+
+	/** How much the density noise thins strands out. 0 keeps every strand. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Fur Texture", meta = (ClampMin = "0.0", ClampMax = "1.0"))
+	float DensityVariation;
+
+	/** Noise cells along one side of the texture for the first density octave; each further octave doubles it. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Fur Texture", meta = (ClampMin = "1", ClampMax = "64"))
+	int32 DensityFrequency;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Fur Texture", meta = (ClampMin = "1", ClampMax = "8"))
+	int32 DensityOctaves;
+
+	/** Strand texture value the innermost layer is clipped at. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Fur Texture", meta = (ClampMin = "0.0", ClampMax = "1.0"))
+	float RootAlphaThreshold;
+
+	/** Strand texture value the outermost layer is clipped at. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Fur Texture", meta = (ClampMin = "0.0", ClampMax = "1.0"))
+	float TipAlphaThreshold;
+
+	/** Texture size. 0 picks the smallest power of two that resolves the strand taper over the layer count. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Fur Texture", meta = (ClampMin = "0", ClampMax = "4096"))
+	int32 Resolution;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Fur Texture")
+	int32 Seed;
+
+	FFurTextureSettings()
+		: Density(64)
+		, StrandThickness(0.5f)
+		, Clumping(0.0f)
+		, ClumpsPerSide(8)
+		, HeightVariation(0.3f)
+		, DensityVariation(0.5f)
+		, DensityFrequency(4)
+		, DensityOctaves(4)
+		, RootAlphaThreshold(0.01f)
+		, TipAlphaThreshold(0.95f)
+		, Resolution(0)
+		, Seed(0)
+	{
+	}
+};
+
+/** Generated pixels of both fur textures, full mip chains, one byte per texel. */
+struct FFurGeneratedTextures
+{
+	int32 Size = 0;
+	TArray<TArray<uint8>> StrandMips;
+	TArray<TArray<uint8>> DensityMips;
+};
+
+/**
+ * Builds tileable strand and density textures for shell materials from FFurTextureSettings.
+ * Results are cached in memory by settings and, in the editor, in the derived data cache.
+ */
+struct FURTEST_API FFurTextureGenerator
+{
+	/** Texture size used for the settings when drawn with LayerCount shells. */
+	static int32 GetResolution(const FFurTextureSettings& Settings, int32 LayerCount);
+
+	/** Alpha clip value of one shell layer, from the root and tip thresholds. */
+	static float GetLayerAlphaThreshold(const FFurTextureSettings& Settings, int32 Layer, int32 LayerCount);
+
+	/** Returns the textures for the settings, generating them if they are not cached. Game thread only. */
+	static TSharedPtr<const FFurGeneratedTextures> GetOrBuild(const FFurTextureSettings& Settings, int32 LayerCount);
+
+	/** Transient G8 textures holding the generated pixels, for runtime use. The caller keeps them referenced. */
+	static void CreateTransientTextures(const FFurGeneratedTextures& Generated, UTexture2D*& OutStrandTexture, UTexture2D*& OutDensityTexture);
+
+#if WITH_EDITOR
+	/**
+	 * Saves the generated textures as <BaseName>_Strand and <BaseName>_Density assets under PackagePath.
+	 * Returns false if either package could not be saved.
+	 */
+	static bool SaveTextureAssets(const FFurGeneratedTextures& Generated, const FString& PackagePath, const FString& BaseName,
+		UTexture2D*& OutStrandTexture, UTexture2D*& OutDensityTexture);
+#endif
+
+private:
+	static TSharedPtr<FFurGeneratedTextures> Build(const FFurTextureSettings& Settings, int32 Size);
+	static FString GetCacheKey(const FFurTextureSettings& Settings, int32 Size);
+};